@@ -0,0 +1,894 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "../src/bitmap.h"
+#include "../src/bitmap-wide.h"
+#include "../src/thread-pool.h"
+#include "../src/bitmap-stats.h"
+#include "../src/bitmap-registry.h"
+#include "../src/bitmap-ewah.h"
+#include "../src/bitmap-cow.h"
+#include "../src/bitmap-expr.h"
+
+#define BENCH_SEED 0x9E3779B97F4A7C15ULL   /* Every workload starts from this seed, runs are reproducible */
+#define BENCH_MIN_MS 200                   /* Default time each workload is repeated for */
+#define BENCH_MANY 64                      /* Inputs of the N-way workloads */
+#define BENCH_CLUSTER 64                   /* Consecutive values per cluster of the clustered pattern */
+#define BENCH_WIDE_CAPACITY (1U << 27)     /* 16 MiB wide bitmaps, a multiple of 64 so no tail bits */
+#define BENCH_REGISTRY_CAPACITY 1024       /* Capacity of the bitmaps of the registry workloads */
+#define BENCH_RUNS 16                      /* Ranges of values in the bitmaps of the run workloads */
+#define BENCH_EXPR "(A & B) | ~(C | D)"    /* Query of the expression workloads, A to D are many[0] to many[3] */
+
+enum bench_pattern
+{
+    PATTERN_RANDOM = 0,
+    PATTERN_SEQUENTIAL,
+    PATTERN_CLUSTERED
+};
+
+/* Everything a workload works on, built by its setup outside the timed region */
+struct bench_ctx
+{
+    u32 capacity;
+    u32 density;                           /* Percent of the values set in the inputs */
+    u8 pattern;
+    u64 rng;
+    u32 cluster;                           /* Start of the current cluster of the clustered pattern */
+    struct bitmap *a;
+    struct bitmap *b;
+    struct bitmap *out;
+    struct bitmap *many[BENCH_MANY];
+    struct bitmap_wide *wa;
+    struct bitmap_wide *wb;
+    struct bitmap_registry *reg;
+    struct bitmap_ewah *ea;
+    struct bitmap_ewah *eb;
+    struct bitmap_cow *ca;
+    struct bitmap_expr *expr;
+    u16 *values;
+    u32 nvalues;
+    u8 *text;
+    char *buf;
+    size_t buf_cap;
+};
+
+struct bench_case
+{
+    const char *name;
+    u32 capacity;
+    u32 density;
+    u8 pattern;
+    void (*setup)(struct bench_ctx *ctx);
+    u64 (*run)(struct bench_ctx *ctx);     /* One pass, returns the operations it did */
+};
+
+struct bench_options
+{
+    bool json;
+    const char *filter;
+    u32 min_ms;
+    u32 threads;
+    u32 parallel_threshold;
+};
+
+/* Heap traffic of the timed region, counted by the allocator wrappers below */
+static u64 alloc_bytes = 0;
+static u64 alloc_calls = 0;
+
+#if defined(__GLIBC__)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static void count_alloc(size_t size)
+{
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_calls, 1, __ATOMIC_RELAXED);
+
+    return;
+}
+
+void *malloc(size_t size)
+{
+    count_alloc(size);
+
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    count_alloc(nmemb * size);
+
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count_alloc(size);
+
+    return __libc_realloc(ptr, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    count_alloc(size);
+
+    return __libc_memalign(alignment, size);
+}
+#endif
+
+static u64 now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+/* xorshift64*, small and the same on every platform */
+static u64 next_rand(struct bench_ctx *ctx)
+{
+    ctx->rng ^= ctx->rng >> 12;
+    ctx->rng ^= ctx->rng << 25;
+    ctx->rng ^= ctx->rng >> 27;
+
+    return ctx->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static u16 next_value(struct bench_ctx *ctx, u32 i)
+{
+    switch (ctx->pattern)
+    {
+    case PATTERN_SEQUENTIAL:
+        return (u16)(i % ctx->capacity + 1);
+    case PATTERN_CLUSTERED:
+        /* Runs of BENCH_CLUSTER values starting at random points */
+        if (i % BENCH_CLUSTER == 0)
+        {
+            ctx->cluster = (u32)(next_rand(ctx) % ctx->capacity);
+        }
+
+        return (u16)((ctx->cluster + i % BENCH_CLUSTER) % ctx->capacity + 1);
+    default:
+        return (u16)(next_rand(ctx) % ctx->capacity + 1);
+    }
+}
+
+static struct bitmap *random_bitmap(struct bench_ctx *ctx, u32 capacity, u32 density)
+{
+    struct bitmap *bm = bitMap_create((u16)capacity);
+    u32 v = 0;
+
+    for (v = 1; v <= capacity; v++)
+    {
+        if (next_rand(ctx) % 100 < density)
+        {
+            bitmap_add_value(bm, (u16)v);
+        }
+    }
+
+    return bm;
+}
+
+/* BENCH_RUNS ranges of up to density percent of the capacity each, the shape of archived snapshots */
+static struct bitmap *runs_bitmap(struct bench_ctx *ctx, u32 capacity, u32 density)
+{
+    struct bitmap *bm = bitMap_create((u16)capacity);
+    u32 lo = 0;
+    u32 hi = 0;
+    u32 i = 0;
+
+    for (i = 0; i < BENCH_RUNS; i++)
+    {
+        lo = (u32)(next_rand(ctx) % capacity) + 1;
+        hi = lo + (u32)(next_rand(ctx) % (capacity * density / 100 + 1));
+        bitmap_add_range(bm, (u16)lo, (u16)(hi < capacity ? hi : capacity));
+    }
+
+    return bm;
+}
+
+static void fill_values(struct bench_ctx *ctx)
+{
+    u32 i = 0;
+
+    ctx->values = (u16 *)malloc(ctx->capacity * sizeof(u16));
+
+    for (i = 0; i < ctx->capacity; i++)
+    {
+        ctx->values[i] = next_value(ctx, i);
+    }
+
+    ctx->nvalues = ctx->capacity;
+
+    return;
+}
+
+static void setup_values(struct bench_ctx *ctx)
+{
+    fill_values(ctx);
+    ctx->a = bitMap_create((u16)ctx->capacity);
+
+    return;
+}
+
+static void setup_inputs(struct bench_ctx *ctx)
+{
+    u32 i = 0;
+
+    ctx->a = random_bitmap(ctx, ctx->capacity, ctx->density);
+    ctx->b = random_bitmap(ctx, ctx->capacity, ctx->density);
+    ctx->out = bitMap_create((u16)ctx->capacity);
+    ctx->buf_cap = (size_t)ctx->capacity * 14 + 1;
+    ctx->buf = (char *)malloc(ctx->buf_cap);
+
+    for (i = 0; i < BENCH_MANY; i++)
+    {
+        ctx->many[i] = random_bitmap(ctx, ctx->capacity, ctx->density);
+    }
+
+    return;
+}
+
+static void setup_probe(struct bench_ctx *ctx)
+{
+    ctx->a = random_bitmap(ctx, ctx->capacity, ctx->density);
+    fill_values(ctx);
+
+    return;
+}
+
+static void setup_text(struct bench_ctx *ctx)
+{
+    struct bitmap *bm = random_bitmap(ctx, ctx->capacity, ctx->density);
+    size_t len = bitmap_format(bm, NULL, 0);
+
+    ctx->text = (u8 *)malloc(len + 1);
+    bitmap_format(bm, (char *)ctx->text, len + 1);
+    bitmap_destroy(bm);
+
+    return;
+}
+
+static void setup_wide(struct bench_ctx *ctx)
+{
+    u32 i = 0;
+
+    ctx->wa = bitmap_wide_create(ctx->capacity);
+    ctx->wb = bitmap_wide_create(ctx->capacity);
+
+    for (i = 0; i < ctx->wa->buf_len; i++)
+    {
+        ctx->wa->buf[i] = next_rand(ctx) & next_rand(ctx);
+        ctx->wb->buf[i] = next_rand(ctx) | next_rand(ctx);
+    }
+
+    ctx->wa->numbers = bitmap_wide_count_set_bits(ctx->wa);
+    ctx->wb->numbers = bitmap_wide_count_set_bits(ctx->wb);
+    ctx->wa->first_value = bitmap_wide_next_value(ctx->wa, 1);
+    ctx->wb->first_value = bitmap_wide_next_value(ctx->wb, 1);
+    ctx->wa->last_value = bitmap_wide_prev_value(ctx->wa, ctx->capacity);
+    ctx->wb->last_value = bitmap_wide_prev_value(ctx->wb, ctx->capacity);
+
+    return;
+}
+
+static void setup_runs(struct bench_ctx *ctx)
+{
+    ctx->a = runs_bitmap(ctx, ctx->capacity, ctx->density);
+    ctx->b = runs_bitmap(ctx, ctx->capacity, ctx->density);
+    ctx->out = bitMap_create((u16)ctx->capacity);
+    ctx->ea = bitmap_ewah_encode(ctx->a);
+    ctx->eb = bitmap_ewah_encode(ctx->b);
+
+    return;
+}
+
+static void setup_cow(struct bench_ctx *ctx)
+{
+    setup_inputs(ctx);
+    ctx->ca = bitmap_cow_from_bitmap(ctx->a);
+
+    return;
+}
+
+static void setup_expr(struct bench_ctx *ctx)
+{
+    setup_inputs(ctx);
+    ctx->expr = bitmap_expr_parse(BENCH_EXPR, NULL);
+
+    return;
+}
+
+/* capacity is the number of bitmaps, keyed by the IDs 0 .. capacity - 1 */
+static void setup_registry(struct bench_ctx *ctx)
+{
+    u32 i = 0;
+
+    ctx->reg = bitmap_registry_create();
+
+    for (i = 0; i < ctx->capacity; i++)
+    {
+        bitmap_registry_add_id(ctx->reg, i, BENCH_REGISTRY_CAPACITY);
+    }
+
+    return;
+}
+
+static void teardown(struct bench_ctx *ctx)
+{
+    u32 i = 0;
+
+    bitmap_destroy(ctx->a);
+    bitmap_destroy(ctx->b);
+    bitmap_destroy(ctx->out);
+
+    for (i = 0; i < BENCH_MANY; i++)
+    {
+        bitmap_destroy(ctx->many[i]);
+    }
+
+    bitmap_wide_destroy(ctx->wa);
+    bitmap_wide_destroy(ctx->wb);
+    bitmap_registry_destroy(ctx->reg);
+    bitmap_ewah_destroy(ctx->ea);
+    bitmap_ewah_destroy(ctx->eb);
+    bitmap_cow_destroy(ctx->ca);
+    bitmap_expr_destroy(ctx->expr);
+    free(ctx->values);
+    free(ctx->text);
+    free(ctx->buf);
+    memset(ctx, 0, sizeof(struct bench_ctx));
+
+    return;
+}
+
+static u64 run_add(struct bench_ctx *ctx)
+{
+    u32 i = 0;
+
+    for (i = 0; i < ctx->nvalues; i++)
+    {
+        bitmap_add_value(ctx->a, ctx->values[i]);
+    }
+
+    bitmap_del_range(ctx->a, 1, (u16)ctx->capacity);
+
+    return ctx->nvalues;
+}
+
+static u64 run_del(struct bench_ctx *ctx)
+{
+    u32 i = 0;
+
+    bitmap_add_range(ctx->a, 1, (u16)ctx->capacity);
+
+    for (i = 0; i < ctx->nvalues; i++)
+    {
+        bitmap_del_value(ctx->a, ctx->values[i]);
+    }
+
+    return ctx->nvalues;
+}
+
+static u64 run_add_many(struct bench_ctx *ctx)
+{
+    bitmap_add_many(ctx->a, ctx->values, ctx->nvalues);
+    bitmap_del_range(ctx->a, 1, (u16)ctx->capacity);
+
+    return ctx->nvalues;
+}
+
+static u64 run_del_many(struct bench_ctx *ctx)
+{
+    bitmap_add_range(ctx->a, 1, (u16)ctx->capacity);
+    bitmap_del_many(ctx->a, ctx->values, ctx->nvalues);
+
+    return ctx->nvalues;
+}
+
+static u64 run_contains(struct bench_ctx *ctx)
+{
+    u32 i = 0;
+    u32 hits = 0;
+
+    for (i = 0; i < ctx->nvalues; i++)
+    {
+        hits += is_value_set(ctx->a, ctx->values[i]);
+    }
+
+    /* Keep the probes from being optimized away */
+    ctx->rng += hits;
+
+    return ctx->nvalues;
+}
+
+static u64 run_not(struct bench_ctx *ctx)
+{
+    bitmap_not(ctx->a);
+
+    return 1;
+}
+
+static u64 run_and(struct bench_ctx *ctx)
+{
+    bitmap_clone_into(ctx->out, ctx->a);
+    bitmap_and(ctx->out, ctx->b);
+
+    return 1;
+}
+
+static u64 run_or(struct bench_ctx *ctx)
+{
+    bitmap_clone_into(ctx->out, ctx->a);
+    bitmap_or(ctx->out, ctx->b);
+
+    return 1;
+}
+
+/* Five set operations and one cardinality read, the shape of a typical query pipeline */
+static u64 chain(struct bench_ctx *ctx, bool lazy)
+{
+    bitmap_set_lazy(ctx->out, lazy);
+    bitmap_clone_into(ctx->out, ctx->a);
+    bitmap_or(ctx->out, ctx->b);
+    bitmap_not(ctx->out);
+    bitmap_or(ctx->out, ctx->a);
+    bitmap_and(ctx->out, ctx->b);
+    bitmap_xor_new(ctx->out, ctx->a, ctx->out);
+    ctx->rng += bitmap_cardinality(ctx->out);
+
+    return 1;
+}
+
+static u64 run_chain(struct bench_ctx *ctx)
+{
+    return chain(ctx, false);
+}
+
+static u64 run_chain_lazy(struct bench_ctx *ctx)
+{
+    return chain(ctx, true);
+}
+
+static u64 run_and_many(struct bench_ctx *ctx)
+{
+    bitmap_and_many(ctx->out, ctx->many, BENCH_MANY);
+
+    return 1;
+}
+
+static u64 run_or_many(struct bench_ctx *ctx)
+{
+    bitmap_or_many(ctx->out, ctx->many, BENCH_MANY);
+
+    return 1;
+}
+
+static u64 run_count(struct bench_ctx *ctx)
+{
+    ctx->rng += count_set_bits(ctx->a);
+
+    return 1;
+}
+
+static u64 run_clone(struct bench_ctx *ctx)
+{
+    bitmap_destroy(bitmap_clone(ctx->a));
+
+    return 1;
+}
+
+static u64 run_clone_into(struct bench_ctx *ctx)
+{
+    bitmap_clone_into(ctx->out, ctx->a);
+
+    return 1;
+}
+
+static u64 run_parse(struct bench_ctx *ctx)
+{
+    bitmap_destroy(bitmap_parse_str(ctx->text));
+
+    return 1;
+}
+
+static u64 run_format(struct bench_ctx *ctx)
+{
+    bitmap_format(ctx->a, ctx->buf, ctx->buf_cap);
+
+    return 1;
+}
+
+static u64 run_print(struct bench_ctx *ctx)
+{
+    bitmap_print(ctx->a);
+
+    return 1;
+}
+
+static u64 run_wide_not(struct bench_ctx *ctx)
+{
+    bitmap_wide_not(ctx->wa);
+
+    return 1;
+}
+
+static u64 run_wide_and(struct bench_ctx *ctx)
+{
+    bitmap_wide_and(ctx->wa, ctx->wb);
+
+    return 1;
+}
+
+static u64 run_wide_or(struct bench_ctx *ctx)
+{
+    bitmap_wide_or(ctx->wa, ctx->wb);
+
+    return 1;
+}
+
+static u64 run_wide_count(struct bench_ctx *ctx)
+{
+    ctx->rng += bitmap_wide_count_set_bits(ctx->wa);
+
+    return 1;
+}
+
+static u64 run_ewah_encode(struct bench_ctx *ctx)
+{
+    bitmap_ewah_destroy(bitmap_ewah_encode(ctx->a));
+
+    return 1;
+}
+
+static u64 run_ewah_decode(struct bench_ctx *ctx)
+{
+    bitmap_ewah_decode(ctx->ea, ctx->out);
+
+    return 1;
+}
+
+static u64 run_ewah_and(struct bench_ctx *ctx)
+{
+    bitmap_ewah_destroy(bitmap_ewah_and(ctx->ea, ctx->eb));
+
+    return 1;
+}
+
+static u64 run_ewah_or(struct bench_ctx *ctx)
+{
+    bitmap_ewah_destroy(bitmap_ewah_or(ctx->ea, ctx->eb));
+
+    return 1;
+}
+
+static u64 run_ewah_and_cardinality(struct bench_ctx *ctx)
+{
+    ctx->rng += bitmap_ewah_and_cardinality(ctx->ea, ctx->eb);
+
+    return 1;
+}
+
+static u64 run_cow_clone(struct bench_ctx *ctx)
+{
+    bitmap_cow_destroy(bitmap_cow_clone(ctx->ca));
+
+    return 1;
+}
+
+/* Snapshot, then change one value of the snapshot: one table and one chunk are copied */
+static u64 run_cow_snapshot_write(struct bench_ctx *ctx)
+{
+    struct bitmap_cow *snap = bitmap_cow_clone(ctx->ca);
+
+    bitmap_cow_add_value(snap, (u16)(next_rand(ctx) % ctx->capacity + 1));
+    bitmap_cow_del_value(snap, (u16)(next_rand(ctx) % ctx->capacity + 1));
+    bitmap_cow_destroy(snap);
+
+    return 1;
+}
+
+/* Both operands are clones of the same bitmap with one value changed, so all but one chunk is shared */
+static u64 run_cow_and_shared(struct bench_ctx *ctx)
+{
+    struct bitmap_cow *snap = bitmap_cow_clone(ctx->ca);
+
+    bitmap_cow_add_value(snap, (u16)(next_rand(ctx) % ctx->capacity + 1));
+    bitmap_cow_and(snap, ctx->ca);
+    bitmap_cow_destroy(snap);
+
+    return 1;
+}
+
+/* BENCH_EXPR the way it is written without the evaluator, one pass and one recount per operator */
+static u64 run_expr_steps(struct bench_ctx *ctx)
+{
+    struct bitmap *tmp = NULL;
+
+    bitmap_clone_into(ctx->out, ctx->many[0]);
+    bitmap_and(ctx->out, ctx->many[1]);
+    tmp = bitmap_clone(ctx->many[2]);
+    bitmap_or(tmp, ctx->many[3]);
+    bitmap_not(tmp);
+    bitmap_or(ctx->out, tmp);
+    bitmap_destroy(tmp);
+    ctx->rng += bitmap_cardinality(ctx->out);
+
+    return 1;
+}
+
+static u64 run_expr_eval(struct bench_ctx *ctx)
+{
+    bitmap_expr_eval(ctx->expr, ctx->many, 4, ctx->out);
+    ctx->rng += ctx->out->numbers;
+
+    return 1;
+}
+
+static u64 run_expr_cardinality(struct bench_ctx *ctx)
+{
+    ctx->rng += bitmap_expr_cardinality(ctx->expr, ctx->many, 4);
+
+    return 1;
+}
+
+static u64 run_registry_find(struct bench_ctx *ctx)
+{
+    u32 i = 0;
+
+    for (i = 0; i < 1024; i++)
+    {
+        ctx->rng += bitmap_registry_get(ctx->reg, bitmap_registry_find_id(ctx->reg, next_rand(ctx) % ctx->capacity))->max_value;
+    }
+
+    return 1024;
+}
+
+/* Drop a random bitmap and add it back, the entry and the slab block are reused */
+static u64 run_registry_churn(struct bench_ctx *ctx)
+{
+    u64 id = 0;
+    u32 i = 0;
+
+    for (i = 0; i < 1024; i++)
+    {
+        id = next_rand(ctx) % ctx->capacity;
+        bitmap_registry_drop(ctx->reg, bitmap_registry_find_id(ctx->reg, id));
+        bitmap_registry_add_id(ctx->reg, id, BENCH_REGISTRY_CAPACITY);
+    }
+
+    return 1024;
+}
+
+static const struct bench_case bench_cases[] =
+{
+    {"add_random", 65535, 0, PATTERN_RANDOM, setup_values, run_add},
+    {"add_sequential", 65535, 0, PATTERN_SEQUENTIAL, setup_values, run_add},
+    {"add_clustered", 65535, 0, PATTERN_CLUSTERED, setup_values, run_add},
+    {"del_random", 65535, 0, PATTERN_RANDOM, setup_values, run_del},
+    {"del_sequential", 65535, 0, PATTERN_SEQUENTIAL, setup_values, run_del},
+    {"del_clustered", 65535, 0, PATTERN_CLUSTERED, setup_values, run_del},
+    {"add_many_random", 65535, 0, PATTERN_RANDOM, setup_values, run_add_many},
+    {"add_many_sequential", 65535, 0, PATTERN_SEQUENTIAL, setup_values, run_add_many},
+    {"del_many_random", 65535, 0, PATTERN_RANDOM, setup_values, run_del_many},
+    {"del_many_sequential", 65535, 0, PATTERN_SEQUENTIAL, setup_values, run_del_many},
+    {"contains_random", 65535, 1, PATTERN_RANDOM, setup_probe, run_contains},
+    {"contains_random", 65535, 50, PATTERN_RANDOM, setup_probe, run_contains},
+    {"not", 1024, 50, PATTERN_RANDOM, setup_inputs, run_not},
+    {"not", 65535, 50, PATTERN_RANDOM, setup_inputs, run_not},
+    {"and", 1024, 1, PATTERN_RANDOM, setup_inputs, run_and},
+    {"and", 1024, 50, PATTERN_RANDOM, setup_inputs, run_and},
+    {"and", 65535, 1, PATTERN_RANDOM, setup_inputs, run_and},
+    {"and", 65535, 50, PATTERN_RANDOM, setup_inputs, run_and},
+    {"or", 1024, 1, PATTERN_RANDOM, setup_inputs, run_or},
+    {"or", 1024, 50, PATTERN_RANDOM, setup_inputs, run_or},
+    {"or", 65535, 1, PATTERN_RANDOM, setup_inputs, run_or},
+    {"or", 65535, 50, PATTERN_RANDOM, setup_inputs, run_or},
+    {"chain", 65535, 50, PATTERN_RANDOM, setup_inputs, run_chain},
+    {"chain_lazy", 65535, 50, PATTERN_RANDOM, setup_inputs, run_chain_lazy},
+    {"and_many", 65535, 50, PATTERN_RANDOM, setup_inputs, run_and_many},
+    {"or_many", 65535, 1, PATTERN_RANDOM, setup_inputs, run_or_many},
+    {"count", 65535, 50, PATTERN_RANDOM, setup_inputs, run_count},
+    {"clone", 65535, 50, PATTERN_RANDOM, setup_inputs, run_clone},
+    {"clone_into", 65535, 50, PATTERN_RANDOM, setup_inputs, run_clone_into},
+    {"expr_steps", 65535, 50, PATTERN_RANDOM, setup_expr, run_expr_steps},
+    {"expr_eval", 65535, 50, PATTERN_RANDOM, setup_expr, run_expr_eval},
+    {"expr_cardinality", 65535, 50, PATTERN_RANDOM, setup_expr, run_expr_cardinality},
+    {"cow_clone", 65535, 50, PATTERN_RANDOM, setup_cow, run_cow_clone},
+    {"cow_snapshot_write", 65535, 50, PATTERN_RANDOM, setup_cow, run_cow_snapshot_write},
+    {"cow_and_shared", 65535, 50, PATTERN_RANDOM, setup_cow, run_cow_and_shared},
+    {"parse_str", 65535, 1, PATTERN_RANDOM, setup_text, run_parse},
+    {"parse_str", 65535, 50, PATTERN_RANDOM, setup_text, run_parse},
+    {"format", 65535, 1, PATTERN_RANDOM, setup_inputs, run_format},
+    {"format", 65535, 50, PATTERN_RANDOM, setup_inputs, run_format},
+    {"print", 65535, 50, PATTERN_RANDOM, setup_inputs, run_print},
+    {"wide_not", BENCH_WIDE_CAPACITY, 50, PATTERN_RANDOM, setup_wide, run_wide_not},
+    {"wide_and", BENCH_WIDE_CAPACITY, 25, PATTERN_RANDOM, setup_wide, run_wide_and},
+    {"wide_or", BENCH_WIDE_CAPACITY, 25, PATTERN_RANDOM, setup_wide, run_wide_or},
+    {"wide_count", BENCH_WIDE_CAPACITY, 25, PATTERN_RANDOM, setup_wide, run_wide_count},
+    {"and_runs", 65535, 5, PATTERN_RANDOM, setup_runs, run_and},
+    {"ewah_encode", 65535, 5, PATTERN_RANDOM, setup_runs, run_ewah_encode},
+    {"ewah_decode", 65535, 5, PATTERN_RANDOM, setup_runs, run_ewah_decode},
+    {"ewah_and", 65535, 5, PATTERN_RANDOM, setup_runs, run_ewah_and},
+    {"ewah_or", 65535, 5, PATTERN_RANDOM, setup_runs, run_ewah_or},
+    {"ewah_and_cardinality", 65535, 5, PATTERN_RANDOM, setup_runs, run_ewah_and_cardinality},
+    {"registry_find", 65536, 0, PATTERN_RANDOM, setup_registry, run_registry_find},
+    {"registry_churn", 65536, 0, PATTERN_RANDOM, setup_registry, run_registry_churn},
+};
+
+static void run_case(const struct bench_case *bc, const struct bench_options *opt, bool first_row)
+{
+    struct bench_ctx ctx;
+    u64 ops = 0;
+    u64 start = 0;
+    u64 elapsed = 0;
+    u64 bytes = 0;
+    u64 calls = 0;
+    double ns_per_op = 0;
+    int saved_stdout = -1;
+    int devnull = -1;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.capacity = bc->capacity;
+    ctx.density = bc->density;
+    ctx.pattern = bc->pattern;
+    ctx.rng = BENCH_SEED;
+    bc->setup(&ctx);
+
+    /* bitmap_print writes to stdout, the results must not be mixed into it */
+    if (bc->run == run_print)
+    {
+        fflush(stdout);
+        saved_stdout = dup(STDOUT_FILENO);
+        devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+    }
+
+    alloc_bytes = 0;
+    alloc_calls = 0;
+    start = now_ns();
+
+    do
+    {
+        ops += bc->run(&ctx);
+        elapsed = now_ns() - start;
+    }
+    while (elapsed < (u64)opt->min_ms * 1000000ULL);
+
+    bytes = alloc_bytes;
+    calls = alloc_calls;
+
+    if (saved_stdout >= 0)
+    {
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+        close(devnull);
+    }
+
+    teardown(&ctx);
+    ns_per_op = (double)elapsed / (double)ops;
+
+    if (opt->json)
+    {
+        printf("%s{\"name\":\"%s\",\"capacity\":%u,\"density\":%u,\"ops\":%llu,\"ns_per_op\":%.3f,"
+               "\"ops_per_s\":%.0f,\"bytes_alloc_per_op\":%.1f,\"allocs_per_op\":%.3f}",
+               first_row ? "" : ",\n", bc->name, bc->capacity, bc->density, (unsigned long long)ops,
+               ns_per_op, 1e9 / ns_per_op, (double)bytes / (double)ops, (double)calls / (double)ops);
+    }
+    else
+    {
+        printf("%s,%u,%u,%llu,%.3f,%.0f,%.1f,%.3f\n", bc->name, bc->capacity, bc->density,
+               (unsigned long long)ops, ns_per_op, 1e9 / ns_per_op, (double)bytes / (double)ops,
+               (double)calls / (double)ops);
+    }
+
+    fflush(stdout);
+
+    return;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [--json] [--filter NAME] [--min-ms N] [--threads N] [--parallel-threshold WORDS]\n"
+            "  --json                      One JSON array instead of CSV rows\n"
+            "  --filter NAME               Only workloads whose name contains NAME\n"
+            "  --min-ms N                  Repeat each workload for at least N ms (default %d)\n"
+            "  --threads N                 Thread pool size for the wide bitmap workloads (default 0, off)\n"
+            "  --parallel-threshold WORDS  Smallest wide bitmap split over the pool\n",
+            prog, BENCH_MIN_MS);
+
+    return;
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_options opt;
+    struct thread_pool *pool = NULL;
+    bool first_row = true;
+    size_t i = 0;
+    int arg = 0;
+
+    memset(&opt, 0, sizeof(opt));
+    opt.min_ms = BENCH_MIN_MS;
+
+    for (arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "--json") == 0)
+        {
+            opt.json = true;
+        }
+        else if (strcmp(argv[arg], "--filter") == 0 && arg + 1 < argc)
+        {
+            opt.filter = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "--min-ms") == 0 && arg + 1 < argc)
+        {
+            opt.min_ms = (u32)strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc)
+        {
+            opt.threads = (u32)strtoul(argv[++arg], NULL, 10);
+        }
+        else if (strcmp(argv[arg], "--parallel-threshold") == 0 && arg + 1 < argc)
+        {
+            opt.parallel_threshold = (u32)strtoul(argv[++arg], NULL, 10);
+        }
+        else
+        {
+            usage(argv[0]);
+
+            return 1;
+        }
+    }
+
+    if (opt.threads != 0)
+    {
+        pool = thread_pool_create(opt.threads);
+
+        if (pool == NULL)
+        {
+            fprintf(stderr, "Failed to start %u threads\n", opt.threads);
+
+            return 1;
+        }
+
+        bitmap_wide_set_thread_pool(pool);
+        bitmap_wide_set_parallel_threshold(opt.parallel_threshold);
+    }
+
+    printf(opt.json ? "[\n" : "name,capacity,density,ops,ns_per_op,ops_per_s,bytes_alloc_per_op,allocs_per_op\n");
+
+    for (i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++)
+    {
+        if (opt.filter != NULL && strstr(bench_cases[i].name, opt.filter) == NULL)
+        {
+            continue;
+        }
+
+        run_case(&bench_cases[i], &opt, first_row);
+        first_row = false;
+    }
+
+    if (opt.json)
+    {
+        printf("\n]\n");
+    }
+
+#ifdef BITMAP_STATS
+    /* Per-operation totals of every run above, kept apart from the CSV/JSON on stdout */
+    bitmap_stats_dump(stderr, opt.json);
+#endif
+
+    bitmap_wide_set_thread_pool(NULL);
+    thread_pool_destroy(pool);
+
+    return 0;
+}
@@ -1,8 +1,36 @@
-#include "src/ui-and-input-control.h"
-
-int main()
-{
-    menu();
-
-    return 0;
-}
+#include "src/ui-and-input-control.h"
+#include "src/batch-mode.h"
+
+int main(int argc, char *argv[])
+{
+    const char *script = NULL;
+    bool timing = false;
+    int i = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+        {
+            script = argv[++i];
+        }
+        else if (strcmp(argv[i], "--timing") == 0)
+        {
+            timing = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--batch FILE|- [--timing]]\n", argv[0]);
+
+            return 1;
+        }
+    }
+
+    if (script != NULL)
+    {
+        return batch_main(script, timing);
+    }
+
+    menu();
+
+    return 0;
+}
@@ -0,0 +1,888 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <time.h>
+#include "bitmap.h"
+#include "bitmap-io.h"
+#include "bitmap-registry.h"
+#include "bitmap-expr.h"
+#include "batch-mode.h"
+
+typedef bool (*batch_handler_fn)(struct batch_session *s, char **cursor);
+
+/* A bitmap named on the command line, name points into the line */
+struct batch_ref
+{
+    const char *name;
+    bitmap_handle h;
+    struct bitmap *bm;
+};
+
+struct batch_command_def
+{
+    const char *name;
+    batch_handler_fn run;
+};
+
+static u64 batch_now(void);
+static bool batch_error(struct batch_session *s, const char *fmt, ...);
+static char *next_token(char **cursor);
+static bool parse_u16(const char *tok, u16 *out);
+static bool expect_end(struct batch_session *s, char **cursor);
+static bool take_name(struct batch_session *s, char **cursor, const char **name);
+static bool take_bitmap(struct batch_session *s, char **cursor, struct batch_ref *ref);
+static bool take_value(struct batch_session *s, char **cursor, u16 *value);
+static bool replace_bitmap(struct batch_session *s, const char *name, u16 capacity, struct bitmap **bm);
+static bool copy_bitmap(struct batch_session *s, const char *name, struct bitmap *src);
+static bool take_values(struct batch_session *s, char **cursor, struct bitmap *bm, u32 *n);
+static bool sink_file(void *ctx, const char *data, size_t len);
+static bool cmd_create(struct batch_session *s, char **cursor);
+static bool cmd_add(struct batch_session *s, char **cursor);
+static bool cmd_del(struct batch_session *s, char **cursor);
+static bool cmd_addrange(struct batch_session *s, char **cursor);
+static bool cmd_delrange(struct batch_session *s, char **cursor);
+static bool cmd_and(struct batch_session *s, char **cursor);
+static bool cmd_or(struct batch_session *s, char **cursor);
+static bool cmd_not(struct batch_session *s, char **cursor);
+static bool cmd_eval(struct batch_session *s, char **cursor);
+static bool cmd_clone(struct batch_session *s, char **cursor);
+static bool cmd_lazy(struct batch_session *s, char **cursor);
+static bool cmd_count(struct batch_session *s, char **cursor);
+static bool cmd_print(struct batch_session *s, char **cursor);
+static bool cmd_save(struct batch_session *s, char **cursor);
+static bool cmd_load(struct batch_session *s, char **cursor);
+static bool cmd_destroy(struct batch_session *s, char **cursor);
+
+static const struct batch_command_def batch_commands[] =
+{
+    {"create", cmd_create}, {"add", cmd_add}, {"del", cmd_del}, {"addrange", cmd_addrange},
+    {"delrange", cmd_delrange}, {"and", cmd_and}, {"or", cmd_or}, {"not", cmd_not}, {"eval", cmd_eval},
+    {"clone", cmd_clone}, {"lazy", cmd_lazy}, {"count", cmd_count}, {"print", cmd_print},
+    {"save", cmd_save}, {"load", cmd_load}, {"destroy", cmd_destroy}
+};
+
+_Static_assert(sizeof(batch_commands) / sizeof(batch_commands[0]) == BATCH_COMMANDS, "one entry per BATCH_* command");
+
+static u64 batch_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+static bool batch_error(struct batch_session *s, const char *fmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "line %llu: ", (unsigned long long)s->line);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    s->errors++;
+
+    return false;
+}
+
+/* Split off the next blank separated word in place, NULL at the end of the line */
+static char *next_token(char **cursor)
+{
+    char *p = *cursor;
+    char *tok = NULL;
+
+    while (isspace((u8)*p))
+    {
+        p++;
+    }
+
+    if (*p == '\0')
+    {
+        *cursor = p;
+
+        return NULL;
+    }
+
+    tok = p;
+
+    while (*p != '\0' && !isspace((u8)*p))
+    {
+        p++;
+    }
+
+    if (*p != '\0')
+    {
+        *p++ = '\0';
+    }
+
+    *cursor = p;
+
+    return tok;
+}
+
+static bool parse_u16(const char *tok, u16 *out)
+{
+    u32 value = 0;
+
+    if (*tok == '\0')
+    {
+        return false;
+    }
+
+    for (; *tok != '\0'; tok++)
+    {
+        if (!isdigit((u8)*tok))
+        {
+            return false;
+        }
+
+        value = value * 10 + (u32)(*tok - '0');
+
+        if (value > U16_MAX)
+        {
+            return false;
+        }
+    }
+
+    *out = (u16)value;
+
+    return true;
+}
+
+static bool expect_end(struct batch_session *s, char **cursor)
+{
+    const char *tok = next_token(cursor);
+
+    if (tok != NULL)
+    {
+        return batch_error(s, "unexpected argument '%s'", tok);
+    }
+
+    return true;
+}
+
+static bool take_name(struct batch_session *s, char **cursor, const char **name)
+{
+    *name = next_token(cursor);
+
+    if (*name == NULL)
+    {
+        return batch_error(s, "missing bitmap name");
+    }
+
+    if (strlen(*name) >= BITMAP_REGISTRY_KEY_LEN)
+    {
+        return batch_error(s, "name '%s' is longer than %d characters", *name, BITMAP_REGISTRY_KEY_LEN - 1);
+    }
+
+    return true;
+}
+
+static bool take_bitmap(struct batch_session *s, char **cursor, struct batch_ref *ref)
+{
+    if (!take_name(s, cursor, &ref->name))
+    {
+        return false;
+    }
+
+    ref->h = bitmap_registry_find(s->reg, ref->name);
+    ref->bm = bitmap_registry_get(s->reg, ref->h);
+
+    if (ref->bm == NULL)
+    {
+        return batch_error(s, "no bitmap named '%s'", ref->name);
+    }
+
+    return true;
+}
+
+static bool take_value(struct batch_session *s, char **cursor, u16 *value)
+{
+    const char *tok = next_token(cursor);
+
+    if (tok == NULL)
+    {
+        return batch_error(s, "missing value");
+    }
+
+    if (!parse_u16(tok, value))
+    {
+        return batch_error(s, "'%s' is not a value from 0 to %d", tok, U16_MAX);
+    }
+
+    return true;
+}
+
+/* File a new empty bitmap under name, a bitmap already holding it is replaced only once the new one exists */
+static bool replace_bitmap(struct batch_session *s, const char *name, u16 capacity, struct bitmap **bm)
+{
+    bitmap_handle h = bitmap_registry_find(s->reg, name);
+
+    if (capacity == 0)
+    {
+        return batch_error(s, "capacity must be from 1 to %d", U16_MAX);
+    }
+
+    if (h != BITMAP_HANDLE_NONE)
+    {
+        h = bitmap_registry_replace(s->reg, h, capacity);
+    }
+    else
+    {
+        h = bitmap_registry_add(s->reg, name, capacity);
+    }
+
+    *bm = bitmap_registry_get(s->reg, h);
+
+    if (*bm == NULL)
+    {
+        return batch_error(s, "cannot create a bitmap of capacity %u", (unsigned)capacity);
+    }
+
+    return true;
+}
+
+/* File a copy of src under name, src must not be the bitmap of that name */
+static bool copy_bitmap(struct batch_session *s, const char *name, struct bitmap *src)
+{
+    struct bitmap *bm = NULL;
+
+    if (!replace_bitmap(s, name, src->max_value, &bm))
+    {
+        return false;
+    }
+
+    bitmap_clone_into(bm, src);
+
+    if (src->flags & BITMAP_FLAG_LAZY)
+    {
+        bitmap_set_lazy(bm, true);
+    }
+
+    return true;
+}
+
+/* Read the rest of the line into s->values, every value must fit into bm */
+static bool take_values(struct batch_session *s, char **cursor, struct bitmap *bm, u32 *n)
+{
+    const char *tok = NULL;
+    u16 *grown = NULL;
+    u16 value = 0;
+
+    *n = 0;
+
+    while ((tok = next_token(cursor)) != NULL)
+    {
+        if (!parse_u16(tok, &value) || value == 0 || value > bm->max_value)
+        {
+            return batch_error(s, "'%s' is not a value from 1 to %u", tok, (unsigned)bm->max_value);
+        }
+
+        if (*n == s->values_cap)
+        {
+            grown = (u16 *)realloc(s->values, (size_t)(s->values_cap * 2 + 64) * sizeof(u16));
+
+            if (grown == NULL)
+            {
+                return batch_error(s, "out of memory");
+            }
+
+            s->values = grown;
+            s->values_cap = s->values_cap * 2 + 64;
+        }
+
+        s->values[(*n)++] = value;
+    }
+
+    if (*n == 0)
+    {
+        return batch_error(s, "missing value");
+    }
+
+    return true;
+}
+
+static bool sink_file(void *ctx, const char *data, size_t len)
+{
+    return fwrite(data, 1, len, (FILE *)ctx) == len;
+}
+
+static bool cmd_create(struct batch_session *s, char **cursor)
+{
+    struct bitmap *bm = NULL;
+    const char *name = NULL;
+    u16 capacity = 0;
+
+    if (!take_name(s, cursor, &name) || !take_value(s, cursor, &capacity) || !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    return replace_bitmap(s, name, capacity, &bm);
+}
+
+static bool cmd_add(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+    u32 n = 0;
+
+    if (!take_bitmap(s, cursor, &ref) || !take_values(s, cursor, ref.bm, &n))
+    {
+        return false;
+    }
+
+    bitmap_add_many(ref.bm, s->values, n);
+
+    return true;
+}
+
+static bool cmd_del(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+    u32 n = 0;
+
+    if (!take_bitmap(s, cursor, &ref) || !take_values(s, cursor, ref.bm, &n))
+    {
+        return false;
+    }
+
+    bitmap_del_many(ref.bm, s->values, n);
+
+    return true;
+}
+
+static bool cmd_addrange(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+    u16 lo = 0;
+    u16 hi = 0;
+
+    if (!take_bitmap(s, cursor, &ref) || !take_value(s, cursor, &lo) || !take_value(s, cursor, &hi) ||
+        !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    if (!bitmap_add_range(ref.bm, lo, hi))
+    {
+        return batch_error(s, "range %u-%u does not fit into '%s'", (unsigned)lo, (unsigned)hi, ref.name);
+    }
+
+    return true;
+}
+
+static bool cmd_delrange(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+    u16 lo = 0;
+    u16 hi = 0;
+
+    if (!take_bitmap(s, cursor, &ref) || !take_value(s, cursor, &lo) || !take_value(s, cursor, &hi) ||
+        !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    if (!bitmap_del_range(ref.bm, lo, hi))
+    {
+        return batch_error(s, "range %u-%u does not fit into '%s'", (unsigned)lo, (unsigned)hi, ref.name);
+    }
+
+    return true;
+}
+
+static bool cmd_and(struct batch_session *s, char **cursor)
+{
+    struct batch_ref dst;
+    struct batch_ref src;
+
+    if (!take_bitmap(s, cursor, &dst) || !take_bitmap(s, cursor, &src) || !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    if (!bitmap_and(dst.bm, src.bm))
+    {
+        return batch_error(s, "and of '%s' and '%s' failed", dst.name, src.name);
+    }
+
+    return true;
+}
+
+static bool cmd_or(struct batch_session *s, char **cursor)
+{
+    struct batch_ref dst;
+    struct batch_ref src;
+
+    if (!take_bitmap(s, cursor, &dst) || !take_bitmap(s, cursor, &src) || !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    if (!bitmap_or(dst.bm, src.bm))
+    {
+        return batch_error(s, "or of '%s' and '%s' failed", dst.name, src.name);
+    }
+
+    return true;
+}
+
+static bool cmd_not(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+
+    if (!take_bitmap(s, cursor, &ref) || !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    if (!bitmap_not(ref.bm))
+    {
+        return batch_error(s, "not of '%s' failed", ref.name);
+    }
+
+    return true;
+}
+
+/* The rest of the line is the expression, each of its names is a bitmap of the session */
+static bool cmd_eval(struct batch_session *s, char **cursor)
+{
+    struct bitmap_expr *ex = NULL;
+    struct bitmap **inputs = NULL;
+    struct bitmap *bm = NULL;
+    const char *name = NULL;
+    const char *var = NULL;
+    char *text = NULL;
+    size_t len = 0;
+    size_t offset = 0;
+    u16 vars = 0;
+    u16 i = 0;
+    bool ok = false;
+
+    if (!take_name(s, cursor, &name))
+    {
+        return false;
+    }
+
+    text = *cursor;
+    len = strlen(text);
+
+    while (len > 0 && isspace((u8)text[len - 1]))
+    {
+        text[--len] = '\0';
+    }
+
+    ex = bitmap_expr_parse(text, &offset);
+
+    if (ex == NULL)
+    {
+        return batch_error(s, "bad expression '%s' at offset %zu", text, offset);
+    }
+
+    vars = bitmap_expr_vars(ex);
+    inputs = (struct bitmap **)malloc(vars * sizeof(struct bitmap *));
+
+    if (inputs == NULL)
+    {
+        bitmap_expr_destroy(ex);
+
+        return batch_error(s, "out of memory");
+    }
+
+    for (i = 0; i < vars; i++)
+    {
+        var = bitmap_expr_var_name(ex, i);
+        inputs[i] = bitmap_registry_get(s->reg, bitmap_registry_find(s->reg, var));
+
+        if (inputs[i] == NULL)
+        {
+            batch_error(s, "no bitmap named '%s'", var);
+            break;
+        }
+
+        if (inputs[i]->max_value != inputs[0]->max_value)
+        {
+            batch_error(s, "'%s' and '%s' have different capacities", bitmap_expr_var_name(ex, 0), var);
+            break;
+        }
+    }
+
+    if (i == vars)
+    {
+        /* A destination of the right capacity is written in place, it may also be one of the inputs */
+        bm = bitmap_registry_get(s->reg, bitmap_registry_find(s->reg, name));
+
+        if (bm != NULL && bm->max_value == inputs[0]->max_value)
+        {
+            ok = true;
+        }
+        else
+        {
+            ok = replace_bitmap(s, name, inputs[0]->max_value, &bm);
+        }
+
+        if (ok && !bitmap_expr_eval(ex, inputs, vars, bm))
+        {
+            ok = batch_error(s, "eval into '%s' failed", name);
+        }
+    }
+
+    free(inputs);
+    bitmap_expr_destroy(ex);
+
+    return ok;
+}
+
+static bool cmd_clone(struct batch_session *s, char **cursor)
+{
+    struct batch_ref src;
+    const char *name = NULL;
+
+    if (!take_name(s, cursor, &name) || !take_bitmap(s, cursor, &src) || !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    /* Cloning a bitmap onto its own name changes nothing */
+    if (strcmp(name, src.name) == 0)
+    {
+        return true;
+    }
+
+    return copy_bitmap(s, name, src.bm);
+}
+
+static bool cmd_lazy(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+    const char *mode = NULL;
+
+    if (!take_bitmap(s, cursor, &ref))
+    {
+        return false;
+    }
+
+    mode = next_token(cursor);
+
+    if (mode == NULL || (strcmp(mode, "on") != 0 && strcmp(mode, "off") != 0))
+    {
+        return batch_error(s, "lazy expects on or off");
+    }
+
+    if (!expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    bitmap_set_lazy(ref.bm, strcmp(mode, "on") == 0 ? true : false);
+
+    return true;
+}
+
+static bool cmd_count(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+
+    if (!take_bitmap(s, cursor, &ref) || !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    fprintf(s->out, "%s %u\n", ref.name, (unsigned)bitmap_cardinality(ref.bm));
+
+    return true;
+}
+
+static bool cmd_print(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+
+    if (!take_bitmap(s, cursor, &ref) || !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    fprintf(s->out, "%s:", ref.name);
+
+    if (bitmap_first(ref.bm) != 0)
+    {
+        fputc(' ', s->out);
+        bitmap_format_sink(ref.bm, sink_file, s->out);
+    }
+
+    fputc('\n', s->out);
+
+    return true;
+}
+
+static bool cmd_save(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+    const char *path = NULL;
+
+    if (!take_bitmap(s, cursor, &ref))
+    {
+        return false;
+    }
+
+    path = next_token(cursor);
+
+    if (path == NULL)
+    {
+        return batch_error(s, "missing file name");
+    }
+
+    if (!expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    if (!bitmap_save(ref.bm, path))
+    {
+        return batch_error(s, "cannot save '%s' to %s", ref.name, path);
+    }
+
+    return true;
+}
+
+static bool cmd_load(struct batch_session *s, char **cursor)
+{
+    struct bitmap *loaded = NULL;
+    const char *name = NULL;
+    const char *path = NULL;
+    bool ok = false;
+
+    if (!take_name(s, cursor, &name))
+    {
+        return false;
+    }
+
+    path = next_token(cursor);
+
+    if (path == NULL)
+    {
+        return batch_error(s, "missing file name");
+    }
+
+    if (!expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    loaded = bitmap_load(path);
+
+    if (loaded == NULL)
+    {
+        return batch_error(s, "cannot load %s", path);
+    }
+
+    ok = copy_bitmap(s, name, loaded);
+    bitmap_destroy(loaded);
+
+    return ok;
+}
+
+static bool cmd_destroy(struct batch_session *s, char **cursor)
+{
+    struct batch_ref ref;
+
+    if (!take_bitmap(s, cursor, &ref) || !expect_end(s, cursor))
+    {
+        return false;
+    }
+
+    bitmap_registry_drop(s->reg, ref.h);
+
+    return true;
+}
+
+bool batch_session_init(struct batch_session *s, FILE *out, bool timing)
+{
+    if (s == NULL || out == NULL)
+    {
+        return false;
+    }
+
+    memset(s, 0, sizeof(struct batch_session));
+    s->reg = bitmap_registry_create();
+
+    if (s->reg == NULL)
+    {
+        return false;
+    }
+
+    s->out = out;
+    s->timing = timing;
+
+    return true;
+}
+
+void batch_session_free(struct batch_session *s)
+{
+    if (s == NULL)
+    {
+        return;
+    }
+
+    bitmap_registry_destroy(s->reg);
+    s->reg = NULL;
+
+    free(s->values);
+    s->values = NULL;
+    s->values_cap = 0;
+
+    return;
+}
+
+bool batch_execute(struct batch_session *s, char *line)
+{
+    struct batch_timing *t = NULL;
+    char *cursor = line;
+    const char *tok = NULL;
+    bool ok = false;
+    u64 start = 0;
+    u64 ns = 0;
+    u32 cmd = 0;
+
+    s->line++;
+    tok = next_token(&cursor);
+
+    if (tok == NULL || tok[0] == '#')
+    {
+        return true;
+    }
+
+    for (cmd = 0; cmd < BATCH_COMMANDS; cmd++)
+    {
+        if (strcmp(tok, batch_commands[cmd].name) == 0)
+        {
+            break;
+        }
+    }
+
+    if (cmd == BATCH_COMMANDS)
+    {
+        return batch_error(s, "unknown command '%s'", tok);
+    }
+
+    if (!s->timing)
+    {
+        return batch_commands[cmd].run(s, &cursor);
+    }
+
+    /* Argument parsing and output are timed too, they are part of replaying the command */
+    start = batch_now();
+    ok = batch_commands[cmd].run(s, &cursor);
+    ns = batch_now() - start;
+
+    t = &s->timings[cmd];
+    t->calls++;
+    t->ns_total += ns;
+    t->ns_max = ns > t->ns_max ? ns : t->ns_max;
+    fprintf(stderr, "line %llu: %s %llu ns\n", (unsigned long long)s->line, tok, (unsigned long long)ns);
+
+    return ok;
+}
+
+u64 batch_run_file(struct batch_session *s, FILE *in)
+{
+    struct batch_timing *t = NULL;
+    char *line = NULL;
+    size_t cap = 0;
+    u32 cmd = 0;
+
+    if (s == NULL || in == NULL)
+    {
+        return 1;
+    }
+
+    while (getline(&line, &cap, in) != -1)
+    {
+        batch_execute(s, line);
+    }
+
+    free(line);
+
+    if (ferror(in))
+    {
+        fprintf(stderr, "line %llu: read error\n", (unsigned long long)s->line + 1);
+        s->errors++;
+    }
+
+    if (s->timing)
+    {
+        fprintf(stderr, "%-10s %12s %14s %12s %12s\n", "command", "calls", "ns_total", "mean_ns", "max_ns");
+
+        for (cmd = 0; cmd < BATCH_COMMANDS; cmd++)
+        {
+            t = &s->timings[cmd];
+
+            if (t->calls != 0)
+            {
+                fprintf(stderr, "%-10s %12llu %14llu %12.1f %12llu\n", batch_commands[cmd].name,
+                        (unsigned long long)t->calls, (unsigned long long)t->ns_total,
+                        (double)t->ns_total / (double)t->calls, (unsigned long long)t->ns_max);
+            }
+        }
+    }
+
+    return s->errors;
+}
+
+int batch_main(const char *path, bool timing)
+{
+    struct batch_session s;
+    FILE *in = NULL;
+    u64 errors = 0;
+
+    if (path == NULL)
+    {
+        return 1;
+    }
+
+    in = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+
+    if (in == NULL)
+    {
+        fprintf(stderr, "cannot open %s: %s\n", path, strerror(errno));
+
+        return 1;
+    }
+
+    /* Output is flushed once per buffer, not per line as on a terminal */
+    setvbuf(stdout, NULL, _IOFBF, BATCH_OUT_BUFFER);
+
+    if (timing)
+    {
+        setvbuf(stderr, NULL, _IOFBF, BATCH_OUT_BUFFER);
+    }
+
+    if (!batch_session_init(&s, stdout, timing))
+    {
+        fprintf(stderr, "out of memory\n");
+
+        if (in != stdin)
+        {
+            fclose(in);
+        }
+
+        return 1;
+    }
+
+    errors = batch_run_file(&s, in);
+    batch_session_free(&s);
+
+    if (in != stdin)
+    {
+        fclose(in);
+    }
+
+    if (fflush(stdout) != 0)
+    {
+        errors++;
+    }
+
+    fflush(stderr);
+
+    return errors == 0 ? 0 : 1;
+}
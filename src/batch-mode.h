@@ -0,0 +1,114 @@
+#ifndef BATCH_MODE_H_INCLUDED
+#define BATCH_MODE_H_INCLUDED
+
+#include <stdio.h>
+#include "bitmap.h"
+#include "bitmap-registry.h"
+
+#define BATCH_OUT_BUFFER 65536     /* stdio buffer of the output stream */
+
+/*
+ * Command scripts for the bitmap executable, one command per line:
+ *
+ *   create NAME CAPACITY        add NAME V...          del NAME V...
+ *   addrange NAME LO HI         delrange NAME LO HI    and DST SRC
+ *   or DST SRC                  not NAME               clone DST SRC
+ *   lazy NAME on|off            count NAME             print NAME
+ *   save NAME PATH              load NAME PATH         destroy NAME
+ *   eval DST EXPRESSION
+ *
+ * eval stores an expression such as "(a & b) | ~c" over the named bitmaps, see bitmap-expr.h.
+ * create, clone and load replace a bitmap that already has the name. Blank lines and lines
+ * starting with '#' are skipped. A failed command is reported on stderr with its line number and
+ * the script goes on with the next line.
+ */
+enum batch_command
+{
+    BATCH_CREATE = 0,
+    BATCH_ADD,
+    BATCH_DEL,
+    BATCH_ADDRANGE,
+    BATCH_DELRANGE,
+    BATCH_AND,
+    BATCH_OR,
+    BATCH_NOT,
+    BATCH_EVAL,
+    BATCH_CLONE,
+    BATCH_LAZY,
+    BATCH_COUNT,
+    BATCH_PRINT,
+    BATCH_SAVE,
+    BATCH_LOAD,
+    BATCH_DESTROY,
+    BATCH_COMMANDS
+};
+
+/* Time spent in one kind of command, only filled in when timing is on */
+struct batch_timing
+{
+    u64 calls;
+    u64 ns_total;
+    u64 ns_max;
+};
+
+struct batch_session
+{
+    struct bitmap_registry *reg;   /* The named bitmaps */
+    FILE *out;                     /* count and print write here */
+    bool timing;                   /* Report every command's latency on stderr */
+    u64 line;                      /* Line number of the command being run */
+    u64 errors;                    /* Commands that failed so far */
+    u16 *values;                   /* Scratch array for the values of add/del */
+    u32 values_cap;
+    struct batch_timing timings[BATCH_COMMANDS];
+};
+
+/*****************************************************************************************************
+ * Name: batch_session_init
+ * Input:  s       The session to set up
+ *         out     Stream count and print write to
+ *         timing  true to report the latency of every command on stderr
+ * Return: Success   true
+ *         Failed    false
+ * Description: Start a session without any named bitmaps, release it with batch_session_free
+ *****************************************************************************************************/
+bool batch_session_init(struct batch_session *s, FILE *out, bool timing);
+
+/*****************************************************************************************************
+ * Name: batch_session_free
+ * Input:  s       The session
+ * Return: None
+ * Description: Destroy every named bitmap and the scratch memory of the session
+ *****************************************************************************************************/
+void batch_session_free(struct batch_session *s);
+
+/*****************************************************************************************************
+ * Name: batch_execute
+ * Input:  s       The session
+ *         line    One command, split in place, so it is modified
+ * Return: Success   true, also for blank and comment lines
+ *         Failed    false, the reason is printed on stderr and counted in s->errors
+ * Description: Run one command of the script
+ *****************************************************************************************************/
+bool batch_execute(struct batch_session *s, char *line);
+
+/*****************************************************************************************************
+ * Name: batch_run_file
+ * Input:  s       The session
+ *         in      The script
+ * Return: Number of commands that failed
+ * Description: Run every line of in, lines of any length are accepted. With timing on, a summary
+ *              per command kind is printed on stderr at the end
+ *****************************************************************************************************/
+u64 batch_run_file(struct batch_session *s, FILE *in);
+
+/*****************************************************************************************************
+ * Name: batch_main
+ * Input:  path    The script, "-" for stdin
+ *         timing  true to report per-command latency on stderr
+ * Return: Exit status for main, 0 when every command succeeded
+ * Description: Run a script against a new session writing to stdout
+ *****************************************************************************************************/
+int batch_main(const char *path, bool timing);
+
+#endif // BATCH_MODE_H_INCLUDED
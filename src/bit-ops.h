@@ -0,0 +1,121 @@
+#ifndef BIT_OPS_H_INCLUDED
+#define BIT_OPS_H_INCLUDED
+
+#include "bitmap.h"
+
+/*****************************************************************************************************
+ * Name: popcount32
+ * Input:  word   The word whose '1' bits will be counted
+ * Return: Number of '1' bits in word
+ * Description: Count the set bits of a single 32-bit word. Uses the POPCNT instruction when the
+ *              compiler targets it and a branch-free SWAR reduction otherwise
+ *****************************************************************************************************/
+static inline u32 popcount32(u32 word)
+{
+#if defined(__POPCNT__)
+    return (u32)__builtin_popcount(word);
+#else
+    word = word - ((word >> 1) & 0x55555555U);
+    word = (word & 0x33333333U) + ((word >> 2) & 0x33333333U);
+    word = (word + (word >> 4)) & 0x0F0F0F0FU;
+
+    return (word * 0x01010101U) >> 24;
+#endif
+}
+
+/*****************************************************************************************************
+ * Name: popcount64
+ * Input:  word   The word whose '1' bits will be counted
+ * Return: Number of '1' bits in word
+ * Description: 64-bit counterpart of popcount32
+ *****************************************************************************************************/
+static inline u32 popcount64(u64 word)
+{
+#if defined(__POPCNT__)
+    return (u32)__builtin_popcountll(word);
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+
+    return (u32)((word * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/*****************************************************************************************************
+ * Name: ctz32
+ * Input:  word   A non-zero word
+ * Return: Index of the lowest '1' bit of word
+ * Description: Count trailing zeros. The result is undefined for word == 0, callers skip zero words
+ *****************************************************************************************************/
+static inline u32 ctz32(u32 word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (u32)__builtin_ctz(word);
+#else
+    u32 count = 0;
+
+    while ((word & 1U) == 0)
+    {
+        word >>= 1;
+        count++;
+    }
+
+    return count;
+#endif
+}
+
+/*****************************************************************************************************
+ * Name: clz32
+ * Input:  word   A non-zero word
+ * Return: Number of '0' bits above the highest '1' bit of word
+ * Description: Count leading zeros. The result is undefined for word == 0, callers skip zero words
+ *****************************************************************************************************/
+static inline u32 clz32(u32 word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (u32)__builtin_clz(word);
+#else
+    u32 count = 0;
+
+    while ((word & 0x80000000U) == 0)
+    {
+        word <<= 1;
+        count++;
+    }
+
+    return count;
+#endif
+}
+
+/*****************************************************************************************************
+ * Name: ctz64
+ * Input:  word   A non-zero word
+ * Return: Index of the lowest '1' bit of word
+ * Description: 64-bit counterpart of ctz32
+ *****************************************************************************************************/
+static inline u32 ctz64(u64 word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (u32)__builtin_ctzll(word);
+#else
+    return (u32)word != 0 ? ctz32((u32)word) : 32 + ctz32((u32)(word >> 32));
+#endif
+}
+
+/*****************************************************************************************************
+ * Name: clz64
+ * Input:  word   A non-zero word
+ * Return: Number of '0' bits above the highest '1' bit of word
+ * Description: 64-bit counterpart of clz32
+ *****************************************************************************************************/
+static inline u32 clz64(u64 word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (u32)__builtin_clzll(word);
+#else
+    return (word >> 32) != 0 ? clz32((u32)(word >> 32)) : 32 + clz32((u32)word);
+#endif
+}
+
+#endif // BIT_OPS_H_INCLUDED
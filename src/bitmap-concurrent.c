@@ -0,0 +1,309 @@
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "bitmap-concurrent.h"
+
+static bool bitmap_concurrent_check(struct bitmap_concurrent *bm);
+static struct bitmap_concurrent_shard *concurrent_shard(struct bitmap_concurrent *bm);
+static void concurrent_widen_bounds(struct bitmap_concurrent *bm, u16 value);
+
+/* Shard of the calling thread, CONCURRENT_SHARDS until the thread first writes */
+static _Thread_local u32 thread_shard = CONCURRENT_SHARDS;
+static atomic_uint next_shard;
+
+static bool bitmap_concurrent_check(struct bitmap_concurrent *bm)
+{
+    if (bm != NULL && bm == bm->bm_self)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+static struct bitmap_concurrent_shard *concurrent_shard(struct bitmap_concurrent *bm)
+{
+    if (thread_shard == CONCURRENT_SHARDS)
+    {
+        thread_shard = atomic_fetch_add_explicit(&next_shard, 1, memory_order_relaxed) % CONCURRENT_SHARDS;
+    }
+
+    return &bm->shards[thread_shard];
+}
+
+/* CAS min on first_value and CAS max on last_value, 0 stands for no bound yet */
+static void concurrent_widen_bounds(struct bitmap_concurrent *bm, u16 value)
+{
+    u16 cur = 0;
+
+    cur = atomic_load_explicit(&bm->first_value, memory_order_relaxed);
+
+    while ((cur == 0 || value < cur) &&
+           !atomic_compare_exchange_weak_explicit(&bm->first_value, &cur, value, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+
+    cur = atomic_load_explicit(&bm->last_value, memory_order_relaxed);
+
+    while (value > cur &&
+           !atomic_compare_exchange_weak_explicit(&bm->last_value, &cur, value, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+
+    return;
+}
+
+struct bitmap_concurrent *bitmap_concurrent_create(u16 capacity)
+{
+    u16 buf_len = 0;
+    size_t size = 0;
+    struct bitmap_concurrent *bm = NULL;
+    u32 i = 0;
+
+    if (capacity == 0)
+    {
+        return NULL;
+    }
+
+    /* aligned_alloc wants a whole number of cache lines */
+    buf_len = (capacity + UINT_BITS - 1) / UINT_BITS;
+    size = sizeof(struct bitmap_concurrent) + buf_len * sizeof(_Atomic u32);
+    size = (size + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+    bm = (struct bitmap_concurrent *)aligned_alloc(CACHE_LINE_SIZE, size);
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    memset(bm, 0, size);
+    bm->bm_self = bm;
+    bm->max_value = capacity;
+    bm->buf_len = buf_len;
+    atomic_init(&bm->first_value, 0);
+    atomic_init(&bm->last_value, 0);
+
+    for (i = 0; i < CONCURRENT_SHARDS; i++)
+    {
+        atomic_init(&bm->shards[i].count, 0);
+    }
+
+    for (i = 0; i < buf_len; i++)
+    {
+        atomic_init(&bm->buf[i], 0);
+    }
+
+    return bm;
+}
+
+void bitmap_concurrent_destroy(struct bitmap_concurrent *bm)
+{
+    if (bitmap_concurrent_check(bm))
+    {
+        bm->bm_self = NULL;
+        free(bm);
+    }
+
+    return;
+}
+
+bool bitmap_concurrent_add_value(struct bitmap_concurrent *bm, u16 value)
+{
+    u16 index = 0;
+    u32 mask = 0;
+    u32 old = 0;
+
+    if (!bitmap_concurrent_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    get_index_and_mask(value, &index, &mask);
+    old = atomic_fetch_or_explicit(&bm->buf[index], mask, memory_order_acq_rel);
+
+    /* Another thread set it first, only the thread that flipped the bit counts it */
+    if (old & mask)
+    {
+        return false;
+    }
+
+    atomic_fetch_add_explicit(&concurrent_shard(bm)->count, 1, memory_order_relaxed);
+    concurrent_widen_bounds(bm, value);
+
+    return true;
+}
+
+bool bitmap_concurrent_del_value(struct bitmap_concurrent *bm, u16 value)
+{
+    u16 index = 0;
+    u32 mask = 0;
+    u32 old = 0;
+
+    if (!bitmap_concurrent_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    get_index_and_mask(value, &index, &mask);
+    old = atomic_fetch_and_explicit(&bm->buf[index], ~mask, memory_order_acq_rel);
+
+    if (!(old & mask))
+    {
+        return false;
+    }
+
+    atomic_fetch_sub_explicit(&concurrent_shard(bm)->count, 1, memory_order_relaxed);
+
+    return true;
+}
+
+bool bitmap_concurrent_is_value_set(struct bitmap_concurrent *bm, u16 value)
+{
+    u16 index = 0;
+    u32 mask = 0;
+
+    if (!bitmap_concurrent_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    get_index_and_mask(value, &index, &mask);
+
+    return (atomic_load_explicit(&bm->buf[index], memory_order_acquire) & mask) != 0;
+}
+
+u32 bitmap_concurrent_cardinality(struct bitmap_concurrent *bm)
+{
+    int count = 0;
+    u32 i = 0;
+
+    if (!bitmap_concurrent_check(bm))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < CONCURRENT_SHARDS; i++)
+    {
+        count += atomic_load_explicit(&bm->shards[i].count, memory_order_relaxed);
+    }
+
+    /* A delete may be summed before the add it undoes */
+    return count < 0 ? 0 : (u32)count;
+}
+
+u16 bitmap_concurrent_first(struct bitmap_concurrent *bm)
+{
+    u16 value = 0;
+    u16 index = 0;
+    u32 mask = 0;
+    u32 word = 0;
+
+    if (!bitmap_concurrent_check(bm))
+    {
+        return 0;
+    }
+
+    value = atomic_load_explicit(&bm->first_value, memory_order_relaxed);
+
+    if (value == 0)
+    {
+        return 0;
+    }
+
+    get_index_and_mask(value, &index, &mask);
+    word = atomic_load_explicit(&bm->buf[index], memory_order_acquire) & ~(mask - 1);
+
+    while (word == 0)
+    {
+        if (++index >= bm->buf_len)
+        {
+            return 0;
+        }
+
+        word = atomic_load_explicit(&bm->buf[index], memory_order_acquire);
+    }
+
+    return (u16)(index * UINT_BITS + ctz32(word) + 1);
+}
+
+u16 bitmap_concurrent_last(struct bitmap_concurrent *bm)
+{
+    u16 value = 0;
+    u16 index = 0;
+    u32 mask = 0;
+    u32 word = 0;
+
+    if (!bitmap_concurrent_check(bm))
+    {
+        return 0;
+    }
+
+    value = atomic_load_explicit(&bm->last_value, memory_order_relaxed);
+
+    if (value == 0)
+    {
+        return 0;
+    }
+
+    get_index_and_mask(value, &index, &mask);
+    word = atomic_load_explicit(&bm->buf[index], memory_order_acquire) & (mask | (mask - 1));
+
+    while (word == 0)
+    {
+        if (index == 0)
+        {
+            return 0;
+        }
+
+        word = atomic_load_explicit(&bm->buf[--index], memory_order_acquire);
+    }
+
+    return (u16)(index * UINT_BITS + (UINT_BITS - 1 - clz32(word)) + 1);
+}
+
+void bitmap_concurrent_sync(struct bitmap_concurrent *bm)
+{
+    u16 first = 0;
+    u16 last = 0;
+
+    if (!bitmap_concurrent_check(bm))
+    {
+        return;
+    }
+
+    first = bitmap_concurrent_first(bm);
+    last = bitmap_concurrent_last(bm);
+    atomic_store_explicit(&bm->first_value, first, memory_order_relaxed);
+    atomic_store_explicit(&bm->last_value, last, memory_order_relaxed);
+
+    return;
+}
+
+struct bitmap *bitmap_concurrent_snapshot(struct bitmap_concurrent *bm)
+{
+    struct bitmap *copy = NULL;
+    u16 i = 0;
+
+    if (!bitmap_concurrent_check(bm))
+    {
+        return NULL;
+    }
+
+    copy = bitMap_create(bm->max_value);
+
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < bm->buf_len; i++)
+    {
+        copy->buf[i] = atomic_load_explicit(&bm->buf[i], memory_order_acquire);
+    }
+
+    copy->numbers = count_set_bits(copy);
+    update_first_value(copy);
+    update_last_value(copy);
+
+    return copy;
+}
@@ -0,0 +1,119 @@
+#ifndef BITMAP_CONCURRENT_H_INCLUDED
+#define BITMAP_CONCURRENT_H_INCLUDED
+
+#include <stdatomic.h>
+#include "bitmap.h"
+
+#define CACHE_LINE_SIZE 64
+#define CONCURRENT_SHARDS 32 /* Cardinality counters, threads are spread over them round-robin */
+
+/* One cardinality counter per cache line, deletes may drive a single shard below zero */
+struct bitmap_concurrent_shard
+{
+    _Alignas(CACHE_LINE_SIZE) atomic_int count;
+};
+
+/* Same values as struct bitmap, every field that writers touch is updated atomically */
+struct bitmap_concurrent
+{
+    struct bitmap_concurrent *bm_self;                         /* The value used when creating a bitmap */
+    u16 max_value;                                             /* The value used when creating a bitmap */
+    u16 buf_len;
+    _Atomic u16 first_value;                                   /* No value below it is set, 0 until the first add */
+    _Atomic u16 last_value;                                    /* No value above it is set */
+    struct bitmap_concurrent_shard shards[CONCURRENT_SHARDS];  /* Sum is the number of '1' bits */
+    _Atomic u32 buf[0]; /* Flexible array member for bitmap storage */
+};
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_create
+ * Input:  capacity  The capacity of the bitmap that will be created
+ * Return: Success   pointer to bitmap
+ *         Failed    NULL
+ * Description: Create a bitmap that any number of threads may add to and delete from at once.
+ *              create and destroy themselves must not race with other calls
+ *****************************************************************************************************/
+struct bitmap_concurrent *bitmap_concurrent_create(u16 capacity);
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_destroy
+ * Input: bm        A concurrent bitmap that will be destroyed
+ * Return: None
+ * Description: Destroy a concurrent bitmap once every thread has stopped using it
+ *****************************************************************************************************/
+void bitmap_concurrent_destroy(struct bitmap_concurrent *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_add_value
+ * Input: bm         The bitmap to which values are added
+ *        value      A value that will be added into the bitmap
+ * Return: true when this call set the bit, false when it was already set or value is invalid
+ * Description: Set the bit with an atomic fetch_or, then widen first/last with CAS min/max
+ *****************************************************************************************************/
+bool bitmap_concurrent_add_value(struct bitmap_concurrent *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_del_value
+ * Input: bm         The bitmap from which values are removed
+ *        value      A value that will be removed from the bitmap
+ * Return: true when this call cleared the bit, false when it was already clear or value is invalid
+ * Description: Clear the bit with an atomic fetch_and. first/last are left as bounds and are
+ *              only tightened by bitmap_concurrent_sync
+ *****************************************************************************************************/
+bool bitmap_concurrent_del_value(struct bitmap_concurrent *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_is_value_set
+ * Input:  bm     Pointer to the concurrent bitmap
+ *         value  The value to check in the bitmap
+ * Return: Success   true
+ *         Failed    false
+ * Description: Check if a given value is set
+ *****************************************************************************************************/
+bool bitmap_concurrent_is_value_set(struct bitmap_concurrent *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_cardinality
+ * Input:  bm     Pointer to the concurrent bitmap
+ * Return: Number of set values, 0 for an invalid bitmap
+ * Description: Sum of the relaxed shard counters. Exact once writers are quiet, while they run
+ *              it is the count of some recent moment
+ *****************************************************************************************************/
+u32 bitmap_concurrent_cardinality(struct bitmap_concurrent *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_first
+ * Input:  bm     Pointer to the concurrent bitmap
+ * Return: The smallest set value, 0 when there is none
+ * Description: Scan forward from the first_value bound
+ *****************************************************************************************************/
+u16 bitmap_concurrent_first(struct bitmap_concurrent *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_last
+ * Input:  bm     Pointer to the concurrent bitmap
+ * Return: The largest set value, 0 when there is none
+ * Description: Scan backward from the last_value bound
+ *****************************************************************************************************/
+u16 bitmap_concurrent_last(struct bitmap_concurrent *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_sync
+ * Input:  bm     Pointer to the concurrent bitmap
+ * Return: None
+ * Description: Shrink first_value/last_value back to the exact values after deletes. Must only be
+ *              called while no other thread writes to bm
+ *****************************************************************************************************/
+void bitmap_concurrent_sync(struct bitmap_concurrent *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_concurrent_snapshot
+ * Input:  bm     Pointer to the concurrent bitmap
+ * Return: Success   A new struct bitmap holding a copy of the values
+ *         Failed    NULL
+ * Description: Copy the words into a plain bitmap for the single threaded API. Each word is read
+ *              atomically, the copy as a whole is only consistent when writers are quiet
+ *****************************************************************************************************/
+struct bitmap *bitmap_concurrent_snapshot(struct bitmap_concurrent *bm);
+
+#endif // BITMAP_CONCURRENT_H_INCLUDED
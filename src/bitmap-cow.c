@@ -0,0 +1,745 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "popcount.h"
+#include "word-ops.h"
+#include "bitmap-rank.h"
+#include "bitmap-cow.h"
+
+#define COW_CHUNK_BYTES (BITMAP_COW_CHUNK_WORDS * sizeof(u32))
+
+/* Words of one slice of the bitmap, freed by whoever drops the last reference */
+struct cow_chunk
+{
+    atomic_uint refs;
+    u32 words[BITMAP_COW_CHUNK_WORDS];
+};
+
+/* Shared by a bitmap and its clones until one of them writes. A NULL chunk holds only 0 words */
+struct bitmap_cow_table
+{
+    atomic_uint refs;
+    u16 chunks;
+    struct cow_chunk *chunk[];
+};
+
+static bool cow_check(struct bitmap_cow *bm);
+static u32 tail_mask(u16 max_value);
+static u32 chunk_len(struct bitmap_cow *bm, u32 idx);
+static void chunk_release(struct cow_chunk *c);
+static void table_release(struct bitmap_cow_table *t);
+static bool table_own(struct bitmap_cow *bm);
+static u32 *chunk_writable(struct bitmap_cow *bm, u32 idx);
+static void chunk_drop(struct bitmap_cow *bm, u32 idx);
+static u16 cow_next(struct bitmap_cow *bm, u32 bit);
+static u16 cow_prev(struct bitmap_cow *bm, u32 bit);
+static u32 chunk_count(struct bitmap_cow *bm, u32 idx);
+static void cow_bounds(struct bitmap_cow *bm);
+static void cow_refresh(struct bitmap_cow *bm);
+
+static bool cow_check(struct bitmap_cow *bm)
+{
+    return bm != NULL && bm == bm->cow_self;
+}
+
+static u32 tail_mask(u16 max_value)
+{
+    return max_value % UINT_BITS == 0 ? ~0U : (1U << (max_value % UINT_BITS)) - 1;
+}
+
+/* Words of chunk idx that belong to the bitmap, the last chunk may be partly used */
+static u32 chunk_len(struct bitmap_cow *bm, u32 idx)
+{
+    u32 start = idx * BITMAP_COW_CHUNK_WORDS;
+
+    return bm->buf_len - start < BITMAP_COW_CHUNK_WORDS ? bm->buf_len - start : BITMAP_COW_CHUNK_WORDS;
+}
+
+static void chunk_release(struct cow_chunk *c)
+{
+    if (c != NULL && atomic_fetch_sub(&c->refs, 1) == 1)
+    {
+        free(c);
+    }
+
+    return;
+}
+
+static void table_release(struct bitmap_cow_table *t)
+{
+    u32 i = 0;
+
+    if (t == NULL || atomic_fetch_sub(&t->refs, 1) != 1)
+    {
+        return;
+    }
+
+    for (i = 0; i < t->chunks; i++)
+    {
+        chunk_release(t->chunk[i]);
+    }
+
+    free(t);
+
+    return;
+}
+
+/* Give bm a table of its own before changing a chunk pointer */
+static bool table_own(struct bitmap_cow *bm)
+{
+    struct bitmap_cow_table *t = bm->table;
+    struct bitmap_cow_table *copy = NULL;
+    size_t size = sizeof(struct bitmap_cow_table) + t->chunks * sizeof(struct cow_chunk *);
+    u32 i = 0;
+
+    /* Only holders of a reference can clone, so a count of 1 cannot grow behind our back */
+    if (atomic_load(&t->refs) == 1)
+    {
+        return true;
+    }
+
+    copy = (struct bitmap_cow_table *)malloc(size);
+
+    if (copy == NULL)
+    {
+        return false;
+    }
+
+    memcpy(copy, t, size);
+    atomic_init(&copy->refs, 1);
+
+    for (i = 0; i < copy->chunks; i++)
+    {
+        if (copy->chunk[i] != NULL)
+        {
+            atomic_fetch_add(&copy->chunk[i]->refs, 1);
+        }
+    }
+
+    bm->table = copy;
+    table_release(t);
+
+    return true;
+}
+
+/* Words of chunk idx that only bm sees, copying or creating the chunk when needed */
+static u32 *chunk_writable(struct bitmap_cow *bm, u32 idx)
+{
+    struct cow_chunk *c = NULL;
+    struct cow_chunk *copy = NULL;
+
+    if (!table_own(bm))
+    {
+        return NULL;
+    }
+
+    c = bm->table->chunk[idx];
+
+    if (c == NULL)
+    {
+        copy = (struct cow_chunk *)calloc(1, sizeof(struct cow_chunk));
+    }
+    else if (atomic_load(&c->refs) != 1)
+    {
+        copy = (struct cow_chunk *)malloc(sizeof(struct cow_chunk));
+
+        if (copy != NULL)
+        {
+            memcpy(copy->words, c->words, COW_CHUNK_BYTES);
+        }
+    }
+    else
+    {
+        return c->words;
+    }
+
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    atomic_init(&copy->refs, 1);
+    bm->table->chunk[idx] = copy;
+    chunk_release(c);
+
+    return copy->words;
+}
+
+/* Replace chunk idx by the implicit 0 chunk, the caller owns the table */
+static void chunk_drop(struct bitmap_cow *bm, u32 idx)
+{
+    chunk_release(bm->table->chunk[idx]);
+    bm->table->chunk[idx] = NULL;
+
+    return;
+}
+
+/* First set value at bit or above, 0 when there is none. Missing chunks are skipped whole */
+static u16 cow_next(struct bitmap_cow *bm, u32 bit)
+{
+    struct cow_chunk *c = NULL;
+    u32 w = bit >> UINT_SHIFT;
+    u32 mask = ~0U << (bit & UINT_MASK);
+    u32 word = 0;
+
+    while (w < bm->buf_len)
+    {
+        c = bm->table->chunk[w / BITMAP_COW_CHUNK_WORDS];
+
+        if (c == NULL)
+        {
+            w = (w / BITMAP_COW_CHUNK_WORDS + 1) * BITMAP_COW_CHUNK_WORDS;
+            mask = ~0U;
+            continue;
+        }
+
+        word = c->words[w % BITMAP_COW_CHUNK_WORDS] & mask;
+        mask = ~0U;
+
+        if (word != 0)
+        {
+            return (u16)(w * UINT_BITS + ctz32(word) + 1);
+        }
+
+        w++;
+    }
+
+    return 0;
+}
+
+/* Last set value at bit or below, 0 when there is none */
+static u16 cow_prev(struct bitmap_cow *bm, u32 bit)
+{
+    struct cow_chunk *c = NULL;
+    u32 w = (bit >> UINT_SHIFT) + 1;
+    u32 mask = ~0U >> (UINT_MASK - (bit & UINT_MASK));
+    u32 word = 0;
+
+    while (w > 0)
+    {
+        w--;
+        c = bm->table->chunk[w / BITMAP_COW_CHUNK_WORDS];
+
+        if (c == NULL)
+        {
+            w = w / BITMAP_COW_CHUNK_WORDS * BITMAP_COW_CHUNK_WORDS;
+            mask = ~0U;
+            continue;
+        }
+
+        word = c->words[w % BITMAP_COW_CHUNK_WORDS] & mask;
+        mask = ~0U;
+
+        if (word != 0)
+        {
+            return (u16)(w * UINT_BITS + UINT_MASK - clz32(word) + 1);
+        }
+    }
+
+    return 0;
+}
+
+/* Set values in chunk idx */
+static u32 chunk_count(struct bitmap_cow *bm, u32 idx)
+{
+    struct cow_chunk *c = bm->table->chunk[idx];
+
+    return c != NULL ? (u32)popcount_buf(c->words, chunk_len(bm, idx) * sizeof(u32)) : 0;
+}
+
+/* Find first_value/last_value again once numbers is right */
+static void cow_bounds(struct bitmap_cow *bm)
+{
+    bm->first_value = bm->numbers != 0 ? cow_next(bm, 0) : 0;
+    bm->last_value = bm->numbers != 0 ? cow_prev(bm, bm->max_value - 1) : 0;
+
+    return;
+}
+
+/* Recount numbers/first_value/last_value after a change to every chunk */
+static void cow_refresh(struct bitmap_cow *bm)
+{
+    u32 n = 0;
+    u32 i = 0;
+
+    for (i = 0; i < bm->table->chunks; i++)
+    {
+        n += chunk_count(bm, i);
+    }
+
+    bm->numbers = (u16)n;
+    cow_bounds(bm);
+
+    return;
+}
+
+struct bitmap_cow *bitmap_cow_create(u16 capacity)
+{
+    struct bitmap_cow *bm = NULL;
+    u16 buf_len = (capacity + UINT_BITS - 1) / UINT_BITS;
+    u16 chunks = (buf_len + BITMAP_COW_CHUNK_WORDS - 1) / BITMAP_COW_CHUNK_WORDS;
+
+    if (capacity == 0)
+    {
+        return NULL;
+    }
+
+    bm = (struct bitmap_cow *)calloc(1, sizeof(struct bitmap_cow));
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    bm->table = (struct bitmap_cow_table *)calloc(1, sizeof(struct bitmap_cow_table) + chunks * sizeof(struct cow_chunk *));
+
+    if (bm->table == NULL)
+    {
+        free(bm);
+
+        return NULL;
+    }
+
+    atomic_init(&bm->table->refs, 1);
+    bm->table->chunks = chunks;
+    bm->max_value = capacity;
+    bm->buf_len = buf_len;
+    bm->cow_self = bm;
+
+    return bm;
+}
+
+void bitmap_cow_destroy(struct bitmap_cow *bm)
+{
+    if (!cow_check(bm))
+    {
+        return;
+    }
+
+    table_release(bm->table);
+    bm->cow_self = NULL;
+    free(bm);
+
+    return;
+}
+
+bool bitmap_cow_is_valid(struct bitmap_cow *bm)
+{
+    return cow_check(bm);
+}
+
+struct bitmap_cow *bitmap_cow_clone(struct bitmap_cow *bm)
+{
+    struct bitmap_cow *copy = NULL;
+
+    if (!cow_check(bm))
+    {
+        return NULL;
+    }
+
+    copy = (struct bitmap_cow *)malloc(sizeof(struct bitmap_cow));
+
+    if (copy == NULL)
+    {
+        return NULL;
+    }
+
+    *copy = *bm;
+    copy->cow_self = copy;
+    atomic_fetch_add(&bm->table->refs, 1);
+
+    return copy;
+}
+
+bool bitmap_cow_add_value(struct bitmap_cow *bm, u16 value)
+{
+    u32 bit = (u32)value - 1;
+    u32 *words = NULL;
+
+    if (!cow_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    /* Setting a value that is already set must not unshare anything */
+    if (bitmap_cow_is_value_set(bm, value))
+    {
+        return true;
+    }
+
+    words = chunk_writable(bm, (bit >> UINT_SHIFT) / BITMAP_COW_CHUNK_WORDS);
+
+    if (words == NULL)
+    {
+        return false;
+    }
+
+    words[(bit >> UINT_SHIFT) % BITMAP_COW_CHUNK_WORDS] |= 1U << (bit & UINT_MASK);
+    bm->numbers++;
+
+    if (bm->first_value == 0 || value < bm->first_value)
+    {
+        bm->first_value = value;
+    }
+
+    if (value > bm->last_value)
+    {
+        bm->last_value = value;
+    }
+
+    return true;
+}
+
+bool bitmap_cow_del_value(struct bitmap_cow *bm, u16 value)
+{
+    u32 bit = (u32)value - 1;
+    u32 *words = NULL;
+
+    if (!cow_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    if (!bitmap_cow_is_value_set(bm, value))
+    {
+        return true;
+    }
+
+    words = chunk_writable(bm, (bit >> UINT_SHIFT) / BITMAP_COW_CHUNK_WORDS);
+
+    if (words == NULL)
+    {
+        return false;
+    }
+
+    words[(bit >> UINT_SHIFT) % BITMAP_COW_CHUNK_WORDS] &= ~(1U << (bit & UINT_MASK));
+    bm->numbers--;
+
+    if (bm->numbers == 0)
+    {
+        bm->first_value = 0;
+        bm->last_value = 0;
+
+        return true;
+    }
+
+    if (value == bm->first_value)
+    {
+        bm->first_value = cow_next(bm, bit + 1);
+    }
+
+    if (value == bm->last_value)
+    {
+        bm->last_value = cow_prev(bm, bit - 1);
+    }
+
+    return true;
+}
+
+bool bitmap_cow_is_value_set(struct bitmap_cow *bm, u16 value)
+{
+    struct cow_chunk *c = NULL;
+    u32 bit = (u32)value - 1;
+
+    if (!cow_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    c = bm->table->chunk[(bit >> UINT_SHIFT) / BITMAP_COW_CHUNK_WORDS];
+
+    return c != NULL && (c->words[(bit >> UINT_SHIFT) % BITMAP_COW_CHUNK_WORDS] >> (bit & UINT_MASK)) & 1;
+}
+
+bool bitmap_cow_not(struct bitmap_cow *bm)
+{
+    const struct word_ops *ops = word_ops_get();
+    u32 *words = NULL;
+    u32 len = 0;
+    u32 i = 0;
+    bool ok = true;
+
+    if (!cow_check(bm))
+    {
+        return false;
+    }
+
+    for (i = 0; i < bm->table->chunks; i++)
+    {
+        words = chunk_writable(bm, i);
+
+        if (words == NULL)
+        {
+            ok = false;
+            break;
+        }
+
+        len = chunk_len(bm, i);
+        ops->not_words(words, len * sizeof(u32));
+
+        if (i == bm->table->chunks - 1u)
+        {
+            words[len - 1] &= tail_mask(bm->max_value);
+            memset(words + len, 0, (BITMAP_COW_CHUNK_WORDS - len) * sizeof(u32));
+        }
+
+        /* A full chunk flips to nothing, keep it implicit */
+        if (popcount_buf(words, len * sizeof(u32)) == 0)
+        {
+            chunk_drop(bm, i);
+        }
+    }
+
+    cow_refresh(bm);
+
+    return ok;
+}
+
+bool bitmap_cow_and(struct bitmap_cow *bm_store, struct bitmap_cow *bm)
+{
+    const struct word_ops *ops = word_ops_get();
+    struct cow_chunk *src = NULL;
+    struct cow_chunk *dst = NULL;
+    u32 *words = NULL;
+    u32 set = 0;
+    u32 n = 0;
+    u32 i = 0;
+    bool ok = true;
+
+    if (!cow_check(bm_store) || !cow_check(bm) || bm_store->max_value != bm->max_value)
+    {
+        return false;
+    }
+
+    if (bm_store->table == bm->table)
+    {
+        return true;
+    }
+
+    /* Only the chunks that change are counted again, shared ones keep their share of numbers */
+    n = bm_store->numbers;
+
+    for (i = 0; i < bm_store->table->chunks; i++)
+    {
+        src = bm->table->chunk[i];
+        dst = bm_store->table->chunk[i];
+
+        if (dst == NULL || dst == src)
+        {
+            continue;
+        }
+
+        if (src == NULL)
+        {
+            if (!table_own(bm_store))
+            {
+                ok = false;
+                break;
+            }
+
+            n -= chunk_count(bm_store, i);
+            chunk_drop(bm_store, i);
+            continue;
+        }
+
+        n -= chunk_count(bm_store, i);
+        words = chunk_writable(bm_store, i);
+
+        if (words == NULL)
+        {
+            ok = false;
+            break;
+        }
+
+        ops->and_words(words, src->words, chunk_len(bm_store, i) * sizeof(u32));
+        set = chunk_count(bm_store, i);
+        n += set;
+
+        if (set == 0)
+        {
+            chunk_drop(bm_store, i);
+        }
+    }
+
+    if (!ok)
+    {
+        /* Stopped half way, n may still hold the chunk that could not be written */
+        cow_refresh(bm_store);
+
+        return false;
+    }
+
+    bm_store->numbers = (u16)n;
+    cow_bounds(bm_store);
+
+    return true;
+}
+
+bool bitmap_cow_or(struct bitmap_cow *bm_store, struct bitmap_cow *bm)
+{
+    const struct word_ops *ops = word_ops_get();
+    struct cow_chunk *src = NULL;
+    struct cow_chunk *dst = NULL;
+    u32 *words = NULL;
+    u32 n = 0;
+    u32 i = 0;
+    bool ok = true;
+
+    if (!cow_check(bm_store) || !cow_check(bm) || bm_store->max_value != bm->max_value)
+    {
+        return false;
+    }
+
+    if (bm_store->table == bm->table)
+    {
+        return true;
+    }
+
+    n = bm_store->numbers;
+
+    for (i = 0; i < bm_store->table->chunks; i++)
+    {
+        src = bm->table->chunk[i];
+        dst = bm_store->table->chunk[i];
+
+        if (src == NULL || dst == src)
+        {
+            continue;
+        }
+
+        if (dst == NULL)
+        {
+            if (!table_own(bm_store))
+            {
+                ok = false;
+                break;
+            }
+
+            atomic_fetch_add(&src->refs, 1);
+            bm_store->table->chunk[i] = src;
+            n += chunk_count(bm_store, i);
+            continue;
+        }
+
+        n -= chunk_count(bm_store, i);
+        words = chunk_writable(bm_store, i);
+
+        if (words == NULL)
+        {
+            ok = false;
+            break;
+        }
+
+        ops->or_words(words, src->words, chunk_len(bm_store, i) * sizeof(u32));
+        n += chunk_count(bm_store, i);
+    }
+
+    if (!ok)
+    {
+        /* Stopped half way, n may still hold the chunk that could not be written */
+        cow_refresh(bm_store);
+
+        return false;
+    }
+
+    bm_store->numbers = (u16)n;
+    cow_bounds(bm_store);
+
+    return true;
+}
+
+struct bitmap_cow *bitmap_cow_from_bitmap(struct bitmap *bm)
+{
+    struct bitmap_cow *cow = NULL;
+    struct cow_chunk *c = NULL;
+    u32 len = 0;
+    u32 i = 0;
+
+    if (!bitmap_is_valid(bm))
+    {
+        return NULL;
+    }
+
+    cow = bitmap_cow_create(bm->max_value);
+
+    if (cow == NULL)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < cow->table->chunks; i++)
+    {
+        len = chunk_len(cow, i);
+
+        if (popcount_buf(bm->buf + i * BITMAP_COW_CHUNK_WORDS, len * sizeof(u32)) == 0)
+        {
+            continue;
+        }
+
+        c = (struct cow_chunk *)calloc(1, sizeof(struct cow_chunk));
+
+        if (c == NULL)
+        {
+            bitmap_cow_destroy(cow);
+
+            return NULL;
+        }
+
+        atomic_init(&c->refs, 1);
+        memcpy(c->words, bm->buf + i * BITMAP_COW_CHUNK_WORDS, len * sizeof(u32));
+        cow->table->chunk[i] = c;
+    }
+
+    /* The dense bitmap may be lazy, count again rather than trust numbers */
+    cow_refresh(cow);
+
+    return cow;
+}
+
+struct bitmap *bitmap_cow_to_bitmap(struct bitmap_cow *bm, struct bitmap *bm_result)
+{
+    struct bitmap *dense = bm_result;
+    struct cow_chunk *c = NULL;
+    u32 len = 0;
+    u32 i = 0;
+
+    if (!cow_check(bm))
+    {
+        return NULL;
+    }
+
+    if (dense == NULL)
+    {
+        dense = bitMap_create(bm->max_value);
+    }
+
+    if (!bitmap_is_valid(dense) || (dense->flags & BITMAP_FLAG_READONLY) || dense->max_value != bm->max_value)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < bm->table->chunks; i++)
+    {
+        c = bm->table->chunk[i];
+        len = chunk_len(bm, i);
+
+        if (c == NULL)
+        {
+            memset(dense->buf + i * BITMAP_COW_CHUNK_WORDS, 0, len * sizeof(u32));
+        }
+        else
+        {
+            memcpy(dense->buf + i * BITMAP_COW_CHUNK_WORDS, c->words, len * sizeof(u32));
+        }
+    }
+
+    dense->numbers = bm->numbers;
+    dense->first_value = bm->first_value;
+    dense->last_value = bm->last_value;
+    dense->flags &= ~BITMAP_FLAG_DIRTY;
+    bitmap_rank_invalidate(dense);
+
+    return dense;
+}
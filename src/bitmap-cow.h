@@ -0,0 +1,146 @@
+#ifndef BITMAP_COW_H_INCLUDED
+#define BITMAP_COW_H_INCLUDED
+
+#include <stddef.h>
+#include "bitmap.h"
+
+#define BITMAP_COW_CHUNK_WORDS 64  /* 2048 values per chunk, the unit that is copied on write */
+
+struct bitmap_cow_table;
+
+/*
+ * Copy-on-write bitmap for cheap snapshots. The words are split into reference counted chunks of
+ * BITMAP_COW_CHUNK_WORDS, reached through a reference counted chunk table. bitmap_cow_clone only
+ * takes a reference on the table; the first write to a clone copies the table, and every write to
+ * a chunk that is still shared copies that chunk alone. A chunk without any set value is not
+ * allocated at all.
+ *
+ * One bitmap must not be used by two threads at once, but bitmaps that share chunks may be used
+ * and destroyed by different threads, the reference counts are atomic.
+ */
+struct bitmap_cow
+{
+    struct bitmap_cow *cow_self;   /* The value used when creating it */
+    u16 max_value;
+    u16 first_value;
+    u16 last_value;
+    u16 numbers;
+    u16 buf_len;                   /* Words of the equivalent dense bitmap */
+    struct bitmap_cow_table *table;
+};
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_create
+ * Input:  capacity  The capacity of the bitmap
+ * Return: Success   An empty copy-on-write bitmap
+ *         Failed    NULL
+ * Description: Only the chunk table is allocated, chunks are created by the first write to them
+ *****************************************************************************************************/
+struct bitmap_cow *bitmap_cow_create(u16 capacity);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_destroy
+ * Input:  bm     The bitmap
+ * Return: None
+ * Description: Drop the bitmap's references, chunks still used by a clone stay alive
+ *****************************************************************************************************/
+void bitmap_cow_destroy(struct bitmap_cow *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_is_valid
+ * Input:  bm     Pointer to check
+ * Return: true for a live copy-on-write bitmap
+ * Description: None
+ *****************************************************************************************************/
+bool bitmap_cow_is_valid(struct bitmap_cow *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_clone
+ * Input:  bm     The bitmap to snapshot
+ * Return: Success   A new bitmap with the values of bm
+ *         Failed    NULL
+ * Description: O(1), the clone shares the chunk table of bm until either of them is written
+ *****************************************************************************************************/
+struct bitmap_cow *bitmap_cow_clone(struct bitmap_cow *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_add_value
+ * Input:  bm     The bitmap
+ *         value  The value to set, 1 to max_value
+ * Return: Success   true, also when the value was already set
+ *         Failed    false
+ * Description: Set a value, copying the chunk table and the value's chunk first if they are shared
+ *****************************************************************************************************/
+bool bitmap_cow_add_value(struct bitmap_cow *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_del_value
+ * Input:  bm     The bitmap
+ *         value  The value to clear, 1 to max_value
+ * Return: Success   true, also when the value was not set
+ *         Failed    false
+ * Description: Clear a value, nothing is copied when it was not set
+ *****************************************************************************************************/
+bool bitmap_cow_del_value(struct bitmap_cow *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_is_value_set
+ * Input:  bm     The bitmap
+ *         value  The value to test
+ * Return: true when value is set
+ * Description: Reads never copy anything
+ *****************************************************************************************************/
+bool bitmap_cow_is_value_set(struct bitmap_cow *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_not
+ * Input:  bm     The bitmap
+ * Return: Success   true
+ *         Failed    false
+ * Description: Reverse every value from 1 to max_value. Every chunk is written, so every shared
+ *              chunk is copied
+ *****************************************************************************************************/
+bool bitmap_cow_not(struct bitmap_cow *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_and
+ * Input:  bm_store  The bitmap that receives bm_store & bm
+ *         bm        Another bitmap of the same max_value
+ * Return: Success   true
+ *         Failed    false, also for different max_values
+ * Description: Chunks that are shared by the two, or empty in bm_store, are left as they are. A
+ *              chunk empty in bm is dropped instead of being cleared
+ *****************************************************************************************************/
+bool bitmap_cow_and(struct bitmap_cow *bm_store, struct bitmap_cow *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_or
+ * Input:  bm_store  The bitmap that receives bm_store | bm
+ *         bm        Another bitmap of the same max_value
+ * Return: Success   true
+ *         Failed    false, also for different max_values
+ * Description: Chunks that are shared by the two, or empty in bm, are left as they are. A chunk
+ *              empty in bm_store takes a reference on the chunk of bm instead of a copy
+ *****************************************************************************************************/
+bool bitmap_cow_or(struct bitmap_cow *bm_store, struct bitmap_cow *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_from_bitmap
+ * Input:  bm     A dense bitmap
+ * Return: Success   A new copy-on-write bitmap with the values of bm
+ *         Failed    NULL
+ * Description: Chunks without a set value are not allocated
+ *****************************************************************************************************/
+struct bitmap_cow *bitmap_cow_from_bitmap(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_cow_to_bitmap
+ * Input:  bm         The copy-on-write bitmap
+ *         bm_result  NULL to create the dense bitmap, or a writable one with the same max_value
+ * Return: Success   The dense bitmap holding the values of bm
+ *         Failed    NULL
+ * Description: Copy the chunks into a dense bitmap
+ *****************************************************************************************************/
+struct bitmap *bitmap_cow_to_bitmap(struct bitmap_cow *bm, struct bitmap *bm_result);
+
+#endif // BITMAP_COW_H_INCLUDED
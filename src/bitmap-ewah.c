@@ -0,0 +1,554 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "bitmap-rank.h"
+#include "bitmap-ewah.h"
+
+#define EWAH_MAX_WORDS ((U16_MAX + UINT_BITS - 1) / UINT_BITS)
+#define EWAH_SCRATCH_WORDS (2 * EWAH_MAX_WORDS + 1)   /* Every marker covers at least one word */
+
+enum ewah_op
+{
+    EWAH_OP_AND = 0,
+    EWAH_OP_OR
+};
+
+/* Position in a stream. Past its end a stream reads as clean 0 words */
+struct ewah_reader
+{
+    const u32 *data;
+    u32 len;
+    u32 pos;                       /* Next word of data[] */
+    u32 run_word;                  /* 0 or ~0 */
+    u32 run_left;                  /* Clean words of the current marker not consumed */
+    u32 lit_left;                  /* Literal words of the current marker not consumed */
+};
+
+/* Builds a stream, or only counts it when out is NULL */
+struct ewah_writer
+{
+    u32 *out;
+    u32 len;                       /* Words written to out */
+    u32 marker;                    /* Index of the open marker in out */
+    bool open;                     /* A marker has been started */
+    u32 m_bit;
+    u32 m_run;
+    u32 m_lits;
+    u32 pos;                       /* Dense words covered so far */
+    u32 buf_len;
+    u32 tail;                      /* Bits of the last word at or below max_value */
+    u32 numbers;
+};
+
+static bool ewah_check(struct bitmap_ewah *ew);
+static u32 tail_mask(u16 max_value);
+static void reader_init(struct ewah_reader *r, struct bitmap_ewah *ew);
+static void reader_fill(struct ewah_reader *r);
+static void writer_init(struct ewah_writer *w, u32 *out, u16 max_value);
+static void writer_marker(struct ewah_writer *w, u32 bit);
+static void writer_store(struct ewah_writer *w);
+static void writer_run(struct ewah_writer *w, u32 word, u32 n);
+static void writer_literal(struct ewah_writer *w, u32 word);
+static struct bitmap_ewah *writer_finish(struct ewah_writer *w, u16 max_value);
+static void ewah_merge(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b, u8 op, struct ewah_writer *w);
+static struct bitmap_ewah *ewah_op_new(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b, u8 op);
+
+static bool ewah_check(struct bitmap_ewah *ew)
+{
+    return ew != NULL && ew == ew->ew_self;
+}
+
+static u32 tail_mask(u16 max_value)
+{
+    return max_value % UINT_BITS == 0 ? ~0U : (1U << (max_value % UINT_BITS)) - 1;
+}
+
+static void reader_init(struct ewah_reader *r, struct bitmap_ewah *ew)
+{
+    memset(r, 0, sizeof(struct ewah_reader));
+    r->data = ew->data;
+    r->len = ew->len;
+
+    return;
+}
+
+/* Move to the next marker once the current one is used up */
+static void reader_fill(struct ewah_reader *r)
+{
+    u32 marker = 0;
+
+    while (r->run_left == 0 && r->lit_left == 0)
+    {
+        if (r->pos >= r->len)
+        {
+            r->run_word = 0;
+            r->run_left = UINT32_MAX;
+
+            return;
+        }
+
+        marker = r->data[r->pos++];
+        r->run_word = marker & 1 ? ~0U : 0;
+        r->run_left = (marker >> 1) & EWAH_RUN_MAX;
+        r->lit_left = marker >> 17;
+    }
+
+    return;
+}
+
+static void writer_init(struct ewah_writer *w, u32 *out, u16 max_value)
+{
+    memset(w, 0, sizeof(struct ewah_writer));
+    w->out = out;
+    w->buf_len = (max_value + UINT_BITS - 1) / UINT_BITS;
+    w->tail = tail_mask(max_value);
+
+    return;
+}
+
+static void writer_marker(struct ewah_writer *w, u32 bit)
+{
+    w->marker = w->len++;
+    w->open = true;
+    w->m_bit = bit;
+    w->m_run = 0;
+    w->m_lits = 0;
+
+    return;
+}
+
+static void writer_store(struct ewah_writer *w)
+{
+    if (w->out != NULL)
+    {
+        w->out[w->marker] = w->m_bit | (w->m_run << 1) | (w->m_lits << 17);
+    }
+
+    return;
+}
+
+/* Append n clean words, a run of 1s reaching the last word leaves its bits above max_value out */
+static void writer_run(struct ewah_writer *w, u32 word, u32 n)
+{
+    u32 bit = word != 0 ? 1 : 0;
+    u32 k = 0;
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    if (bit && w->pos + n == w->buf_len && w->tail != ~0U)
+    {
+        writer_run(w, word, n - 1);
+        writer_literal(w, word);
+
+        return;
+    }
+
+    w->pos += n;
+    w->numbers += bit ? n * UINT_BITS : 0;
+
+    while (n > 0)
+    {
+        /* A run must come before the literals of its marker */
+        if (!w->open || w->m_lits > 0 || (w->m_run > 0 && w->m_bit != bit) || w->m_run == EWAH_RUN_MAX)
+        {
+            writer_marker(w, bit);
+        }
+
+        w->m_bit = bit;
+        k = n < EWAH_RUN_MAX - w->m_run ? n : EWAH_RUN_MAX - w->m_run;
+        w->m_run += k;
+        n -= k;
+        writer_store(w);
+    }
+
+    return;
+}
+
+static void writer_literal(struct ewah_writer *w, u32 word)
+{
+    if (w->pos == w->buf_len - 1)
+    {
+        word &= w->tail;
+    }
+
+    if (word == 0 || word == ~0U)
+    {
+        writer_run(w, word, 1);
+
+        return;
+    }
+
+    if (!w->open || w->m_lits == EWAH_LITERAL_MAX)
+    {
+        writer_marker(w, 0);
+    }
+
+    if (w->out != NULL)
+    {
+        w->out[w->len] = word;
+    }
+
+    w->len++;
+    w->m_lits++;
+    w->pos++;
+    w->numbers += popcount32(word);
+    writer_store(w);
+
+    return;
+}
+
+/* Copy the finished stream out of the scratch buffer into an exactly sized bitmap_ewah */
+static struct bitmap_ewah *writer_finish(struct ewah_writer *w, u16 max_value)
+{
+    struct bitmap_ewah *ew = NULL;
+
+    ew = (struct bitmap_ewah *)malloc(sizeof(struct bitmap_ewah) + (size_t)w->len * sizeof(u32));
+
+    if (ew == NULL)
+    {
+        return NULL;
+    }
+
+    ew->ew_self = ew;
+    ew->max_value = max_value;
+    ew->buf_len = (u16)w->buf_len;
+    ew->numbers = (u16)w->numbers;
+    ew->len = w->len;
+    memcpy(ew->data, w->out, (size_t)w->len * sizeof(u32));
+
+    return ew;
+}
+
+/* Walk both streams segment by segment, a segment ends where either stream changes marker part */
+static void ewah_merge(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b, u8 op, struct ewah_writer *w)
+{
+    struct ewah_reader ra;
+    struct ewah_reader rb;
+    struct ewah_reader *run = NULL;
+    struct ewah_reader *lit = NULL;
+    u32 remaining = ew_a->buf_len;
+    u32 n = 0;
+    u32 i = 0;
+
+    reader_init(&ra, ew_a);
+    reader_init(&rb, ew_b);
+
+    while (remaining > 0)
+    {
+        reader_fill(&ra);
+        reader_fill(&rb);
+
+        if (ra.run_left > 0 && rb.run_left > 0)
+        {
+            n = ra.run_left < rb.run_left ? ra.run_left : rb.run_left;
+            n = n < remaining ? n : remaining;
+            writer_run(w, op == EWAH_OP_AND ? ra.run_word & rb.run_word : ra.run_word | rb.run_word, n);
+            ra.run_left -= n;
+            rb.run_left -= n;
+        }
+        else if (ra.run_left > 0 || rb.run_left > 0)
+        {
+            run = ra.run_left > 0 ? &ra : &rb;
+            lit = ra.run_left > 0 ? &rb : &ra;
+            n = run->run_left < lit->lit_left ? run->run_left : lit->lit_left;
+            n = n < remaining ? n : remaining;
+
+            /* 0 & x and ~0 | x do not depend on the literals, they are skipped unread */
+            if ((op == EWAH_OP_AND) == (run->run_word == 0))
+            {
+                writer_run(w, run->run_word, n);
+                lit->pos += n;
+            }
+            else
+            {
+                for (i = 0; i < n; i++)
+                {
+                    writer_literal(w, lit->data[lit->pos++]);
+                }
+            }
+
+            run->run_left -= n;
+            lit->lit_left -= n;
+        }
+        else
+        {
+            n = ra.lit_left < rb.lit_left ? ra.lit_left : rb.lit_left;
+            n = n < remaining ? n : remaining;
+
+            for (i = 0; i < n; i++)
+            {
+                writer_literal(w, op == EWAH_OP_AND ? ra.data[ra.pos++] & rb.data[rb.pos++] :
+                               ra.data[ra.pos++] | rb.data[rb.pos++]);
+            }
+
+            ra.lit_left -= n;
+            rb.lit_left -= n;
+        }
+
+        remaining -= n;
+    }
+
+    return;
+}
+
+static struct bitmap_ewah *ewah_op_new(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b, u8 op)
+{
+    struct ewah_writer w;
+    u32 scratch[EWAH_SCRATCH_WORDS];
+
+    if (!ewah_check(ew_a) || !ewah_check(ew_b))
+    {
+        return NULL;
+    }
+
+    writer_init(&w, scratch, ew_a->max_value);
+    ewah_merge(ew_a, ew_b, op, &w);
+
+    return writer_finish(&w, ew_a->max_value);
+}
+
+struct bitmap_ewah *bitmap_ewah_encode(struct bitmap *bm)
+{
+    struct ewah_writer w;
+    u32 scratch[EWAH_SCRATCH_WORDS];
+    u32 word = 0;
+    u32 i = 0;
+    u32 j = 0;
+
+    if (!bitmap_is_valid(bm))
+    {
+        return NULL;
+    }
+
+    writer_init(&w, scratch, bm->max_value);
+
+    for (i = 0; i < bm->buf_len; i = j)
+    {
+        word = bm->buf[i];
+        j = i + 1;
+
+        if (word != 0 && word != ~0U)
+        {
+            writer_literal(&w, word);
+            continue;
+        }
+
+        while (j < bm->buf_len && bm->buf[j] == word)
+        {
+            j++;
+        }
+
+        writer_run(&w, word, j - i);
+    }
+
+    return writer_finish(&w, bm->max_value);
+}
+
+struct bitmap *bitmap_ewah_decode(struct bitmap_ewah *ew, struct bitmap *bm_result)
+{
+    struct bitmap *bm = bm_result;
+    struct ewah_reader r;
+    u32 pos = 0;
+    u32 n = 0;
+    u32 first = 0;
+    u32 last = 0;
+
+    if (!ewah_check(ew))
+    {
+        return NULL;
+    }
+
+    if (bm == NULL)
+    {
+        bm = bitMap_create(ew->max_value);
+    }
+
+    if (!bitmap_is_valid(bm) || (bm->flags & BITMAP_FLAG_READONLY) || bm->max_value != ew->max_value)
+    {
+        return NULL;
+    }
+
+    reader_init(&r, ew);
+
+    while (pos < ew->buf_len)
+    {
+        reader_fill(&r);
+        n = r.run_left < ew->buf_len - pos ? r.run_left : ew->buf_len - pos;
+        memset(bm->buf + pos, r.run_word != 0 ? 0xFF : 0, (size_t)n * sizeof(u32));
+
+        if (r.run_word != 0 && n > 0)
+        {
+            first = first != 0 ? first : pos * UINT_BITS + 1;
+            last = (pos + n) * UINT_BITS;
+        }
+
+        pos += n;
+        r.run_left -= n;
+        n = r.lit_left < ew->buf_len - pos ? r.lit_left : ew->buf_len - pos;
+        memcpy(bm->buf + pos, r.data + r.pos, (size_t)n * sizeof(u32));
+
+        /* Literals are never 0, so the first and last one give the bounds */
+        if (n > 0)
+        {
+            first = first != 0 ? first : pos * UINT_BITS + ctz32(r.data[r.pos]) + 1;
+            last = (pos + n) * UINT_BITS - clz32(r.data[r.pos + n - 1]);
+        }
+
+        pos += n;
+        r.pos += n;
+        r.lit_left -= n;
+    }
+
+    bm->numbers = ew->numbers;
+    bm->first_value = (u16)first;
+    bm->last_value = (u16)last;
+    bm->flags &= ~BITMAP_FLAG_DIRTY;
+    bitmap_rank_invalidate(bm);
+
+    return bm;
+}
+
+void bitmap_ewah_destroy(struct bitmap_ewah *ew)
+{
+    if (!ewah_check(ew))
+    {
+        return;
+    }
+
+    ew->ew_self = NULL;
+    free(ew);
+
+    return;
+}
+
+bool bitmap_ewah_is_valid(struct bitmap_ewah *ew)
+{
+    return ewah_check(ew);
+}
+
+size_t bitmap_ewah_size_in_bytes(struct bitmap_ewah *ew)
+{
+    if (!ewah_check(ew))
+    {
+        return 0;
+    }
+
+    return sizeof(struct bitmap_ewah) + (size_t)ew->len * sizeof(u32);
+}
+
+u16 bitmap_ewah_cardinality(struct bitmap_ewah *ew)
+{
+    return ewah_check(ew) ? ew->numbers : 0;
+}
+
+bool bitmap_ewah_contains(struct bitmap_ewah *ew, u16 value)
+{
+    u32 index = 0;
+    u32 pos = 0;
+    u32 marker = 0;
+    u32 run = 0;
+    u32 lits = 0;
+    u32 i = 0;
+
+    if (!ewah_check(ew) || value == 0 || value > ew->max_value)
+    {
+        return false;
+    }
+
+    index = (u32)(value - 1) >> UINT_SHIFT;
+
+    while (i < ew->len)
+    {
+        marker = ew->data[i++];
+        run = (marker >> 1) & EWAH_RUN_MAX;
+        lits = marker >> 17;
+
+        if (index < pos + run)
+        {
+            return (marker & 1) != 0;
+        }
+
+        if (index < pos + run + lits)
+        {
+            return ((ew->data[i + index - pos - run] >> ((value - 1) & UINT_MASK)) & 1) != 0;
+        }
+
+        pos += run + lits;
+        i += lits;
+    }
+
+    return false;
+}
+
+struct bitmap_ewah *bitmap_ewah_and(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b)
+{
+    return ewah_op_new(ew_a, ew_b, EWAH_OP_AND);
+}
+
+struct bitmap_ewah *bitmap_ewah_or(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b)
+{
+    return ewah_op_new(ew_a, ew_b, EWAH_OP_OR);
+}
+
+struct bitmap_ewah *bitmap_ewah_not(struct bitmap_ewah *ew)
+{
+    struct ewah_writer w;
+    u32 scratch[EWAH_SCRATCH_WORDS];
+    u32 marker = 0;
+    u32 lits = 0;
+    u32 i = 0;
+
+    if (!ewah_check(ew))
+    {
+        return NULL;
+    }
+
+    writer_init(&w, scratch, ew->max_value);
+
+    while (i < ew->len)
+    {
+        marker = ew->data[i++];
+        writer_run(&w, marker & 1 ? 0 : ~0U, (marker >> 1) & EWAH_RUN_MAX);
+
+        for (lits = marker >> 17; lits > 0; lits--)
+        {
+            writer_literal(&w, ~ew->data[i++]);
+        }
+    }
+
+    return writer_finish(&w, ew->max_value);
+}
+
+u16 bitmap_ewah_and_cardinality(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b)
+{
+    struct ewah_writer w;
+
+    if (!ewah_check(ew_a) || !ewah_check(ew_b))
+    {
+        return 0;
+    }
+
+    writer_init(&w, NULL, ew_a->max_value);
+    ewah_merge(ew_a, ew_b, EWAH_OP_AND, &w);
+
+    return (u16)w.numbers;
+}
+
+u16 bitmap_ewah_or_cardinality(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b)
+{
+    struct ewah_writer w;
+
+    if (!ewah_check(ew_a) || !ewah_check(ew_b))
+    {
+        return 0;
+    }
+
+    writer_init(&w, NULL, ew_a->max_value);
+    ewah_merge(ew_a, ew_b, EWAH_OP_OR, &w);
+
+    return (u16)w.numbers;
+}
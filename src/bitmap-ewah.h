@@ -0,0 +1,140 @@
+#ifndef BITMAP_EWAH_H_INCLUDED
+#define BITMAP_EWAH_H_INCLUDED
+
+#include <stddef.h>
+#include "bitmap.h"
+
+#define EWAH_RUN_MAX 0xFFFF        /* Clean words one marker can cover */
+#define EWAH_LITERAL_MAX 0x7FFF    /* Literal words one marker can announce */
+
+/*
+ * Immutable word-aligned hybrid (EWAH) encoding of a struct bitmap. The 32-bit words of buf[] are
+ * stored as a sequence of markers, each followed by its literal words:
+ *
+ *   bit 0        value of the clean words of the run, all 0 or all 1
+ *   bits 1-16    number of clean words in the run, up to EWAH_RUN_MAX
+ *   bits 17-31   number of literal words stored after the marker, up to EWAH_LITERAL_MAX
+ *
+ * The markers cover exactly buf_len words and the bits above max_value are 0, like in a dense
+ * bitmap. AND, OR, NOT and the cardinalities walk the streams marker by marker, a run against a
+ * run or a run that decides the result costs one step however many words it covers.
+ */
+struct bitmap_ewah
+{
+    struct bitmap_ewah *ew_self;   /* The value used when creating it */
+    u16 max_value;                 /* max_value of the dense bitmap */
+    u16 buf_len;                   /* buf_len of the dense bitmap */
+    u16 numbers;                   /* Number of set values */
+    u32 len;                       /* Words in data[] */
+    u32 data[0];
+};
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_encode
+ * Input:  bm     The dense bitmap to compress
+ * Return: Success   A new compressed bitmap holding the values of bm
+ *         Failed    NULL
+ * Description: Compress the words of bm in one pass, release the result with bitmap_ewah_destroy
+ *****************************************************************************************************/
+struct bitmap_ewah *bitmap_ewah_encode(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_decode
+ * Input:  ew         The compressed bitmap
+ *         bm_result  NULL to create the dense bitmap, or a writable one with the same max_value
+ * Return: Success   The dense bitmap holding the values of ew
+ *         Failed    NULL
+ * Description: Expand ew, runs are written with memset. numbers/first_value/last_value are set
+ *              from the stream, no rescan is needed
+ *****************************************************************************************************/
+struct bitmap *bitmap_ewah_decode(struct bitmap_ewah *ew, struct bitmap *bm_result);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_destroy
+ * Input:  ew     The compressed bitmap
+ * Return: None
+ * Description: Release a compressed bitmap
+ *****************************************************************************************************/
+void bitmap_ewah_destroy(struct bitmap_ewah *ew);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_is_valid
+ * Input:  ew     Pointer to check
+ * Return: true for a live compressed bitmap
+ * Description: None
+ *****************************************************************************************************/
+bool bitmap_ewah_is_valid(struct bitmap_ewah *ew);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_size_in_bytes
+ * Input:  ew     The compressed bitmap
+ * Return: Bytes allocated for ew, 0 when it is invalid
+ * Description: None
+ *****************************************************************************************************/
+size_t bitmap_ewah_size_in_bytes(struct bitmap_ewah *ew);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_cardinality
+ * Input:  ew     The compressed bitmap
+ * Return: Number of set values, 0 when ew is invalid
+ * Description: Counted once when ew was built
+ *****************************************************************************************************/
+u16 bitmap_ewah_cardinality(struct bitmap_ewah *ew);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_contains
+ * Input:  ew     The compressed bitmap
+ *         value  The value to test
+ * Return: true when value is set
+ * Description: Skips whole markers until the one covering value
+ *****************************************************************************************************/
+bool bitmap_ewah_contains(struct bitmap_ewah *ew, u16 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_and
+ * Input:  ew_a   A compressed bitmap, the result has its max_value
+ *         ew_b   Another compressed bitmap
+ * Return: Success   A new compressed bitmap of ew_a & ew_b
+ *         Failed    NULL
+ * Description: Merge the two streams without decompressing them
+ *****************************************************************************************************/
+struct bitmap_ewah *bitmap_ewah_and(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_or
+ * Input:  ew_a   A compressed bitmap, the result has its max_value
+ *         ew_b   Another compressed bitmap, values above ew_a's max_value are left out
+ * Return: Success   A new compressed bitmap of ew_a | ew_b
+ *         Failed    NULL
+ * Description: Merge the two streams without decompressing them
+ *****************************************************************************************************/
+struct bitmap_ewah *bitmap_ewah_or(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_not
+ * Input:  ew     A compressed bitmap
+ * Return: Success   A new compressed bitmap of the values 1 to max_value not set in ew
+ *         Failed    NULL
+ * Description: Flip the runs and the literals, the markers keep their shape
+ *****************************************************************************************************/
+struct bitmap_ewah *bitmap_ewah_not(struct bitmap_ewah *ew);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_and_cardinality
+ * Input:  ew_a   A compressed bitmap
+ *         ew_b   Another compressed bitmap
+ * Return: Number of values set in both, 0 when either is invalid
+ * Description: Same merge as bitmap_ewah_and, counting instead of writing a result
+ *****************************************************************************************************/
+u16 bitmap_ewah_and_cardinality(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b);
+
+/*****************************************************************************************************
+ * Name: bitmap_ewah_or_cardinality
+ * Input:  ew_a   A compressed bitmap
+ *         ew_b   Another compressed bitmap
+ * Return: Number of values up to ew_a's max_value set in either, 0 when either is invalid
+ * Description: Same merge as bitmap_ewah_or, counting instead of writing a result
+ *****************************************************************************************************/
+u16 bitmap_ewah_or_cardinality(struct bitmap_ewah *ew_a, struct bitmap_ewah *ew_b);
+
+#endif // BITMAP_EWAH_H_INCLUDED
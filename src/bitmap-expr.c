@@ -0,0 +1,748 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "popcount.h"
+#include "word-ops.h"
+#include "bitmap-rank.h"
+#include "bitmap-expr.h"
+
+#define EXPR_BLOCK_WORDS 256       /* Words of every input per pass of the plan, the temporaries stay in L1 */
+#define EXPR_MAX_NEST 256          /* Parentheses and '~' the parser follows before giving up */
+#define EXPR_MAX_PLAN 65535        /* Instructions of a plan, bounds trees that reuse nodes */
+
+/* Plan instructions. The *_VAR forms read an input block instead of popping a temporary */
+enum expr_code
+{
+    CODE_LOAD = 0,                 /* Push a copy of an input block */
+    CODE_NOT,                      /* top = ~top */
+    CODE_AND,                      /* Pop top, new top &= it */
+    CODE_OR,
+    CODE_XOR,
+    CODE_ANDNOT,                   /* Pop top, new top &= ~it */
+    CODE_AND_VAR,                  /* top &= input */
+    CODE_OR_VAR,
+    CODE_XOR_VAR,
+    CODE_ANDNOT_VAR                /* top &= ~input */
+};
+
+struct expr_node
+{
+    u8 op;                         /* BITMAP_EXPR_* */
+    u16 a;                         /* Variable of a VAR node, else the first operand */
+    u16 b;                         /* Second operand of a binary node */
+};
+
+struct expr_insn
+{
+    u8 code;                       /* CODE_* */
+    u16 var;                       /* Input of CODE_LOAD and the *_VAR codes */
+};
+
+struct bitmap_expr
+{
+    struct bitmap_expr *ex_self;   /* The value used when creating it */
+    struct expr_node *nodes;
+    u32 count;
+    u32 cap;
+    struct expr_insn *plan;        /* NULL until compiled */
+    u32 plan_len;
+    u32 plan_cap;
+    u16 vars;
+    char (*names)[BITMAP_EXPR_NAME_LEN];   /* Variable names of a parsed expression */
+    u16 named;                     /* Entries in names */
+};
+
+struct expr_parser
+{
+    struct bitmap_expr *ex;
+    const char *text;
+    size_t pos;
+    u32 nest;
+};
+
+static bool expr_check(struct bitmap_expr *ex);
+static u32 tail_mask(u16 max_value);
+static u16 node_add(struct bitmap_expr *ex, u8 op, u16 a, u16 b);
+static u16 node_binary(struct bitmap_expr *ex, u8 op, u16 a, u16 b);
+static bool is_direct(struct bitmap_expr *ex, u8 op, u16 n);
+static u16 right_need(struct bitmap_expr *ex, u8 op, u16 r, const u16 *need);
+static u16 pair_need(struct bitmap_expr *ex, u8 op, u16 l, u16 r, const u16 *need);
+static bool order_swapped(struct bitmap_expr *ex, struct expr_node *node, const u16 *need);
+static bool plan_emit(struct bitmap_expr *ex, u8 code, u16 var);
+static bool plan_node(struct bitmap_expr *ex, u16 n, const u16 *need);
+static bool expr_run(struct bitmap_expr *ex, struct bitmap **inputs, u16 n, struct bitmap *bm_result, u16 *numbers);
+static void skip_blanks(struct expr_parser *p);
+static u16 parse_name(struct expr_parser *p);
+static u16 parse_unary(struct expr_parser *p);
+static u16 parse_level(struct expr_parser *p, u8 op);
+
+static bool expr_check(struct bitmap_expr *ex)
+{
+    return ex != NULL && ex == ex->ex_self;
+}
+
+static u32 tail_mask(u16 max_value)
+{
+    return max_value % UINT_BITS == 0 ? ~0U : (1U << (max_value % UINT_BITS)) - 1;
+}
+
+static u16 node_add(struct bitmap_expr *ex, u8 op, u16 a, u16 b)
+{
+    struct expr_node *nodes = NULL;
+    u32 cap = 0;
+
+    if (!expr_check(ex) || ex->count >= BITMAP_EXPR_NONE)
+    {
+        return BITMAP_EXPR_NONE;
+    }
+
+    if (ex->count == ex->cap)
+    {
+        cap = ex->cap != 0 ? ex->cap * 2 : 16;
+        nodes = (struct expr_node *)realloc(ex->nodes, cap * sizeof(struct expr_node));
+
+        if (nodes == NULL)
+        {
+            return BITMAP_EXPR_NONE;
+        }
+
+        ex->nodes = nodes;
+        ex->cap = cap;
+    }
+
+    ex->nodes[ex->count].op = op;
+    ex->nodes[ex->count].a = a;
+    ex->nodes[ex->count].b = b;
+
+    return (u16)ex->count++;
+}
+
+static u16 node_binary(struct bitmap_expr *ex, u8 op, u16 a, u16 b)
+{
+    if (!expr_check(ex) || a >= ex->count || b >= ex->count)
+    {
+        return BITMAP_EXPR_NONE;
+    }
+
+    return node_add(ex, op, a, b);
+}
+
+/* n can be applied to the top temporary straight from the inputs */
+static bool is_direct(struct bitmap_expr *ex, u8 op, u16 n)
+{
+    struct expr_node *node = &ex->nodes[n];
+
+    return node->op == BITMAP_EXPR_VAR ||
+           (op == BITMAP_EXPR_AND && node->op == BITMAP_EXPR_NOT && ex->nodes[node->a].op == BITMAP_EXPR_VAR);
+}
+
+/* Temporaries the right operand needs, an AND takes the operand of a '~' with CODE_ANDNOT */
+static u16 right_need(struct bitmap_expr *ex, u8 op, u16 r, const u16 *need)
+{
+    if (op == BITMAP_EXPR_AND && ex->nodes[r].op == BITMAP_EXPR_NOT)
+    {
+        return need[ex->nodes[r].a];
+    }
+
+    return need[r];
+}
+
+/* Temporaries needed to evaluate l, then r on top of it */
+static u16 pair_need(struct bitmap_expr *ex, u8 op, u16 l, u16 r, const u16 *need)
+{
+    u16 rn = 0;
+
+    if (is_direct(ex, op, r))
+    {
+        return need[l];
+    }
+
+    rn = right_need(ex, op, r, need) + 1;
+
+    return need[l] > rn ? need[l] : rn;
+}
+
+/* Every binary operator is commutative, so the operand order is the one needing fewer temporaries */
+static bool order_swapped(struct bitmap_expr *ex, struct expr_node *node, const u16 *need)
+{
+    return pair_need(ex, node->op, node->b, node->a, need) < pair_need(ex, node->op, node->a, node->b, need);
+}
+
+static bool plan_emit(struct bitmap_expr *ex, u8 code, u16 var)
+{
+    struct expr_insn *plan = NULL;
+    u32 cap = 0;
+
+    if (ex->plan_len == EXPR_MAX_PLAN)
+    {
+        return false;
+    }
+
+    if (ex->plan_len == ex->plan_cap)
+    {
+        cap = ex->plan_cap != 0 ? ex->plan_cap * 2 : 16;
+        plan = (struct expr_insn *)realloc(ex->plan, cap * sizeof(struct expr_insn));
+
+        if (plan == NULL)
+        {
+            return false;
+        }
+
+        ex->plan = plan;
+        ex->plan_cap = cap;
+    }
+
+    ex->plan[ex->plan_len].code = code;
+    ex->plan[ex->plan_len].var = var;
+    ex->plan_len++;
+
+    return true;
+}
+
+static bool plan_node(struct bitmap_expr *ex, u16 n, const u16 *need)
+{
+    struct expr_node *node = &ex->nodes[n];
+    struct expr_node *rnode = NULL;
+    u16 l = node->a;
+    u16 r = node->b;
+    u8 code = 0;
+    bool negate = false;
+
+    if (node->op == BITMAP_EXPR_VAR)
+    {
+        return plan_emit(ex, CODE_LOAD, node->a);
+    }
+
+    if (node->op == BITMAP_EXPR_NOT)
+    {
+        return plan_node(ex, node->a, need) && plan_emit(ex, CODE_NOT, 0);
+    }
+
+    if (order_swapped(ex, node, need))
+    {
+        l = node->b;
+        r = node->a;
+    }
+
+    rnode = &ex->nodes[r];
+
+    if (node->op == BITMAP_EXPR_AND && rnode->op == BITMAP_EXPR_NOT)
+    {
+        negate = true;
+        r = rnode->a;
+        rnode = &ex->nodes[r];
+    }
+
+    code = node->op == BITMAP_EXPR_AND ? (negate ? CODE_ANDNOT : CODE_AND) :
+           node->op == BITMAP_EXPR_OR ? CODE_OR : CODE_XOR;
+
+    if (!plan_node(ex, l, need))
+    {
+        return false;
+    }
+
+    if (rnode->op == BITMAP_EXPR_VAR)
+    {
+        /* CODE_AND .. CODE_ANDNOT and their *_VAR forms are in the same order */
+        return plan_emit(ex, (u8)(code - CODE_AND + CODE_AND_VAR), rnode->a);
+    }
+
+    return plan_node(ex, r, need) && plan_emit(ex, code, 0);
+}
+
+/* Run the plan over every block of the inputs, storing into bm_result when it is not NULL */
+static bool expr_run(struct bitmap_expr *ex, struct bitmap **inputs, u16 n, struct bitmap *bm_result, u16 *numbers)
+{
+    const struct word_ops *ops = word_ops_get();
+    u32 tmp[BITMAP_EXPR_MAX_DEPTH][EXPR_BLOCK_WORDS];
+    u32 *slot[BITMAP_EXPR_MAX_DEPTH];
+    struct expr_insn *insn = NULL;
+    struct bitmap *bm = NULL;
+    u16 max_value = 0;
+    u16 buf_len = 0;
+    u32 first = 0;
+    u32 last = 0;
+    u64 total = 0;
+    u64 set = 0;
+    u32 start = 0;
+    u32 words = 0;
+    size_t bytes = 0;
+    bool direct = bm_result != NULL;
+    u32 sp = 0;
+    u32 i = 0;
+
+    if (!expr_check(ex) || ex->plan == NULL || inputs == NULL || n < ex->vars)
+    {
+        return false;
+    }
+
+    for (i = 0; i < ex->vars; i++)
+    {
+        if (!bitmap_is_valid(inputs[i]) || inputs[i]->max_value != inputs[0]->max_value)
+        {
+            return false;
+        }
+    }
+
+    max_value = inputs[0]->max_value;
+    buf_len = inputs[0]->buf_len;
+
+    if (bm_result != NULL &&
+        (!bitmap_is_valid(bm_result) || (bm_result->flags & BITMAP_FLAG_READONLY) || bm_result->max_value != max_value))
+    {
+        return false;
+    }
+
+    for (i = 0; i < BITMAP_EXPR_MAX_DEPTH; i++)
+    {
+        slot[i] = tmp[i];
+    }
+
+    /* The bottom temporary is the result, so it can live in bm_result unless the plan still reads that */
+    for (i = 0; i < ex->vars; i++)
+    {
+        direct = direct && inputs[i] != bm_result;
+    }
+
+    for (start = 0; start < buf_len; start += words)
+    {
+        words = buf_len - start < EXPR_BLOCK_WORDS ? buf_len - start : EXPR_BLOCK_WORDS;
+        bytes = words * sizeof(u32);
+        sp = 0;
+
+        if (direct)
+        {
+            slot[0] = bm_result->buf + start;
+        }
+
+        for (i = 0; i < ex->plan_len; i++)
+        {
+            insn = &ex->plan[i];
+            bm = inputs[insn->var];
+
+            switch (insn->code)
+            {
+                case CODE_LOAD:
+                    memcpy(slot[sp++], bm->buf + start, bytes);
+                    break;
+                case CODE_NOT:
+                    ops->not_words(slot[sp - 1], bytes);
+                    break;
+                case CODE_AND:
+                    sp--;
+                    ops->and_words(slot[sp - 1], slot[sp], bytes);
+                    break;
+                case CODE_OR:
+                    sp--;
+                    ops->or_words(slot[sp - 1], slot[sp], bytes);
+                    break;
+                case CODE_XOR:
+                    sp--;
+                    ops->xor_words(slot[sp - 1], slot[sp], bytes);
+                    break;
+                case CODE_ANDNOT:
+                    sp--;
+                    ops->andnot_words(slot[sp - 1], slot[sp], bytes);
+                    break;
+                case CODE_AND_VAR:
+                    ops->and_words(slot[sp - 1], bm->buf + start, bytes);
+                    break;
+                case CODE_OR_VAR:
+                    ops->or_words(slot[sp - 1], bm->buf + start, bytes);
+                    break;
+                case CODE_XOR_VAR:
+                    ops->xor_words(slot[sp - 1], bm->buf + start, bytes);
+                    break;
+                default:
+                    ops->andnot_words(slot[sp - 1], bm->buf + start, bytes);
+                    break;
+            }
+        }
+
+        /* '~' sets the bits above max_value, they only matter in the last word */
+        if (start + words == buf_len)
+        {
+            slot[0][words - 1] &= tail_mask(max_value);
+        }
+
+        set = popcount_buf(slot[0], bytes);
+        total += set;
+
+        if (set != 0)
+        {
+            for (i = 0; first == 0 && i < words; i++)
+            {
+                if (slot[0][i] != 0)
+                {
+                    first = (start + i) * UINT_BITS + ctz32(slot[0][i]) + 1;
+                }
+            }
+
+            for (i = words; i > 0; i--)
+            {
+                if (slot[0][i - 1] != 0)
+                {
+                    last = (start + i) * UINT_BITS - clz32(slot[0][i - 1]);
+                    break;
+                }
+            }
+        }
+
+        /* Otherwise bm_result is an input, each block is stored only after the plan has read it */
+        if (bm_result != NULL && !direct)
+        {
+            memcpy(bm_result->buf + start, slot[0], bytes);
+        }
+    }
+
+    if (bm_result != NULL)
+    {
+        bm_result->numbers = (u16)total;
+        bm_result->first_value = (u16)first;
+        bm_result->last_value = (u16)last;
+        bm_result->flags &= ~BITMAP_FLAG_DIRTY;
+        bitmap_rank_invalidate(bm_result);
+    }
+
+    *numbers = (u16)total;
+
+    return true;
+}
+
+static void skip_blanks(struct expr_parser *p)
+{
+    while (p->text[p->pos] == ' ' || p->text[p->pos] == '\t')
+    {
+        p->pos++;
+    }
+
+    return;
+}
+
+/* A name, the same name always gives the same variable */
+static u16 parse_name(struct expr_parser *p)
+{
+    struct bitmap_expr *ex = p->ex;
+    char (*names)[BITMAP_EXPR_NAME_LEN] = NULL;
+    size_t len = 0;
+    u16 i = 0;
+    char c = 0;
+
+    for (;;)
+    {
+        c = p->text[p->pos + len];
+
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+        {
+            break;
+        }
+
+        len++;
+    }
+
+    if (len == 0 || len >= BITMAP_EXPR_NAME_LEN)
+    {
+        return BITMAP_EXPR_NONE;
+    }
+
+    for (i = 0; i < ex->named; i++)
+    {
+        if (strncmp(ex->names[i], p->text + p->pos, len) == 0 && ex->names[i][len] == '\0')
+        {
+            break;
+        }
+    }
+
+    if (i == ex->named)
+    {
+        names = (char (*)[BITMAP_EXPR_NAME_LEN])realloc(ex->names, ((size_t)ex->named + 1) * BITMAP_EXPR_NAME_LEN);
+
+        if (names == NULL)
+        {
+            return BITMAP_EXPR_NONE;
+        }
+
+        ex->names = names;
+        memcpy(ex->names[i], p->text + p->pos, len);
+        ex->names[i][len] = '\0';
+        ex->named++;
+    }
+
+    p->pos += len;
+
+    return bitmap_expr_var(ex, i);
+}
+
+static u16 parse_unary(struct expr_parser *p)
+{
+    u16 n = BITMAP_EXPR_NONE;
+
+    skip_blanks(p);
+
+    if (p->text[p->pos] != '~' && p->text[p->pos] != '(')
+    {
+        return parse_name(p);
+    }
+
+    if (++p->nest > EXPR_MAX_NEST)
+    {
+        return BITMAP_EXPR_NONE;
+    }
+
+    if (p->text[p->pos] == '~')
+    {
+        p->pos++;
+        n = bitmap_expr_not(p->ex, parse_unary(p));
+    }
+    else
+    {
+        p->pos++;
+        n = parse_level(p, BITMAP_EXPR_OR);
+        skip_blanks(p);
+
+        if (n == BITMAP_EXPR_NONE || p->text[p->pos] != ')')
+        {
+            return BITMAP_EXPR_NONE;
+        }
+
+        p->pos++;
+    }
+
+    p->nest--;
+
+    return n;
+}
+
+/* Left-associative chain of op, whose operands are the next tighter level: '|' over '^' over '&' */
+static u16 parse_level(struct expr_parser *p, u8 op)
+{
+    static const char symbol[] = {'\0', '\0', '&', '|', '^'};
+    u16 n = BITMAP_EXPR_NONE;
+    u16 m = BITMAP_EXPR_NONE;
+
+    n = op == BITMAP_EXPR_AND ? parse_unary(p) : parse_level(p, op == BITMAP_EXPR_OR ? BITMAP_EXPR_XOR : BITMAP_EXPR_AND);
+
+    for (;;)
+    {
+        skip_blanks(p);
+
+        if (n == BITMAP_EXPR_NONE || p->text[p->pos] != symbol[op])
+        {
+            return n;
+        }
+
+        p->pos++;
+        m = op == BITMAP_EXPR_AND ? parse_unary(p) : parse_level(p, op == BITMAP_EXPR_OR ? BITMAP_EXPR_XOR : BITMAP_EXPR_AND);
+        n = node_binary(p->ex, op, n, m);
+    }
+}
+
+struct bitmap_expr *bitmap_expr_create(void)
+{
+    struct bitmap_expr *ex = NULL;
+
+    ex = (struct bitmap_expr *)calloc(1, sizeof(struct bitmap_expr));
+
+    if (ex == NULL)
+    {
+        return NULL;
+    }
+
+    ex->ex_self = ex;
+
+    return ex;
+}
+
+void bitmap_expr_destroy(struct bitmap_expr *ex)
+{
+    if (!expr_check(ex))
+    {
+        return;
+    }
+
+    ex->ex_self = NULL;
+    free(ex->nodes);
+    free(ex->plan);
+    free(ex->names);
+    free(ex);
+
+    return;
+}
+
+u16 bitmap_expr_var(struct bitmap_expr *ex, u16 index)
+{
+    u16 n = BITMAP_EXPR_NONE;
+
+    if (index == BITMAP_EXPR_NONE)
+    {
+        return BITMAP_EXPR_NONE;
+    }
+
+    n = node_add(ex, BITMAP_EXPR_VAR, index, 0);
+
+    if (n != BITMAP_EXPR_NONE && index >= ex->vars)
+    {
+        ex->vars = index + 1;
+    }
+
+    return n;
+}
+
+u16 bitmap_expr_not(struct bitmap_expr *ex, u16 a)
+{
+    if (!expr_check(ex) || a >= ex->count)
+    {
+        return BITMAP_EXPR_NONE;
+    }
+
+    return node_add(ex, BITMAP_EXPR_NOT, a, 0);
+}
+
+u16 bitmap_expr_and(struct bitmap_expr *ex, u16 a, u16 b)
+{
+    return node_binary(ex, BITMAP_EXPR_AND, a, b);
+}
+
+u16 bitmap_expr_or(struct bitmap_expr *ex, u16 a, u16 b)
+{
+    return node_binary(ex, BITMAP_EXPR_OR, a, b);
+}
+
+u16 bitmap_expr_xor(struct bitmap_expr *ex, u16 a, u16 b)
+{
+    return node_binary(ex, BITMAP_EXPR_XOR, a, b);
+}
+
+bool bitmap_expr_compile(struct bitmap_expr *ex, u16 root)
+{
+    struct expr_node *node = NULL;
+    u16 *need = NULL;
+    u32 i = 0;
+    bool ok = false;
+
+    if (!expr_check(ex) || root >= ex->count)
+    {
+        return false;
+    }
+
+    need = (u16 *)malloc(ex->count * sizeof(u16));
+
+    if (need == NULL)
+    {
+        return false;
+    }
+
+    /* Operands are always created before the nodes using them, one forward pass sizes every subtree */
+    for (i = 0; i < ex->count; i++)
+    {
+        node = &ex->nodes[i];
+
+        if (node->op == BITMAP_EXPR_VAR)
+        {
+            need[i] = 1;
+        }
+        else if (node->op == BITMAP_EXPR_NOT)
+        {
+            need[i] = need[node->a];
+        }
+        else
+        {
+            need[i] = order_swapped(ex, node, need) ? pair_need(ex, node->op, node->b, node->a, need) :
+                                                      pair_need(ex, node->op, node->a, node->b, need);
+        }
+    }
+
+    ex->plan_len = 0;
+
+    if (need[root] <= BITMAP_EXPR_MAX_DEPTH)
+    {
+        ok = plan_node(ex, root, need);
+    }
+
+    free(need);
+
+    if (!ok)
+    {
+        free(ex->plan);
+        ex->plan = NULL;
+        ex->plan_len = 0;
+        ex->plan_cap = 0;
+    }
+
+    return ok;
+}
+
+struct bitmap_expr *bitmap_expr_parse(const char *text, size_t *error_offset)
+{
+    struct expr_parser p;
+    u16 root = BITMAP_EXPR_NONE;
+
+    if (text == NULL)
+    {
+        return NULL;
+    }
+
+    memset(&p, 0, sizeof(struct expr_parser));
+    p.text = text;
+    p.ex = bitmap_expr_create();
+
+    if (p.ex != NULL)
+    {
+        root = parse_level(&p, BITMAP_EXPR_OR);
+        skip_blanks(&p);
+    }
+
+    if (p.ex == NULL || root == BITMAP_EXPR_NONE || text[p.pos] != '\0' || !bitmap_expr_compile(p.ex, root))
+    {
+        if (error_offset != NULL)
+        {
+            *error_offset = p.pos;
+        }
+
+        bitmap_expr_destroy(p.ex);
+
+        return NULL;
+    }
+
+    return p.ex;
+}
+
+u16 bitmap_expr_vars(struct bitmap_expr *ex)
+{
+    return expr_check(ex) ? ex->vars : 0;
+}
+
+const char *bitmap_expr_var_name(struct bitmap_expr *ex, u16 index)
+{
+    if (!expr_check(ex) || index >= ex->named)
+    {
+        return NULL;
+    }
+
+    return ex->names[index];
+}
+
+bool bitmap_expr_eval(struct bitmap_expr *ex, struct bitmap **inputs, u16 n, struct bitmap *bm_result)
+{
+    u16 numbers = 0;
+
+    if (bm_result == NULL)
+    {
+        return false;
+    }
+
+    return expr_run(ex, inputs, n, bm_result, &numbers);
+}
+
+u16 bitmap_expr_cardinality(struct bitmap_expr *ex, struct bitmap **inputs, u16 n)
+{
+    u16 numbers = 0;
+
+    if (!expr_run(ex, inputs, n, NULL, &numbers))
+    {
+        return 0;
+    }
+
+    return numbers;
+}
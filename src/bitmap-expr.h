@@ -0,0 +1,168 @@
+#ifndef BITMAP_EXPR_H_INCLUDED
+#define BITMAP_EXPR_H_INCLUDED
+
+#include <stddef.h>
+#include "bitmap.h"
+
+#define BITMAP_EXPR_NONE 0xFFFF            /* Never a valid node */
+#define BITMAP_EXPR_NAME_LEN 32            /* Names in an expression text are at most 31 characters */
+#define BITMAP_EXPR_MAX_DEPTH 16           /* Temporaries a compiled plan may need at once */
+
+enum bitmap_expr_op
+{
+    BITMAP_EXPR_VAR = 0,           /* Input bitmap */
+    BITMAP_EXPR_NOT,
+    BITMAP_EXPR_AND,
+    BITMAP_EXPR_OR,
+    BITMAP_EXPR_XOR
+};
+
+/*
+ * Expression over bitmaps such as "(A & B) | ~(C | D)". Nodes are added with the builder functions
+ * or by bitmap_expr_parse, then bitmap_expr_compile turns the tree under one node into a plan.
+ * The plan runs over one block of words of every input at a time, keeping intermediate results in
+ * small stack blocks that stay in L1, so the whole tree costs one pass over the inputs and the
+ * result, with numbers/first_value/last_value computed in the same pass.
+ *
+ * Variables are the positions in the input array given to bitmap_expr_eval. A compiled expression
+ * is only read by the evaluation, so it can be evaluated by many threads at once.
+ */
+struct bitmap_expr;
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_create
+ * Input:  None
+ * Return: Success   An empty expression
+ *         Failed    NULL
+ * Description: Start an expression for the builder functions, release it with bitmap_expr_destroy
+ *****************************************************************************************************/
+struct bitmap_expr *bitmap_expr_create(void);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_destroy
+ * Input:  ex     The expression
+ * Return: None
+ * Description: Release the nodes and the plan
+ *****************************************************************************************************/
+void bitmap_expr_destroy(struct bitmap_expr *ex);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_var
+ * Input:  ex     The expression
+ *         index  Position of the bitmap in the array given to bitmap_expr_eval
+ * Return: Success   The new node
+ *         Failed    BITMAP_EXPR_NONE
+ * Description: Leaf reading an input bitmap
+ *****************************************************************************************************/
+u16 bitmap_expr_var(struct bitmap_expr *ex, u16 index);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_not
+ * Input:  ex     The expression
+ *         a      A node of ex
+ * Return: Success   The new node
+ *         Failed    BITMAP_EXPR_NONE, also when a is BITMAP_EXPR_NONE
+ * Description: The values from 1 to max_value not in a
+ *****************************************************************************************************/
+u16 bitmap_expr_not(struct bitmap_expr *ex, u16 a);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_and
+ * Input:  ex     The expression
+ *         a      A node of ex
+ *         b      Another node of ex
+ * Return: Success   The new node
+ *         Failed    BITMAP_EXPR_NONE, also when a or b is BITMAP_EXPR_NONE
+ * Description: The values in both a and b. A failed call can be passed on, so a tree can be
+ *              built without checking each step
+ *****************************************************************************************************/
+u16 bitmap_expr_and(struct bitmap_expr *ex, u16 a, u16 b);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_or
+ * Input:  ex     The expression
+ *         a      A node of ex
+ *         b      Another node of ex
+ * Return: Success   The new node
+ *         Failed    BITMAP_EXPR_NONE, also when a or b is BITMAP_EXPR_NONE
+ * Description: The values in a or b
+ *****************************************************************************************************/
+u16 bitmap_expr_or(struct bitmap_expr *ex, u16 a, u16 b);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_xor
+ * Input:  ex     The expression
+ *         a      A node of ex
+ *         b      Another node of ex
+ * Return: Success   The new node
+ *         Failed    BITMAP_EXPR_NONE, also when a or b is BITMAP_EXPR_NONE
+ * Description: The values in exactly one of a and b
+ *****************************************************************************************************/
+u16 bitmap_expr_xor(struct bitmap_expr *ex, u16 a, u16 b);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_compile
+ * Input:  ex     The expression
+ *         root   The node to evaluate
+ * Return: Success   true
+ *         Failed    false for a bad node or a tree needing more than BITMAP_EXPR_MAX_DEPTH
+ *                   temporaries
+ * Description: Build the plan of root. Deeper subtrees are evaluated first so few temporaries are
+ *              live, and an input or the NOT of an input on the right of a binary node is read
+ *              directly instead of being copied into a temporary
+ *****************************************************************************************************/
+bool bitmap_expr_compile(struct bitmap_expr *ex, u16 root);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_parse
+ * Input:  text          Expression with names, '~', '&', '^', '|' and parentheses
+ *         error_offset  NULL, or receives the offset of the character an error was found at
+ * Return: Success   A compiled expression
+ *         Failed    NULL
+ * Description: Precedence is C's, '~' binds tightest, then '&', '^' and '|'. Names are made of
+ *              letters, digits and '_'. Each distinct name is one variable, numbered from 0 in
+ *              order of first appearance, see bitmap_expr_var_name
+ *****************************************************************************************************/
+struct bitmap_expr *bitmap_expr_parse(const char *text, size_t *error_offset);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_vars
+ * Input:  ex     The expression
+ * Return: Number of input bitmaps bitmap_expr_eval needs, one more than the highest variable
+ * Description: None
+ *****************************************************************************************************/
+u16 bitmap_expr_vars(struct bitmap_expr *ex);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_var_name
+ * Input:  ex     The expression
+ *         index  A variable
+ * Return: The name of variable index in the parsed text, NULL for a built expression
+ * Description: None
+ *****************************************************************************************************/
+const char *bitmap_expr_var_name(struct bitmap_expr *ex, u16 index);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_eval
+ * Input:  ex         A compiled expression
+ *         inputs     bitmap_expr_vars(ex) bitmaps, all with the same max_value
+ *         n          Number of bitmaps in inputs
+ *         bm_result  Writable bitmap with the same max_value, may also be one of the inputs
+ * Return: Success   true
+ *         Failed    false
+ * Description: Evaluate the plan block by block and store the result, numbers/first_value/
+ *              last_value are exact afterwards even for a lazy bitmap
+ *****************************************************************************************************/
+bool bitmap_expr_eval(struct bitmap_expr *ex, struct bitmap **inputs, u16 n, struct bitmap *bm_result);
+
+/*****************************************************************************************************
+ * Name: bitmap_expr_cardinality
+ * Input:  ex         A compiled expression
+ *         inputs     bitmap_expr_vars(ex) bitmaps, all with the same max_value
+ *         n          Number of bitmaps in inputs
+ * Return: Number of values in the result, 0 on failure
+ * Description: Same pass as bitmap_expr_eval, the result is counted and never stored
+ *****************************************************************************************************/
+u16 bitmap_expr_cardinality(struct bitmap_expr *ex, struct bitmap **inputs, u16 n);
+
+#endif // BITMAP_EXPR_H_INCLUDED
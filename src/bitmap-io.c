@@ -0,0 +1,438 @@
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bitmap.h"
+#include "bitmap-rank.h"
+#include "bitmap-io.h"
+
+/* struct bitmap is laid over the reserved header bytes in front of the mapped words */
+_Static_assert(offsetof(struct bitmap, buf) <= BITMAP_IO_HEADER_SIZE - 32, "struct bitmap must fit in the reserved header bytes");
+_Static_assert((BITMAP_IO_HEADER_SIZE - offsetof(struct bitmap, buf)) % _Alignof(struct bitmap) == 0, "the view's struct bitmap must be aligned");
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BITMAP_IO_NATIVE_LE 1
+#else
+#define BITMAP_IO_NATIVE_LE 0
+#endif
+
+/* Header fields in host order */
+struct io_header
+{
+    u16 max_value;
+    u16 numbers;
+    u16 first_value;
+    u16 last_value;
+    u16 buf_len;
+    u64 data_checksum;
+};
+
+static void store_le16(u8 *p, u16 v);
+static void store_le32(u8 *p, u32 v);
+static void store_le64(u8 *p, u64 v);
+static u16 load_le16(const u8 *p);
+static u32 load_le32(const u8 *p);
+static u64 load_le64(const u8 *p);
+static u64 words_checksum(const u32 *words, u32 n);
+static u32 header_checksum(const u8 *hdr);
+static void header_encode(struct bitmap *bm, u8 *hdr);
+static bool header_decode(const u8 *hdr, struct io_header *h);
+static size_t data_size(u16 buf_len);
+
+static void store_le16(u8 *p, u16 v)
+{
+    p[0] = (u8)v;
+    p[1] = (u8)(v >> 8);
+
+    return;
+}
+
+static void store_le32(u8 *p, u32 v)
+{
+    store_le16(p, (u16)v);
+    store_le16(p + 2, (u16)(v >> 16));
+
+    return;
+}
+
+static void store_le64(u8 *p, u64 v)
+{
+    store_le32(p, (u32)v);
+    store_le32(p + 4, (u32)(v >> 32));
+
+    return;
+}
+
+static u16 load_le16(const u8 *p)
+{
+    return (u16)(p[0] | (p[1] << 8));
+}
+
+static u32 load_le32(const u8 *p)
+{
+    return load_le16(p) | ((u32)load_le16(p + 2) << 16);
+}
+
+static u64 load_le64(const u8 *p)
+{
+    return load_le32(p) | ((u64)load_le32(p + 4) << 32);
+}
+
+/* Fletcher style sums over the word values, so the result does not depend on the host byte order */
+static u64 words_checksum(const u32 *words, u32 n)
+{
+    u32 sum1 = 0;
+    u32 sum2 = 0;
+    u32 i = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        sum1 += words[i];
+        sum2 += sum1;
+    }
+
+    return ((u64)sum2 << 32) | sum1;
+}
+
+static u32 header_checksum(const u8 *hdr)
+{
+    u32 words[BITMAP_IO_HEADER_SIZE / sizeof(u32)];
+    u64 sum = 0;
+    u32 i = 0;
+
+    for (i = 0; i < BITMAP_IO_HEADER_SIZE / sizeof(u32); i++)
+    {
+        words[i] = load_le32(hdr + i * sizeof(u32));
+    }
+
+    words[20 / sizeof(u32)] = 0;
+    sum = words_checksum(words, BITMAP_IO_HEADER_SIZE / sizeof(u32));
+
+    return (u32)(sum >> 32) ^ (u32)sum;
+}
+
+static void header_encode(struct bitmap *bm, u8 *hdr)
+{
+    memset(hdr, 0, BITMAP_IO_HEADER_SIZE);
+    store_le32(hdr, BITMAP_IO_MAGIC);
+    store_le16(hdr + 4, BITMAP_IO_VERSION);
+    store_le16(hdr + 6, BITMAP_IO_HEADER_SIZE);
+    store_le16(hdr + 8, bm->max_value);
+    store_le16(hdr + 10, bitmap_cardinality(bm));
+    store_le16(hdr + 12, bitmap_first(bm));
+    store_le16(hdr + 14, bitmap_last(bm));
+    store_le16(hdr + 16, bm->buf_len);
+    store_le64(hdr + 24, words_checksum(bm->buf, bm->buf_len));
+    store_le32(hdr + 20, header_checksum(hdr));
+
+    return;
+}
+
+static bool header_decode(const u8 *hdr, struct io_header *h)
+{
+    if (load_le32(hdr) != BITMAP_IO_MAGIC || load_le16(hdr + 4) != BITMAP_IO_VERSION ||
+        load_le16(hdr + 6) != BITMAP_IO_HEADER_SIZE || load_le32(hdr + 20) != header_checksum(hdr))
+    {
+        return false;
+    }
+
+    h->max_value = load_le16(hdr + 8);
+    h->numbers = load_le16(hdr + 10);
+    h->first_value = load_le16(hdr + 12);
+    h->last_value = load_le16(hdr + 14);
+    h->buf_len = load_le16(hdr + 16);
+    h->data_checksum = load_le64(hdr + 24);
+
+    if (h->max_value == 0 || h->buf_len != (h->max_value + UINT_BITS - 1) / UINT_BITS || h->numbers > h->max_value)
+    {
+        return false;
+    }
+
+    if (h->numbers == 0)
+    {
+        return h->first_value == 0 && h->last_value == 0;
+    }
+
+    return h->first_value != 0 && h->first_value <= h->last_value && h->last_value <= h->max_value;
+}
+
+static size_t data_size(u16 buf_len)
+{
+    return ((size_t)buf_len * sizeof(u32) + BITMAP_IO_ALIGN - 1) & ~(size_t)(BITMAP_IO_ALIGN - 1);
+}
+
+size_t bitmap_serialized_size(struct bitmap *bm)
+{
+    if (!bitmap_is_valid(bm))
+    {
+        return 0;
+    }
+
+    return BITMAP_IO_HEADER_SIZE + data_size(bm->buf_len);
+}
+
+bool bitmap_write(struct bitmap *bm, FILE *fp)
+{
+    u8 hdr[BITMAP_IO_HEADER_SIZE];
+    u8 pad[BITMAP_IO_ALIGN];
+    size_t bytes = 0;
+    u16 i = 0;
+
+    if (!bitmap_is_valid(bm) || fp == NULL)
+    {
+        return false;
+    }
+
+    header_encode(bm, hdr);
+
+    if (fwrite(hdr, 1, sizeof(hdr), fp) != sizeof(hdr))
+    {
+        return false;
+    }
+
+    bytes = (size_t)bm->buf_len * sizeof(u32);
+
+    if (BITMAP_IO_NATIVE_LE)
+    {
+        if (fwrite(bm->buf, 1, bytes, fp) != bytes)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        for (i = 0; i < bm->buf_len; i++)
+        {
+            store_le32(pad, bm->buf[i]);
+
+            if (fwrite(pad, 1, sizeof(u32), fp) != sizeof(u32))
+            {
+                return false;
+            }
+        }
+    }
+
+    memset(pad, 0, sizeof(pad));
+    bytes = data_size(bm->buf_len) - bytes;
+
+    return fwrite(pad, 1, bytes, fp) == bytes;
+}
+
+struct bitmap *bitmap_read(FILE *fp)
+{
+    u8 hdr[BITMAP_IO_HEADER_SIZE];
+    u8 pad[BITMAP_IO_ALIGN];
+    struct io_header h;
+    struct bitmap *bm = NULL;
+    size_t bytes = 0;
+    u16 i = 0;
+
+    if (fp == NULL || fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) || !header_decode(hdr, &h))
+    {
+        return NULL;
+    }
+
+    bm = bitMap_create(h.max_value);
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    bytes = (size_t)h.buf_len * sizeof(u32);
+
+    if (fread(bm->buf, 1, bytes, fp) != bytes ||
+        fread(pad, 1, data_size(h.buf_len) - bytes, fp) != data_size(h.buf_len) - bytes)
+    {
+        bitmap_destroy(bm);
+
+        return NULL;
+    }
+
+    if (!BITMAP_IO_NATIVE_LE)
+    {
+        for (i = 0; i < h.buf_len; i++)
+        {
+            bm->buf[i] = load_le32((const u8 *)&bm->buf[i]);
+        }
+    }
+
+    bm->numbers = h.numbers;
+    bm->first_value = h.first_value;
+    bm->last_value = h.last_value;
+
+    /* The header fields must describe the words, otherwise first/last based scans go wrong */
+    if (words_checksum(bm->buf, bm->buf_len) != h.data_checksum || count_set_bits(bm) != bm->numbers ||
+        (bm->numbers != 0 && (!is_value_set(bm, bm->first_value) || !is_value_set(bm, bm->last_value))))
+    {
+        bitmap_destroy(bm);
+
+        return NULL;
+    }
+
+    return bm;
+}
+
+bool bitmap_save(struct bitmap *bm, const char *path)
+{
+    FILE *fp = NULL;
+    bool ok = false;
+
+    if (!bitmap_is_valid(bm) || path == NULL)
+    {
+        return false;
+    }
+
+    fp = fopen(path, "wb");
+
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    ok = bitmap_write(bm, fp);
+
+    if (fclose(fp) != 0)
+    {
+        ok = false;
+    }
+
+    return ok;
+}
+
+struct bitmap *bitmap_load(const char *path)
+{
+    FILE *fp = NULL;
+    struct bitmap *bm = NULL;
+
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    fp = fopen(path, "rb");
+
+    if (fp == NULL)
+    {
+        return NULL;
+    }
+
+    bm = bitmap_read(fp);
+    fclose(fp);
+
+    return bm;
+}
+
+struct bitmap *bitmap_open_view(const char *path)
+{
+    struct io_header h;
+    struct stat st;
+    struct bitmap *bm = NULL;
+    u8 *base = NULL;
+    size_t length = 0;
+    u32 used_bits = 0;
+    int fd = -1;
+
+    /* The words on disk are little-endian, other hosts get a private copy instead */
+    if (!BITMAP_IO_NATIVE_LE)
+    {
+        bm = bitmap_load(path);
+
+        if (bm != NULL)
+        {
+            bm->flags |= BITMAP_FLAG_READONLY;
+        }
+
+        return bm;
+    }
+
+    if (path == NULL)
+    {
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size < BITMAP_IO_HEADER_SIZE)
+    {
+        close(fd);
+
+        return NULL;
+    }
+
+    base = (u8 *)mmap(NULL, BITMAP_IO_HEADER_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (base == MAP_FAILED)
+    {
+        close(fd);
+
+        return NULL;
+    }
+
+    /* Map only as far as the words reach, bitmap_close_view recomputes the same length */
+    if (!header_decode(base, &h) || (size_t)st.st_size < BITMAP_IO_HEADER_SIZE + (size_t)h.buf_len * sizeof(u32))
+    {
+        munmap(base, BITMAP_IO_HEADER_SIZE);
+        close(fd);
+
+        return NULL;
+    }
+
+    munmap(base, BITMAP_IO_HEADER_SIZE);
+    length = BITMAP_IO_HEADER_SIZE + (size_t)h.buf_len * sizeof(u32);
+    base = (u8 *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    /* Only the header page is copied on write, the word pages stay shared with the page cache */
+    bm = (struct bitmap *)(base + BITMAP_IO_HEADER_SIZE - offsetof(struct bitmap, buf));
+    bm->bm_self = bm;
+    bm->max_value = h.max_value;
+    bm->buf_len = h.buf_len;
+    bm->rank = NULL;
+
+    /* The words are not checksummed here, so the counts of the header are not trusted either.
+     * Stale bounds over the whole range make the first accessor recount them from the words */
+    bm->first_value = 1;
+    bm->last_value = h.max_value;
+    bm->numbers = 0;
+    bm->flags = BITMAP_FLAG_READONLY | BITMAP_FLAG_VIEW | BITMAP_FLAG_DIRTY;
+
+    /* Bits above max_value would be counted, clearing them copies only the last page */
+    used_bits = h.max_value & UINT_MASK;
+
+    if (used_bits != 0 && (bm->buf[bm->buf_len - 1] >> used_bits) != 0)
+    {
+        bm->buf[bm->buf_len - 1] &= (1U << used_bits) - 1;
+    }
+
+    return bm;
+}
+
+void bitmap_close_view(struct bitmap *bm)
+{
+    u8 *base = NULL;
+
+    if (!bitmap_is_valid(bm) || (bm->flags & BITMAP_FLAG_VIEW) == 0)
+    {
+        return;
+    }
+
+    bitmap_rank_disable(bm);
+    bm->bm_self = NULL;
+    base = (u8 *)bm + offsetof(struct bitmap, buf) - BITMAP_IO_HEADER_SIZE;
+    munmap(base, BITMAP_IO_HEADER_SIZE + (size_t)bm->buf_len * sizeof(u32));
+
+    return;
+}
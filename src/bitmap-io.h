@@ -0,0 +1,99 @@
+#ifndef BITMAP_IO_H_INCLUDED
+#define BITMAP_IO_H_INCLUDED
+
+#include <stdio.h>
+#include "bitmap.h"
+
+/*
+ * On-disk format, every field little-endian:
+ *
+ *   offset  size  field
+ *        0     4  magic "BMAP"
+ *        4     2  version (BITMAP_IO_VERSION)
+ *        6     2  header size (BITMAP_IO_HEADER_SIZE)
+ *        8     2  max_value
+ *       10     2  numbers
+ *       12     2  first_value
+ *       14     2  last_value
+ *       16     2  buf_len
+ *       18     2  reserved, 0
+ *       20     4  header checksum, computed with this field set to 0
+ *       24     8  checksum of the word data
+ *       32    32  reserved, 0
+ *       64        buf_len 32-bit words, padded with 0 to a multiple of 64 bytes
+ */
+#define BITMAP_IO_MAGIC 0x50414D42U     /* "BMAP" read as a little-endian u32 */
+#define BITMAP_IO_VERSION 1
+#define BITMAP_IO_HEADER_SIZE 64
+#define BITMAP_IO_ALIGN 64
+
+/*****************************************************************************************************
+ * Name: bitmap_serialized_size
+ * Input:  bm     Pointer to the bitmap structure
+ * Return: Number of bytes bitmap_write produces for bm, 0 for an invalid bitmap
+ * Description: Header plus the word data rounded up to BITMAP_IO_ALIGN
+ *****************************************************************************************************/
+size_t bitmap_serialized_size(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_write
+ * Input:  bm     The bitmap that will be written
+ *         fp     Stream opened for binary writing
+ * Return: Success   true
+ *         Failed    false
+ * Description: Append bm to fp in the binary format described above
+ *****************************************************************************************************/
+bool bitmap_write(struct bitmap *bm, FILE *fp);
+
+/*****************************************************************************************************
+ * Name: bitmap_read
+ * Input:  fp     Stream opened for binary reading, positioned at a header
+ * Return: Success   A new bitmap
+ *         Failed    NULL for a short read, an unknown version or a checksum mismatch
+ * Description: Read back one bitmap written by bitmap_write, the stream is left after its data
+ *****************************************************************************************************/
+struct bitmap *bitmap_read(FILE *fp);
+
+/*****************************************************************************************************
+ * Name: bitmap_save
+ * Input:  bm     The bitmap that will be saved
+ *         path   The file that is created or truncated
+ * Return: Success   true
+ *         Failed    false
+ * Description: Write bm alone into the file at path
+ *****************************************************************************************************/
+bool bitmap_save(struct bitmap *bm, const char *path);
+
+/*****************************************************************************************************
+ * Name: bitmap_load
+ * Input:  path   A file written by bitmap_save
+ * Return: Success   A new bitmap
+ *         Failed    NULL
+ * Description: Read the file into a new, writable bitmap, verifying both checksums
+ *****************************************************************************************************/
+struct bitmap *bitmap_load(const char *path);
+
+/*****************************************************************************************************
+ * Name: bitmap_open_view
+ * Input:  path   A file written by bitmap_save
+ * Return: Success   A read-only bitmap whose buf[] is the mapped file
+ *         Failed    NULL
+ * Description: mmap the file privately and lay struct bitmap over the reserved header bytes right
+ *              in front of the word data, so nothing is copied and the words are only faulted in
+ *              when read. Only the header and the file length are verified, the data checksum is
+ *              left to bitmap_load, so a damaged file gives wrong values but never reads outside
+ *              buf[]. numbers/first_value/last_value of the header are ignored and recounted from
+ *              the words by the first accessor, bits above max_value are cleared.
+ *              Every writing operation rejects the view, bitmap_destroy unmaps it
+ *****************************************************************************************************/
+struct bitmap *bitmap_open_view(const char *path);
+
+/*****************************************************************************************************
+ * Name: bitmap_close_view
+ * Input:  bm     A bitmap returned by bitmap_open_view
+ * Return: None
+ * Description: Unmap the view, called by bitmap_destroy
+ *****************************************************************************************************/
+void bitmap_close_view(struct bitmap *bm);
+
+#endif // BITMAP_IO_H_INCLUDED
@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "bitmap-pool.h"
+
+/* A cached block, the link overlays bm_self so a cached bitmap never passes bitmap_check */
+struct pool_block
+{
+    struct pool_block *next;
+};
+
+struct pool_class
+{
+    struct pool_block *head;
+    u32 count;
+};
+
+static u32 pool_class_of(u16 buf_len);
+
+static _Thread_local struct pool_class pool_classes[BITMAP_POOL_CLASSES];
+
+/* Smallest class whose 2^class words hold buf_len */
+static u32 pool_class_of(u16 buf_len)
+{
+    return buf_len <= 1 ? 0 : UINT_BITS - clz32((u32)buf_len - 1);
+}
+
+struct bitmap *bitmap_pool_alloc(u16 buf_len)
+{
+    struct pool_class *size_class = NULL;
+    struct bitmap *bm = NULL;
+    u32 index = pool_class_of(buf_len);
+
+    if (index >= BITMAP_POOL_CLASSES)
+    {
+        return NULL;
+    }
+
+    size_class = &pool_classes[index];
+
+    if (size_class->head == NULL)
+    {
+        return (struct bitmap *)calloc(1, sizeof(struct bitmap) + ((size_t)1 << index) * sizeof(u32));
+    }
+
+    bm = (struct bitmap *)size_class->head;
+    size_class->head = size_class->head->next;
+    size_class->count--;
+    memset(bm->buf, 0, (size_t)buf_len * sizeof(u32));
+
+    return bm;
+}
+
+void bitmap_pool_free(struct bitmap *bm)
+{
+    struct pool_class *size_class = &pool_classes[pool_class_of(bm->buf_len)];
+    struct pool_block *block = (struct pool_block *)bm;
+
+    if (size_class->count >= BITMAP_POOL_MAX_PER_CLASS)
+    {
+        free(bm);
+
+        return;
+    }
+
+    block->next = size_class->head;
+    size_class->head = block;
+    size_class->count++;
+
+    return;
+}
+
+void bitmap_pool_trim(void)
+{
+    struct pool_block *block = NULL;
+    u32 i = 0;
+
+    for (i = 0; i < BITMAP_POOL_CLASSES; i++)
+    {
+        while (pool_classes[i].head != NULL)
+        {
+            block = pool_classes[i].head;
+            pool_classes[i].head = block->next;
+            free(block);
+        }
+
+        pool_classes[i].count = 0;
+    }
+
+    return;
+}
@@ -0,0 +1,36 @@
+#ifndef BITMAP_POOL_H_INCLUDED
+#define BITMAP_POOL_H_INCLUDED
+
+#include "bitmap.h"
+
+#define BITMAP_POOL_CLASSES 12          /* Size classes of 1, 2, 4 ... 2048 buffer words */
+#define BITMAP_POOL_MAX_PER_CLASS 64    /* Freed bitmaps kept per class and thread, the rest go to free() */
+
+/*****************************************************************************************************
+ * Name: bitmap_pool_alloc
+ * Input:  buf_len   Number of buffer words the bitmap needs
+ * Return: Success   Storage for a struct bitmap with at least buf_len words, the first buf_len zeroed
+ *         Failed    NULL
+ * Description: Take a block of the buf_len size class from the calling thread's cache, or calloc a
+ *              new one when the cache is empty. Used by bitMap_create
+ *****************************************************************************************************/
+struct bitmap *bitmap_pool_alloc(u16 buf_len);
+
+/*****************************************************************************************************
+ * Name: bitmap_pool_free
+ * Input:  bm     A bitmap from bitmap_pool_alloc, already marked invalid
+ * Return: None
+ * Description: Keep the block in the calling thread's cache for its size class, or free it when
+ *              the class is full. Used by bitmap_destroy
+ *****************************************************************************************************/
+void bitmap_pool_free(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_pool_trim
+ * Input:  None
+ * Return: None
+ * Description: Release every block cached by the calling thread, e.g. before the thread exits
+ *****************************************************************************************************/
+void bitmap_pool_trim(void);
+
+#endif // BITMAP_POOL_H_INCLUDED
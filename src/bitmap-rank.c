@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "popcount.h"
+#include "bitmap-rank.h"
+
+static void rank_rebuild(struct bitmap *bm);
+static u32 select_in_word(u32 word, u32 k);
+
+static void rank_rebuild(struct bitmap *bm)
+{
+    struct bitmap_rank *rank = bm->rank;
+    u32 count = 0;
+    u32 words = 0;
+    u16 block = 0;
+
+    for (block = 0; block < rank->blocks; block++)
+    {
+        rank->counts[block] = (u16)count;
+        words = bm->buf_len - block * RANK_BLOCK_WORDS;
+        words = words < RANK_BLOCK_WORDS ? words : RANK_BLOCK_WORDS;
+        count += (u32)popcount_buf(bm->buf + block * RANK_BLOCK_WORDS, words * sizeof(u32));
+    }
+
+    rank->valid = true;
+
+    return;
+}
+
+/* Position of the '1' bit that has k '1' bits below it */
+static u32 select_in_word(u32 word, u32 k)
+{
+    u32 bytes = 0;
+    u32 prefix = 0;
+    u32 shift = 0;
+    u32 byte = 0;
+
+    /* Per-byte popcounts, then their running sums in every byte */
+    bytes = word - ((word >> 1) & 0x55555555U);
+    bytes = (bytes & 0x33333333U) + ((bytes >> 2) & 0x33333333U);
+    bytes = (bytes + (bytes >> 4)) & 0x0F0F0F0FU;
+    prefix = bytes * 0x01010101U;
+
+    while (((prefix >> shift) & 0xFF) <= k)
+    {
+        shift += CHAR_BIT;
+    }
+
+    if (shift != 0)
+    {
+        k -= (prefix >> (shift - CHAR_BIT)) & 0xFF;
+    }
+
+    for (byte = (word >> shift) & 0xFF; k != 0; k--)
+    {
+        byte &= byte - 1;
+    }
+
+    return shift + ctz32(byte);
+}
+
+bool bitmap_rank_enable(struct bitmap *bm)
+{
+    u16 blocks = 0;
+
+    if (!bitmap_is_valid(bm))
+    {
+        return false;
+    }
+
+    if (bm->rank != NULL)
+    {
+        return true;
+    }
+
+    blocks = (u16)((bm->buf_len + RANK_BLOCK_WORDS - 1) / RANK_BLOCK_WORDS);
+    bm->rank = (struct bitmap_rank *)malloc(sizeof(struct bitmap_rank) + blocks * sizeof(u16));
+
+    if (bm->rank == NULL)
+    {
+        return false;
+    }
+
+    bm->rank->valid = false;
+    bm->rank->blocks = blocks;
+
+    return true;
+}
+
+void bitmap_rank_disable(struct bitmap *bm)
+{
+    if (bitmap_is_valid(bm))
+    {
+        free(bm->rank);
+        bm->rank = NULL;
+    }
+
+    return;
+}
+
+u16 bitmap_rank(struct bitmap *bm, u16 value)
+{
+    u32 index = 0;
+    u32 block = 0;
+    u32 count = 0;
+
+    if (!bitmap_is_valid(bm) || value == 0)
+    {
+        return 0;
+    }
+
+    if (value > bm->max_value)
+    {
+        value = bm->max_value;
+    }
+
+    if (bm->rank == NULL)
+    {
+        return bitmap_cardinality_range(bm, 1, value);
+    }
+
+    if (!bm->rank->valid)
+    {
+        rank_rebuild(bm);
+    }
+
+    index = (u32)(value - 1) >> UINT_SHIFT;
+    block = index / RANK_BLOCK_WORDS;
+    count = bm->rank->counts[block];
+    count += (u32)popcount_buf(bm->buf + block * RANK_BLOCK_WORDS, (index - block * RANK_BLOCK_WORDS) * sizeof(u32));
+    count += popcount32(bm->buf[index] & (~0U >> (UINT_MASK - ((value - 1) & UINT_MASK))));
+
+    return (u16)count;
+}
+
+u16 bitmap_select(struct bitmap *bm, u16 k)
+{
+    u32 index = 0;
+    u32 lo = 0;
+    u32 hi = 0;
+    u32 mid = 0;
+    u32 rest = 0;
+    u32 count = 0;
+
+    if (!bitmap_is_valid(bm) || k == 0 || k > bitmap_cardinality(bm))
+    {
+        return 0;
+    }
+
+    rest = k - 1;
+    index = (u32)(bm->first_value - 1) >> UINT_SHIFT;
+
+    if (bm->rank != NULL)
+    {
+        if (!bm->rank->valid)
+        {
+            rank_rebuild(bm);
+        }
+
+        /* Last block whose preceding count does not exceed rest */
+        lo = 0;
+        hi = bm->rank->blocks - 1;
+
+        while (lo < hi)
+        {
+            mid = lo + (hi - lo + 1) / 2;
+
+            if (bm->rank->counts[mid] <= rest)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid - 1;
+            }
+        }
+
+        rest -= bm->rank->counts[lo];
+        index = lo * RANK_BLOCK_WORDS;
+    }
+
+    /* numbers can overstate the words, e.g. for a damaged file view, so never walk past buf[] */
+    for (; index < bm->buf_len; index++)
+    {
+        count = popcount32(bm->buf[index]);
+
+        if (count > rest)
+        {
+            break;
+        }
+
+        rest -= count;
+    }
+
+    if (index >= bm->buf_len)
+    {
+        return 0;
+    }
+
+    return (u16)((index << UINT_SHIFT) + select_in_word(bm->buf[index], rest) + 1);
+}
+
+void bitmap_rank_update(struct bitmap *bm, u16 value, bool added)
+{
+    struct bitmap_rank *rank = bm->rank;
+    u32 block = 0;
+
+    if (rank == NULL || !rank->valid)
+    {
+        return;
+    }
+
+    /* Only the blocks after the one holding value count it */
+    for (block = ((u32)(value - 1) >> UINT_SHIFT) / RANK_BLOCK_WORDS + 1; block < rank->blocks; block++)
+    {
+        rank->counts[block] = added ? rank->counts[block] + 1 : rank->counts[block] - 1;
+    }
+
+    return;
+}
+
+void bitmap_rank_invalidate(struct bitmap *bm)
+{
+    if (bm->rank != NULL)
+    {
+        bm->rank->valid = false;
+    }
+
+    return;
+}
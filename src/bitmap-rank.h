@@ -0,0 +1,74 @@
+#ifndef BITMAP_RANK_H_INCLUDED
+#define BITMAP_RANK_H_INCLUDED
+
+#include "bitmap.h"
+
+#define RANK_BLOCK_WORDS 16 /* One cumulative count is sampled every 512 bits */
+
+/* Auxiliary rank/select index attached to a bitmap by bitmap_rank_enable */
+struct bitmap_rank
+{
+    bool valid;     /* false after a bulk operation, the counts are rebuilt on the next query */
+    u16 blocks;     /* Number of RANK_BLOCK_WORDS blocks covering buf[] */
+    u16 counts[0];  /* counts[i] is the number of '1' bits in the blocks before block i */
+};
+
+/*****************************************************************************************************
+ * Name: bitmap_rank_enable
+ * Input:  bm     The bitmap that gets a rank/select index
+ * Return: Success   true
+ *         Failed    false
+ * Description: Attach a rank/select index to bm. add/del keep it up to date, bulk operations
+ *              invalidate it and it is rebuilt lazily by the next query
+ *****************************************************************************************************/
+bool bitmap_rank_enable(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_rank_disable
+ * Input:  bm     The bitmap whose index is released
+ * Return: None
+ * Description: Free the rank/select index of bm, if any
+ *****************************************************************************************************/
+void bitmap_rank_disable(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_rank
+ * Input:  bm     Pointer to the bitmap structure
+ *         value  The value to rank, clamped to max_value
+ * Return: Number of set values <= value, 0 for an invalid bitmap
+ * Description: Answer in constant time from the sampled counts plus at most one block of popcounts.
+ *              Works without an index too, by counting the range directly
+ *****************************************************************************************************/
+u16 bitmap_rank(struct bitmap *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_select
+ * Input:  bm     Pointer to the bitmap structure
+ *         k      Position of the wanted value, starting from 1
+ * Return: Success   The k-th smallest set value
+ *         Failed    0 when k is 0 or larger than the number of set values
+ * Description: Binary search the sampled counts, then select inside the word with broadword
+ *              byte counts. Without an index the words are scanned from first_value
+ *****************************************************************************************************/
+u16 bitmap_select(struct bitmap *bm, u16 k);
+
+/*****************************************************************************************************
+ * Name: bitmap_rank_update
+ * Input:  bm     The bitmap whose index is kept in sync
+ *         value  The value that was just set or cleared
+ *         added  true when the value was set, false when it was cleared
+ * Return: None
+ * Description: Adjust the sampled counts after a single bit change, called by bitmap_add_value
+ *              and bitmap_del_value
+ *****************************************************************************************************/
+void bitmap_rank_update(struct bitmap *bm, u16 value, bool added);
+
+/*****************************************************************************************************
+ * Name: bitmap_rank_invalidate
+ * Input:  bm     The bitmap that was changed in bulk
+ * Return: None
+ * Description: Mark the index stale, called by every operation that rewrites whole words
+ *****************************************************************************************************/
+void bitmap_rank_invalidate(struct bitmap *bm);
+
+#endif // BITMAP_RANK_H_INCLUDED
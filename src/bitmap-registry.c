@@ -0,0 +1,628 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "bitmap-registry.h"
+
+#define REGISTRY_CLASSES 12          /* Size classes of 1, 2, 4 ... 2048 buffer words */
+#define REGISTRY_ALIGN 16            /* Alignment of every bitmap carved out of a slab */
+#define REGISTRY_MIN_TABLE 64        /* Slots of a new table, always a power of two */
+#define REGISTRY_MIN_ENTRIES 64
+
+/* One table slot, the hash is kept here so most mismatches never touch the entry */
+struct registry_slot
+{
+    u32 hash;
+    u32 entry;                       /* Entry index + 1, 0 for an empty slot */
+};
+
+struct registry_entry
+{
+    struct bitmap *bm;               /* NULL while the entry is free */
+    u32 generation;                  /* Bumped on drop, handles carrying an older one are stale */
+    u32 next_free;                   /* Next free entry index + 1, while the entry is free */
+    u32 hash;
+    u8 key_len;
+    u8 key[BITMAP_REGISTRY_KEY_LEN]; /* '\0' terminated name, or '\0' and the 8 ID bytes */
+};
+
+/* A freed block, the link overlays bm_self so it never passes bitmap_check */
+struct registry_block
+{
+    struct registry_block *next;
+};
+
+/* Header of a slab, the blocks follow at REGISTRY_ALIGN */
+struct registry_slab
+{
+    struct registry_slab *next;
+};
+
+struct registry_class
+{
+    struct registry_block *free;
+    u8 *cursor;                      /* Next unused byte of the newest slab */
+    u8 *end;
+};
+
+struct bitmap_registry
+{
+    struct registry_slot *table;
+    u32 table_mask;
+    struct registry_entry *entries;
+    u32 entries_len;                 /* Entries handed out so far, live or free */
+    u32 entries_cap;
+    u32 free_head;                   /* First free entry index + 1 */
+    u32 count;
+    struct registry_class classes[REGISTRY_CLASSES];
+    struct registry_slab *slabs;
+};
+
+static u32 key_hash(const u8 *key, u32 len);
+static u32 name_key(const char *name, u8 *key);
+static u32 id_key(u64 id, u8 *key);
+static bitmap_handle make_handle(struct bitmap_registry *reg, u32 index);
+static struct registry_entry *resolve(struct bitmap_registry *reg, bitmap_handle h);
+static u32 table_find(struct bitmap_registry *reg, const u8 *key, u32 len, u32 hash);
+static void table_put(struct registry_slot *table, u32 mask, u32 hash, u32 entry);
+static bool table_grow(struct bitmap_registry *reg);
+static void table_remove(struct bitmap_registry *reg, u32 pos);
+static u32 class_of(u16 buf_len);
+static size_t block_size(u32 index);
+static void *block_alloc(struct bitmap_registry *reg, u16 buf_len);
+static void block_free(struct bitmap_registry *reg, struct bitmap *bm);
+static bool entry_alloc(struct bitmap_registry *reg, u32 *index);
+static bitmap_handle registry_add(struct bitmap_registry *reg, const u8 *key, u32 len, u16 capacity);
+static bitmap_handle registry_find(struct bitmap_registry *reg, const u8 *key, u32 len);
+
+/* FNV-1a, keys are short */
+static u32 key_hash(const u8 *key, u32 len)
+{
+    u32 hash = 2166136261u;
+    u32 i = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        hash = (hash ^ key[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/* 0 for a name that is empty or too long */
+static u32 name_key(const char *name, u8 *key)
+{
+    size_t len = name == NULL ? 0 : strlen(name);
+
+    if (len == 0 || len >= BITMAP_REGISTRY_KEY_LEN)
+    {
+        return 0;
+    }
+
+    memset(key, 0, BITMAP_REGISTRY_KEY_LEN);
+    memcpy(key, name, len);
+
+    return (u32)len;
+}
+
+/* The leading '\0' keeps IDs apart from names */
+static u32 id_key(u64 id, u8 *key)
+{
+    u32 i = 0;
+
+    memset(key, 0, BITMAP_REGISTRY_KEY_LEN);
+
+    for (i = 0; i < sizeof(u64); i++)
+    {
+        key[1 + i] = (u8)(id >> (i * CHAR_BIT));
+    }
+
+    return 1 + sizeof(u64);
+}
+
+static bitmap_handle make_handle(struct bitmap_registry *reg, u32 index)
+{
+    return ((u64)reg->entries[index].generation << 32) | (index + 1);
+}
+
+/* The entry of a live handle, the generation compare rejects dropped ones */
+static struct registry_entry *resolve(struct bitmap_registry *reg, bitmap_handle h)
+{
+    struct registry_entry *e = NULL;
+    u32 index = (u32)h;
+
+    if (reg == NULL || index == 0 || index > reg->entries_len)
+    {
+        return NULL;
+    }
+
+    e = &reg->entries[index - 1];
+
+    return e->generation == (u32)(h >> 32) && e->bm != NULL ? e : NULL;
+}
+
+/* Table position of key, UINT32_MAX when it is not filed */
+static u32 table_find(struct bitmap_registry *reg, const u8 *key, u32 len, u32 hash)
+{
+    struct registry_entry *e = NULL;
+    u32 pos = hash & reg->table_mask;
+
+    while (reg->table[pos].entry != 0)
+    {
+        if (reg->table[pos].hash == hash)
+        {
+            e = &reg->entries[reg->table[pos].entry - 1];
+
+            if (e->key_len == len && memcmp(e->key, key, len) == 0)
+            {
+                return pos;
+            }
+        }
+
+        pos = (pos + 1) & reg->table_mask;
+    }
+
+    return UINT32_MAX;
+}
+
+static void table_put(struct registry_slot *table, u32 mask, u32 hash, u32 entry)
+{
+    u32 pos = hash & mask;
+
+    while (table[pos].entry != 0)
+    {
+        pos = (pos + 1) & mask;
+    }
+
+    table[pos].hash = hash;
+    table[pos].entry = entry;
+
+    return;
+}
+
+/* Double the table, it is kept at most half full so probe sequences stay short */
+static bool table_grow(struct bitmap_registry *reg)
+{
+    struct registry_slot *table = NULL;
+    u32 mask = reg->table_mask * 2 + 1;
+    u32 i = 0;
+
+    table = (struct registry_slot *)calloc((size_t)mask + 1, sizeof(struct registry_slot));
+
+    if (table == NULL)
+    {
+        return false;
+    }
+
+    for (i = 0; i <= reg->table_mask; i++)
+    {
+        if (reg->table[i].entry != 0)
+        {
+            table_put(table, mask, reg->table[i].hash, reg->table[i].entry);
+        }
+    }
+
+    free(reg->table);
+    reg->table = table;
+    reg->table_mask = mask;
+
+    return true;
+}
+
+/* Backward shift deletion, slots that probed past pos move up so no tombstones are needed */
+static void table_remove(struct bitmap_registry *reg, u32 pos)
+{
+    u32 mask = reg->table_mask;
+    u32 next = pos;
+    u32 home = 0;
+
+    while (true)
+    {
+        reg->table[pos].entry = 0;
+
+        do
+        {
+            next = (next + 1) & mask;
+
+            if (reg->table[next].entry == 0)
+            {
+                return;
+            }
+
+            home = reg->table[next].hash & mask;
+        }
+        while (pos <= next ? (pos < home && home <= next) : (pos < home || home <= next));
+
+        reg->table[pos] = reg->table[next];
+        pos = next;
+    }
+}
+
+/* Smallest class whose 2^class words hold buf_len */
+static u32 class_of(u16 buf_len)
+{
+    return buf_len <= 1 ? 0 : UINT_BITS - clz32((u32)buf_len - 1);
+}
+
+static size_t block_size(u32 index)
+{
+    return (sizeof(struct bitmap) + ((size_t)1 << index) * sizeof(u32) + REGISTRY_ALIGN - 1) & ~(size_t)(REGISTRY_ALIGN - 1);
+}
+
+static void *block_alloc(struct bitmap_registry *reg, u16 buf_len)
+{
+    struct registry_class *size_class = NULL;
+    struct registry_slab *slab = NULL;
+    void *block = NULL;
+    u32 index = class_of(buf_len);
+    size_t size = block_size(index);
+    size_t header = (sizeof(struct registry_slab) + REGISTRY_ALIGN - 1) & ~(size_t)(REGISTRY_ALIGN - 1);
+    size_t bytes = 0;
+
+    if (index >= REGISTRY_CLASSES)
+    {
+        return NULL;
+    }
+
+    size_class = &reg->classes[index];
+
+    if (size_class->free != NULL)
+    {
+        block = size_class->free;
+        size_class->free = size_class->free->next;
+
+        return block;
+    }
+
+    if (size_class->cursor == NULL || (size_t)(size_class->end - size_class->cursor) < size)
+    {
+        bytes = header + size > BITMAP_REGISTRY_SLAB_SIZE ? header + size : BITMAP_REGISTRY_SLAB_SIZE;
+        slab = (struct registry_slab *)aligned_alloc(REGISTRY_ALIGN, bytes);
+
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+
+        slab->next = reg->slabs;
+        reg->slabs = slab;
+        size_class->cursor = (u8 *)slab + header;
+        size_class->end = (u8 *)slab + bytes;
+    }
+
+    block = size_class->cursor;
+    size_class->cursor += size;
+
+    return block;
+}
+
+static void block_free(struct bitmap_registry *reg, struct bitmap *bm)
+{
+    struct registry_class *size_class = &reg->classes[class_of(bm->buf_len)];
+    struct registry_block *block = (struct registry_block *)bm;
+
+    block->next = size_class->free;
+    size_class->free = block;
+
+    return;
+}
+
+static bool entry_alloc(struct bitmap_registry *reg, u32 *index)
+{
+    struct registry_entry *grown = NULL;
+    u32 cap = 0;
+
+    if (reg->free_head != 0)
+    {
+        *index = reg->free_head - 1;
+        reg->free_head = reg->entries[*index].next_free;
+
+        return true;
+    }
+
+    if (reg->entries_len == reg->entries_cap)
+    {
+        cap = reg->entries_cap == 0 ? REGISTRY_MIN_ENTRIES : reg->entries_cap * 2;
+
+        if (cap <= reg->entries_cap || cap == UINT32_MAX)
+        {
+            return false;
+        }
+
+        grown = (struct registry_entry *)realloc(reg->entries, (size_t)cap * sizeof(struct registry_entry));
+
+        if (grown == NULL)
+        {
+            return false;
+        }
+
+        reg->entries = grown;
+        reg->entries_cap = cap;
+    }
+
+    *index = reg->entries_len++;
+    reg->entries[*index].generation = 1;
+
+    return true;
+}
+
+static bitmap_handle registry_add(struct bitmap_registry *reg, const u8 *key, u32 len, u16 capacity)
+{
+    struct registry_entry *e = NULL;
+    void *block = NULL;
+    u32 hash = key_hash(key, len);
+    u32 index = 0;
+
+    if (len == 0 || capacity == 0 || table_find(reg, key, len, hash) != UINT32_MAX)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    if ((u64)(reg->count + 1) * 2 > (u64)reg->table_mask + 1 && !table_grow(reg))
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    block = block_alloc(reg, (capacity + UINT_BITS - 1) / UINT_BITS);
+
+    if (block == NULL)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    if (!entry_alloc(reg, &index))
+    {
+        /* Only buf_len is read back, set it so the block goes to the right class */
+        ((struct bitmap *)block)->buf_len = (capacity + UINT_BITS - 1) / UINT_BITS;
+        block_free(reg, (struct bitmap *)block);
+
+        return BITMAP_HANDLE_NONE;
+    }
+
+    e = &reg->entries[index];
+    e->bm = bitmap_init(block, bitmap_size_for(capacity), capacity);
+    e->next_free = 0;
+    e->hash = hash;
+    e->key_len = (u8)len;
+    memcpy(e->key, key, BITMAP_REGISTRY_KEY_LEN);
+    table_put(reg->table, reg->table_mask, hash, index + 1);
+    reg->count++;
+
+    return make_handle(reg, index);
+}
+
+static bitmap_handle registry_find(struct bitmap_registry *reg, const u8 *key, u32 len)
+{
+    u32 pos = 0;
+
+    if (len == 0)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    pos = table_find(reg, key, len, key_hash(key, len));
+
+    return pos == UINT32_MAX ? BITMAP_HANDLE_NONE : make_handle(reg, reg->table[pos].entry - 1);
+}
+
+struct bitmap_registry *bitmap_registry_create(void)
+{
+    struct bitmap_registry *reg = (struct bitmap_registry *)calloc(1, sizeof(struct bitmap_registry));
+
+    if (reg == NULL)
+    {
+        return NULL;
+    }
+
+    reg->table = (struct registry_slot *)calloc(REGISTRY_MIN_TABLE, sizeof(struct registry_slot));
+
+    if (reg->table == NULL)
+    {
+        free(reg);
+
+        return NULL;
+    }
+
+    reg->table_mask = REGISTRY_MIN_TABLE - 1;
+
+    return reg;
+}
+
+void bitmap_registry_destroy(struct bitmap_registry *reg)
+{
+    struct registry_slab *slab = NULL;
+    u32 i = 0;
+
+    if (reg == NULL)
+    {
+        return;
+    }
+
+    /* Only rank indexes live outside the slabs */
+    for (i = 0; i < reg->entries_len; i++)
+    {
+        if (reg->entries[i].bm != NULL)
+        {
+            bitmap_destroy(reg->entries[i].bm);
+        }
+    }
+
+    while (reg->slabs != NULL)
+    {
+        slab = reg->slabs;
+        reg->slabs = slab->next;
+        free(slab);
+    }
+
+    free(reg->entries);
+    free(reg->table);
+    free(reg);
+
+    return;
+}
+
+bitmap_handle bitmap_registry_add(struct bitmap_registry *reg, const char *name, u16 capacity)
+{
+    u8 key[BITMAP_REGISTRY_KEY_LEN];
+
+    if (reg == NULL)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    return registry_add(reg, key, name_key(name, key), capacity);
+}
+
+bitmap_handle bitmap_registry_add_id(struct bitmap_registry *reg, u64 id, u16 capacity)
+{
+    u8 key[BITMAP_REGISTRY_KEY_LEN];
+
+    if (reg == NULL)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    return registry_add(reg, key, id_key(id, key), capacity);
+}
+
+bitmap_handle bitmap_registry_find(struct bitmap_registry *reg, const char *name)
+{
+    u8 key[BITMAP_REGISTRY_KEY_LEN];
+
+    if (reg == NULL)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    return registry_find(reg, key, name_key(name, key));
+}
+
+bitmap_handle bitmap_registry_find_id(struct bitmap_registry *reg, u64 id)
+{
+    u8 key[BITMAP_REGISTRY_KEY_LEN];
+
+    if (reg == NULL)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    return registry_find(reg, key, id_key(id, key));
+}
+
+struct bitmap *bitmap_registry_get(struct bitmap_registry *reg, bitmap_handle h)
+{
+    struct registry_entry *e = resolve(reg, h);
+
+    return e == NULL ? NULL : e->bm;
+}
+
+bool bitmap_registry_drop(struct bitmap_registry *reg, bitmap_handle h)
+{
+    struct registry_entry *e = resolve(reg, h);
+    u32 pos = 0;
+
+    if (e == NULL)
+    {
+        return false;
+    }
+
+    pos = table_find(reg, e->key, e->key_len, e->hash);
+    table_remove(reg, pos);
+
+    /* bitmap_init marked the storage external, so this only invalidates it and frees a rank index */
+    bitmap_destroy(e->bm);
+    block_free(reg, e->bm);
+    e->bm = NULL;
+
+    /* Generation 0 is skipped, a wrapped handle must not match a fresh entry */
+    e->generation = e->generation + 1 == 0 ? 1 : e->generation + 1;
+    e->next_free = reg->free_head;
+    reg->free_head = (u32)h;
+    reg->count--;
+
+    return true;
+}
+
+bitmap_handle bitmap_registry_replace(struct bitmap_registry *reg, bitmap_handle h, u16 capacity)
+{
+    struct registry_entry *e = resolve(reg, h);
+    void *block = NULL;
+
+    if (e == NULL || capacity == 0)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    block = block_alloc(reg, (capacity + UINT_BITS - 1) / UINT_BITS);
+
+    if (block == NULL)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    /* The key and the table slot stay, only the bitmap and the generation change */
+    bitmap_destroy(e->bm);
+    block_free(reg, e->bm);
+    e->bm = bitmap_init(block, bitmap_size_for(capacity), capacity);
+    e->generation = e->generation + 1 == 0 ? 1 : e->generation + 1;
+
+    return make_handle(reg, (u32)h - 1);
+}
+
+u32 bitmap_registry_count(struct bitmap_registry *reg)
+{
+    return reg == NULL ? 0 : reg->count;
+}
+
+bitmap_handle bitmap_registry_next(struct bitmap_registry *reg, bitmap_handle h)
+{
+    u32 i = 0;
+
+    if (reg == NULL)
+    {
+        return BITMAP_HANDLE_NONE;
+    }
+
+    /* The low half of a handle is its index + 1, where the scan goes on */
+    for (i = (u32)h; i < reg->entries_len; i++)
+    {
+        if (reg->entries[i].bm != NULL)
+        {
+            return make_handle(reg, i);
+        }
+    }
+
+    return BITMAP_HANDLE_NONE;
+}
+
+const char *bitmap_registry_name(struct bitmap_registry *reg, bitmap_handle h)
+{
+    struct registry_entry *e = resolve(reg, h);
+
+    if (e == NULL || e->key[0] == '\0')
+    {
+        return NULL;
+    }
+
+    return (const char *)e->key;
+}
+
+bool bitmap_registry_id(struct bitmap_registry *reg, bitmap_handle h, u64 *id)
+{
+    struct registry_entry *e = resolve(reg, h);
+    u32 i = 0;
+
+    if (e == NULL || e->key[0] != '\0' || id == NULL)
+    {
+        return false;
+    }
+
+    *id = 0;
+
+    for (i = 0; i < sizeof(u64); i++)
+    {
+        *id |= (u64)e->key[1 + i] << (i * CHAR_BIT);
+    }
+
+    return true;
+}
@@ -0,0 +1,154 @@
+#ifndef BITMAP_REGISTRY_H_INCLUDED
+#define BITMAP_REGISTRY_H_INCLUDED
+
+#include "bitmap.h"
+
+#define BITMAP_REGISTRY_KEY_LEN 32         /* Names are at most 31 characters */
+#define BITMAP_REGISTRY_SLAB_SIZE 65536    /* Bytes carved into bitmaps of one size class at a time */
+#define BITMAP_HANDLE_NONE 0               /* Never a valid handle */
+
+/*
+ * Named bitmaps for programs that keep many of them alive. Each bitmap is reached through a handle
+ * holding its entry index and the generation of that entry; dropping a bitmap bumps the generation,
+ * so a handle that outlives its bitmap is refused by a single compare instead of reading freed
+ * memory. Keys are either a name or a 64-bit ID, the two never collide.
+ *
+ * Lookups go through an open addressing table that keeps each key's hash next to its entry index,
+ * entries live in one array and the bitmaps are carved out of large slabs per size class, so
+ * neither lookup nor iteration follows a list. A registry must not be used by two threads at once.
+ */
+typedef u64 bitmap_handle;
+
+struct bitmap_registry;
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_create
+ * Input:  None
+ * Return: Success   An empty registry
+ *         Failed    NULL
+ * Description: Create a registry, release it with bitmap_registry_destroy
+ *****************************************************************************************************/
+struct bitmap_registry *bitmap_registry_create(void);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_destroy
+ * Input:  reg    The registry
+ * Return: None
+ * Description: Destroy every bitmap of the registry and release its memory. All handles and
+ *              bitmap pointers obtained from it become invalid
+ *****************************************************************************************************/
+void bitmap_registry_destroy(struct bitmap_registry *reg);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_add
+ * Input:  reg       The registry
+ *         name      Key of the new bitmap, 1 to 31 characters
+ *         capacity  The capacity of the new bitmap
+ * Return: Success   Handle of a new empty bitmap
+ *         Failed    BITMAP_HANDLE_NONE, also when the name is already taken
+ * Description: Create a bitmap in the registry's slabs and file it under name
+ *****************************************************************************************************/
+bitmap_handle bitmap_registry_add(struct bitmap_registry *reg, const char *name, u16 capacity);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_add_id
+ * Input:  reg       The registry
+ *         id        Key of the new bitmap
+ *         capacity  The capacity of the new bitmap
+ * Return: Success   Handle of a new empty bitmap
+ *         Failed    BITMAP_HANDLE_NONE, also when the ID is already taken
+ * Description: bitmap_registry_add keyed by a number
+ *****************************************************************************************************/
+bitmap_handle bitmap_registry_add_id(struct bitmap_registry *reg, u64 id, u16 capacity);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_find
+ * Input:  reg    The registry
+ *         name   The key to look up
+ * Return: Handle of the bitmap filed under name, BITMAP_HANDLE_NONE when there is none
+ * Description: Expected O(1), one table probe sequence and one key compare
+ *****************************************************************************************************/
+bitmap_handle bitmap_registry_find(struct bitmap_registry *reg, const char *name);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_find_id
+ * Input:  reg    The registry
+ *         id     The key to look up
+ * Return: Handle of the bitmap filed under id, BITMAP_HANDLE_NONE when there is none
+ * Description: bitmap_registry_find keyed by a number
+ *****************************************************************************************************/
+bitmap_handle bitmap_registry_find_id(struct bitmap_registry *reg, u64 id);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_get
+ * Input:  reg    The registry
+ *         h      A handle from this registry
+ * Return: Success   The bitmap of h
+ *         Failed    NULL when h was dropped or never belonged to reg
+ * Description: Resolve a handle. The pointer stays valid until the bitmap is dropped, slabs never
+ *              move
+ *****************************************************************************************************/
+struct bitmap *bitmap_registry_get(struct bitmap_registry *reg, bitmap_handle h);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_drop
+ * Input:  reg    The registry
+ *         h      The handle of the bitmap to remove
+ * Return: Success   true
+ *         Failed    false for a stale or foreign handle
+ * Description: Destroy the bitmap, free its key and make every copy of h stale. The storage is
+ *              reused by the next bitmap of the same size class
+ *****************************************************************************************************/
+bool bitmap_registry_drop(struct bitmap_registry *reg, bitmap_handle h);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_replace
+ * Input:  reg       The registry
+ *         h         The handle of the bitmap to replace
+ *         capacity  The capacity of the new bitmap
+ * Return: Success   Handle of a new empty bitmap filed under the key of h
+ *         Failed    BITMAP_HANDLE_NONE, the bitmap of h is then left as it was
+ * Description: bitmap_registry_drop and bitmap_registry_add under the same key, except that the new
+ *              bitmap is allocated before the old one is destroyed. Every copy of h becomes stale
+ *****************************************************************************************************/
+bitmap_handle bitmap_registry_replace(struct bitmap_registry *reg, bitmap_handle h, u16 capacity);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_count
+ * Input:  reg    The registry
+ * Return: Number of live bitmaps
+ * Description: None
+ *****************************************************************************************************/
+u32 bitmap_registry_count(struct bitmap_registry *reg);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_next
+ * Input:  reg    The registry
+ *         h      BITMAP_HANDLE_NONE to start, then the handle returned by the previous call
+ * Return: Handle of the next live bitmap, BITMAP_HANDLE_NONE after the last one
+ * Description: Visit every bitmap in entry order, a linear scan of the entry array. Dropping the
+ *              bitmap of h during the loop is allowed, adding may or may not be visited
+ *****************************************************************************************************/
+bitmap_handle bitmap_registry_next(struct bitmap_registry *reg, bitmap_handle h);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_name
+ * Input:  reg    The registry
+ *         h      A handle from this registry
+ * Return: The name of h, NULL for a stale handle or a bitmap keyed by ID
+ * Description: The string is only valid until the next bitmap_registry_add or _add_id
+ *****************************************************************************************************/
+const char *bitmap_registry_name(struct bitmap_registry *reg, bitmap_handle h);
+
+/*****************************************************************************************************
+ * Name: bitmap_registry_id
+ * Input:  reg    The registry
+ *         h      A handle from this registry
+ *         id     Receives the ID of h
+ * Return: Success   true
+ *         Failed    false for a stale handle or a bitmap keyed by name
+ * Description: None
+ *****************************************************************************************************/
+bool bitmap_registry_id(struct bitmap_registry *reg, bitmap_handle h, u64 *id);
+
+#endif // BITMAP_REGISTRY_H_INCLUDED
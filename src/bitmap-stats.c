@@ -0,0 +1,314 @@
+#include "bitmap.h"
+#include "bitmap-stats.h"
+
+#ifdef BITMAP_STATS
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "bit-ops.h"
+
+/* Written only by the owning thread, the atomics just keep the dump's reads well defined */
+struct stats_counters
+{
+    _Atomic u64 calls;
+    _Atomic u64 bits_changed;
+    _Atomic u64 words_scanned;
+    _Atomic u64 timed;
+    _Atomic u64 ns_total;
+    _Atomic u64 hist[BITMAP_STAT_BUCKETS];
+};
+
+struct stats_block
+{
+    struct stats_block *next;
+    struct stats_counters ops[BITMAP_STAT_OPS];
+};
+
+static const char *const stat_names[] =
+{
+    "bitMap_create", "bitmap_init", "bitmap_destroy", "bitmap_set_lazy", "bitmap_cardinality",
+    "bitmap_first", "bitmap_last", "bitmap_refresh", "bitmap_add_value", "bitmap_del_value",
+    "bitmap_add_range", "bitmap_del_range", "bitmap_add_many", "bitmap_del_many", "is_value_set",
+    "bitmap_next_value", "bitmap_prev_value", "update_first_value", "update_last_value",
+    "count_set_bits", "bitmap_cardinality_range", "bitmap_iter_init", "bitmap_iter_next",
+    "bitmap_to_array", "bitmap_format", "bitmap_print", "bitmap_clone", "bitmap_clone_into",
+    "bitmap_not", "bitmap_or", "bitmap_and", "bitmap_and_new", "bitmap_or_new", "bitmap_xor_new",
+    "bitmap_andnot_new", "bitmap_and_cardinality", "bitmap_or_cardinality", "bitmap_intersects",
+    "bitmap_or_many", "bitmap_and_many", "bitmap_parse_str"
+};
+
+_Static_assert(sizeof(stat_names) / sizeof(stat_names[0]) == BITMAP_STAT_OPS, "one name per BITMAP_STAT_* op");
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stats_block *stats_blocks = NULL;
+static _Thread_local struct stats_block *thread_block = NULL;
+
+static struct stats_block *stats_thread_block(void);
+static void stat_add(_Atomic u64 *counter, u64 value);
+static u32 stat_bucket(u64 ns);
+
+/* The calling thread's block, registered on its first call */
+static struct stats_block *stats_thread_block(void)
+{
+    if (thread_block != NULL)
+    {
+        return thread_block;
+    }
+
+    thread_block = (struct stats_block *)calloc(1, sizeof(struct stats_block));
+
+    if (thread_block == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    thread_block->next = stats_blocks;
+    stats_blocks = thread_block;
+    pthread_mutex_unlock(&stats_lock);
+
+    return thread_block;
+}
+
+/* Single writer, so a plain load and store is enough and no locked instruction is needed */
+static void stat_add(_Atomic u64 *counter, u64 value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+
+    return;
+}
+
+static u32 stat_bucket(u64 ns)
+{
+    u32 bucket = ns == 0 ? 0 : 64 - clz64(ns);
+
+    return bucket < BITMAP_STAT_BUCKETS ? bucket : BITMAP_STAT_BUCKETS - 1;
+}
+
+u64 bitmap_stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec + 1;
+}
+
+void bitmap_stats_record(u32 op, u64 bits, u64 words, u64 start)
+{
+    struct stats_block *block = stats_thread_block();
+    struct stats_counters *c = NULL;
+    u64 ns = 0;
+
+    if (block == NULL || op >= BITMAP_STAT_OPS)
+    {
+        return;
+    }
+
+    c = &block->ops[op];
+    stat_add(&c->calls, 1);
+    stat_add(&c->bits_changed, bits);
+    stat_add(&c->words_scanned, words);
+
+    if (start != 0)
+    {
+        ns = bitmap_stats_now() - start;
+        stat_add(&c->timed, 1);
+        stat_add(&c->ns_total, ns);
+        stat_add(&c->hist[stat_bucket(ns)], 1);
+    }
+
+    return;
+}
+
+bool bitmap_stats_get(u32 op, struct bitmap_stat *out)
+{
+    struct stats_block *block = NULL;
+    struct stats_counters *c = NULL;
+    u32 b = 0;
+
+    if (op >= BITMAP_STAT_OPS || out == NULL)
+    {
+        return false;
+    }
+
+    memset(out, 0, sizeof(struct bitmap_stat));
+    pthread_mutex_lock(&stats_lock);
+
+    for (block = stats_blocks; block != NULL; block = block->next)
+    {
+        c = &block->ops[op];
+        out->calls += atomic_load_explicit(&c->calls, memory_order_relaxed);
+        out->bits_changed += atomic_load_explicit(&c->bits_changed, memory_order_relaxed);
+        out->words_scanned += atomic_load_explicit(&c->words_scanned, memory_order_relaxed);
+        out->timed += atomic_load_explicit(&c->timed, memory_order_relaxed);
+        out->ns_total += atomic_load_explicit(&c->ns_total, memory_order_relaxed);
+
+        for (b = 0; b < BITMAP_STAT_BUCKETS; b++)
+        {
+            out->hist[b] += atomic_load_explicit(&c->hist[b], memory_order_relaxed);
+        }
+    }
+
+    pthread_mutex_unlock(&stats_lock);
+
+    return true;
+}
+
+bool bitmap_stats_dump(FILE *fp, bool json)
+{
+    struct bitmap_stat st;
+    const char *sep = "";
+    u32 op = 0;
+    u32 b = 0;
+
+    if (fp == NULL)
+    {
+        return false;
+    }
+
+    if (json)
+    {
+        fprintf(fp, "{\"operations\":[");
+    }
+    else
+    {
+        fprintf(fp, "%-26s %12s %14s %14s %12s\n", "operation", "calls", "bits_changed", "words_scanned", "mean_ns");
+    }
+
+    for (op = 0; op < BITMAP_STAT_OPS; op++)
+    {
+        if (!bitmap_stats_get(op, &st) || st.calls == 0)
+        {
+            continue;
+        }
+
+        if (json)
+        {
+            fprintf(fp, "%s\n{\"name\":\"%s\",\"calls\":%llu,\"bits_changed\":%llu,\"words_scanned\":%llu,"
+                    "\"timed\":%llu,\"ns_total\":%llu,\"hist\":{", sep, stat_names[op],
+                    (unsigned long long)st.calls, (unsigned long long)st.bits_changed,
+                    (unsigned long long)st.words_scanned, (unsigned long long)st.timed,
+                    (unsigned long long)st.ns_total);
+            sep = "";
+
+            /* Keyed by the bucket's exclusive upper bound in ns */
+            for (b = 0; b < BITMAP_STAT_BUCKETS; b++)
+            {
+                if (st.hist[b] != 0)
+                {
+                    fprintf(fp, "%s\"%llu\":%llu", sep, 1ULL << b, (unsigned long long)st.hist[b]);
+                    sep = ",";
+                }
+            }
+
+            fprintf(fp, "}}");
+            sep = ",";
+        }
+        else
+        {
+            fprintf(fp, "%-26s %12llu %14llu %14llu", stat_names[op], (unsigned long long)st.calls,
+                    (unsigned long long)st.bits_changed, (unsigned long long)st.words_scanned);
+
+            if (st.timed == 0)
+            {
+                fprintf(fp, " %12s\n", "-");
+                continue;
+            }
+
+            fprintf(fp, " %12.1f\n   ", (double)st.ns_total / (double)st.timed);
+
+            for (b = 0; b < BITMAP_STAT_BUCKETS; b++)
+            {
+                if (st.hist[b] != 0)
+                {
+                    fprintf(fp, " <%lluns:%llu", 1ULL << b, (unsigned long long)st.hist[b]);
+                }
+            }
+
+            fputc('\n', fp);
+        }
+    }
+
+    if (json)
+    {
+        fprintf(fp, "\n]}\n");
+    }
+
+    return !ferror(fp);
+}
+
+void bitmap_stats_reset(void)
+{
+    struct stats_block *block = NULL;
+    struct stats_counters *c = NULL;
+    u32 op = 0;
+    u32 b = 0;
+
+    pthread_mutex_lock(&stats_lock);
+
+    for (block = stats_blocks; block != NULL; block = block->next)
+    {
+        for (op = 0; op < BITMAP_STAT_OPS; op++)
+        {
+            c = &block->ops[op];
+            atomic_store_explicit(&c->calls, 0, memory_order_relaxed);
+            atomic_store_explicit(&c->bits_changed, 0, memory_order_relaxed);
+            atomic_store_explicit(&c->words_scanned, 0, memory_order_relaxed);
+            atomic_store_explicit(&c->timed, 0, memory_order_relaxed);
+            atomic_store_explicit(&c->ns_total, 0, memory_order_relaxed);
+
+            for (b = 0; b < BITMAP_STAT_BUCKETS; b++)
+            {
+                atomic_store_explicit(&c->hist[b], 0, memory_order_relaxed);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&stats_lock);
+
+    return;
+}
+
+#else
+
+u64 bitmap_stats_now(void)
+{
+    return 0;
+}
+
+void bitmap_stats_record(u32 op, u64 bits, u64 words, u64 start)
+{
+    (void)op;
+    (void)bits;
+    (void)words;
+    (void)start;
+
+    return;
+}
+
+bool bitmap_stats_get(u32 op, struct bitmap_stat *out)
+{
+    (void)op;
+    (void)out;
+
+    return false;
+}
+
+bool bitmap_stats_dump(FILE *fp, bool json)
+{
+    if (fp != NULL)
+    {
+        fprintf(fp, json ? "{\"operations\":null}\n" : "bitmap stats are compiled out, build with -DBITMAP_STATS\n");
+    }
+
+    return false;
+}
+
+void bitmap_stats_reset(void)
+{
+    return;
+}
+
+#endif
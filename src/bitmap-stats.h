@@ -0,0 +1,141 @@
+#ifndef BITMAP_STATS_H_INCLUDED
+#define BITMAP_STATS_H_INCLUDED
+
+#include <stdio.h>
+#include "bitmap.h"
+
+/*
+ * Per-operation counters for the functions of bitmap.h. Nothing is collected unless the library
+ * is built with -DBITMAP_STATS, without it the BITMAP_STAT_* macros generate no code and the dump
+ * functions only report that the stats are compiled out.
+ *
+ * Each thread counts into its own block, so the hot paths never share a cache line. Blocks are
+ * linked into a global list when a thread records its first call and stay there after the thread
+ * exits, the dump adds all of them up.
+ */
+#define BITMAP_STAT_BUCKETS 32      /* Latency bucket b holds calls of [2^(b-1), 2^b) ns, the last one everything slower */
+
+enum bitmap_stat_op
+{
+    BITMAP_STAT_CREATE = 0,
+    BITMAP_STAT_INIT,
+    BITMAP_STAT_DESTROY,
+    BITMAP_STAT_SET_LAZY,
+    BITMAP_STAT_CARDINALITY,
+    BITMAP_STAT_FIRST,
+    BITMAP_STAT_LAST,
+    BITMAP_STAT_REFRESH,
+    BITMAP_STAT_ADD_VALUE,
+    BITMAP_STAT_DEL_VALUE,
+    BITMAP_STAT_ADD_RANGE,
+    BITMAP_STAT_DEL_RANGE,
+    BITMAP_STAT_ADD_MANY,
+    BITMAP_STAT_DEL_MANY,
+    BITMAP_STAT_IS_VALUE_SET,
+    BITMAP_STAT_NEXT_VALUE,
+    BITMAP_STAT_PREV_VALUE,
+    BITMAP_STAT_UPDATE_FIRST,
+    BITMAP_STAT_UPDATE_LAST,
+    BITMAP_STAT_COUNT_SET_BITS,
+    BITMAP_STAT_CARDINALITY_RANGE,
+    BITMAP_STAT_ITER_INIT,
+    BITMAP_STAT_ITER_NEXT,
+    BITMAP_STAT_TO_ARRAY,
+    BITMAP_STAT_FORMAT,
+    BITMAP_STAT_PRINT,
+    BITMAP_STAT_CLONE,
+    BITMAP_STAT_CLONE_INTO,
+    BITMAP_STAT_NOT,
+    BITMAP_STAT_OR,
+    BITMAP_STAT_AND,
+    BITMAP_STAT_AND_NEW,
+    BITMAP_STAT_OR_NEW,
+    BITMAP_STAT_XOR_NEW,
+    BITMAP_STAT_ANDNOT_NEW,
+    BITMAP_STAT_AND_CARDINALITY,
+    BITMAP_STAT_OR_CARDINALITY,
+    BITMAP_STAT_INTERSECTS,
+    BITMAP_STAT_OR_MANY,
+    BITMAP_STAT_AND_MANY,
+    BITMAP_STAT_PARSE_STR,
+    BITMAP_STAT_OPS
+};
+
+struct bitmap_stat
+{
+    u64 calls;
+    u64 bits_changed;               /* Values added or removed by the call */
+    u64 words_scanned;              /* Buffer words read or written by the call itself, not its callees */
+    u64 timed;                      /* Calls that were timed, cheap operations are only counted */
+    u64 ns_total;
+    u64 hist[BITMAP_STAT_BUCKETS];
+};
+
+/* Values a whole-buffer operation added or removed, counted as the change of numbers, 0 while numbers is stale */
+#define BITMAP_STAT_DELTA(before, bm) \
+    ((bm)->flags & BITMAP_FLAG_DIRTY ? 0 : (before) > (bm)->numbers ? (before) - (bm)->numbers : (bm)->numbers - (before))
+
+#ifdef BITMAP_STATS
+
+#define BITMAP_STAT_START() bitmap_stats_now()
+#define BITMAP_STAT_COUNT(op, bits, words) bitmap_stats_record((op), (u64)(bits), (u64)(words), 0)
+#define BITMAP_STAT_TIMED(op, bits, words, start) bitmap_stats_record((op), (u64)(bits), (u64)(words), (start))
+
+#else
+
+/* The arguments stay referenced so values computed only for the stats do not warn, nothing is evaluated */
+#define BITMAP_STAT_START() 0
+#define BITMAP_STAT_COUNT(op, bits, words) ((void)sizeof((bits) + (words)))
+#define BITMAP_STAT_TIMED(op, bits, words, start) ((void)sizeof((bits) + (words) + (start)))
+
+#endif
+
+/*****************************************************************************************************
+ * Name: bitmap_stats_now
+ * Input:  None
+ * Return: Monotonic clock in ns, never 0
+ * Description: Start time handed to bitmap_stats_record, use BITMAP_STAT_START() instead
+ *****************************************************************************************************/
+u64 bitmap_stats_now(void);
+
+/*****************************************************************************************************
+ * Name: bitmap_stats_record
+ * Input:  op      BITMAP_STAT_* of the finished call
+ *         bits    Values the call added or removed
+ *         words   Buffer words the call touched
+ *         start   bitmap_stats_now() at the start of the call, 0 for a call that is not timed
+ * Return: None
+ * Description: Add one call to the calling thread's counters, use the BITMAP_STAT_* macros instead
+ *****************************************************************************************************/
+void bitmap_stats_record(u32 op, u64 bits, u64 words, u64 start);
+
+/*****************************************************************************************************
+ * Name: bitmap_stats_get
+ * Input:  op      BITMAP_STAT_* to read
+ *         out     Receives the counters of op summed over every thread
+ * Return: Success   true
+ *         Failed    false for an unknown op or when the stats are compiled out
+ * Description: Counters of threads that are still running may be a few calls behind
+ *****************************************************************************************************/
+bool bitmap_stats_get(u32 op, struct bitmap_stat *out);
+
+/*****************************************************************************************************
+ * Name: bitmap_stats_dump
+ * Input:  fp      Stream the report is written to
+ *         json    true for a JSON object, false for a text table
+ * Return: Success   true
+ *         Failed    false when fp could not be written or the stats are compiled out
+ * Description: Write the summed counters of every operation that was called at least once, with
+ *              the mean latency and the non-empty histogram buckets of the timed ones
+ *****************************************************************************************************/
+bool bitmap_stats_dump(FILE *fp, bool json);
+
+/*****************************************************************************************************
+ * Name: bitmap_stats_reset
+ * Input:  None
+ * Return: None
+ * Description: Zero the counters of every thread, calls running at the same time may be lost
+ *****************************************************************************************************/
+void bitmap_stats_reset(void);
+
+#endif // BITMAP_STATS_H_INCLUDED
@@ -0,0 +1,613 @@
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "popcount.h"
+#include "word-ops.h"
+#include "thread-pool.h"
+#include "bitmap-wide.h"
+
+enum wide_op
+{
+    WIDE_OP_COUNT = 0,
+    WIDE_OP_NOT,
+    WIDE_OP_OR,
+    WIDE_OP_AND
+};
+
+/* What one chunk of a parallel bulk operation reports back */
+struct wide_chunk_result
+{
+    u64 count;
+    u32 first_word;  /* 1 + index of the first non-zero word, 0 when the chunk is empty */
+    u32 last_word;   /* 1 + index of the last non-zero word */
+};
+
+struct wide_job
+{
+    struct bitmap_wide *dst;
+    struct bitmap_wide *src;
+    u32 src_words;   /* Words of src that take part, the rest of dst is OR'ed with / AND'ed by 0 */
+    u8 op;
+    struct wide_chunk_result *results;
+};
+
+static struct thread_pool *wide_pool = NULL;
+static u32 wide_parallel_min_words = WIDE_PARALLEL_MIN_WORDS;
+
+static bool bitmap_wide_check(struct bitmap_wide *bm);
+static void wide_index_and_mask(u32 value, u32 *index, u64 *mask);
+static void wide_mask_tail(struct bitmap_wide *bm);
+static void wide_update_bounds(struct bitmap_wide *bm, u32 first_hint, u32 last_hint);
+static u32 wide_run_end(struct bitmap_wide *bm, u32 start);
+static void wide_chunk(void *arg, size_t chunk, size_t begin, size_t end);
+static bool wide_parallel(struct bitmap_wide *dst, struct bitmap_wide *src, u32 src_words, u8 op, u64 *count);
+
+static bool bitmap_wide_check(struct bitmap_wide *bm)
+{
+    if (bm != NULL && bm == bm->bm_self)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+static void wide_index_and_mask(u32 value, u32 *index, u64 *mask)
+{
+    *index = (value - 1) >> WORD64_SHIFT;
+    *mask = 1ULL << ((value - 1) & WORD64_MASK);
+
+    return;
+}
+
+/* Keep the bits above max_value in the last word cleared */
+static void wide_mask_tail(struct bitmap_wide *bm)
+{
+    u32 used_bits = bm->max_value & WORD64_MASK;
+
+    if (used_bits != 0)
+    {
+        bm->buf[bm->buf_len - 1] &= (1ULL << used_bits) - 1;
+    }
+
+    return;
+}
+
+/* Recount numbers and rescan first/last starting from the given bounds */
+static void wide_update_bounds(struct bitmap_wide *bm, u32 first_hint, u32 last_hint)
+{
+    bm->numbers = bitmap_wide_count_set_bits(bm);
+
+    if (bm->numbers == 0)
+    {
+        bm->first_value = 0;
+        bm->last_value = 0;
+
+        return;
+    }
+
+    bm->first_value = bitmap_wide_next_value(bm, first_hint);
+    bm->last_value = bitmap_wide_prev_value(bm, last_hint);
+
+    return;
+}
+
+/* Last value of the run of set values beginning at start */
+static u32 wide_run_end(struct bitmap_wide *bm, u32 start)
+{
+    u32 index = 0;
+    u64 mask = 0;
+    u64 word = 0;
+    u64 end = 0;
+
+    wide_index_and_mask(start, &index, &mask);
+    word = ~bm->buf[index] & ~(mask - 1);
+
+    while (word == 0)
+    {
+        if (++index >= bm->buf_len)
+        {
+            return bm->max_value;
+        }
+
+        word = ~bm->buf[index];
+    }
+
+    /* The first clear bit sits at 0-based position end, so the run ends at value end */
+    end = ((u64)index << WORD64_SHIFT) + ctz64(word);
+
+    return end > bm->max_value ? bm->max_value : (u32)end;
+}
+
+/* Apply the operation to words [begin, end) of dst, then count them and find the set words at both ends */
+static void wide_chunk(void *arg, size_t chunk, size_t begin, size_t end)
+{
+    struct wide_job *job = (struct wide_job *)arg;
+    struct wide_chunk_result *result = &job->results[chunk];
+    const struct word_ops *ops = word_ops_get();
+    u64 *buf = job->dst->buf;
+    size_t shared = 0;
+    size_t i = 0;
+
+    shared = end < job->src_words ? end : job->src_words;
+    shared = shared > begin ? shared - begin : 0;
+
+    switch (job->op)
+    {
+    case WIDE_OP_NOT:
+        ops->not_words(buf + begin, (end - begin) * sizeof(u64));
+        break;
+    case WIDE_OP_OR:
+        ops->or_words(buf + begin, job->src->buf + begin, shared * sizeof(u64));
+        break;
+    case WIDE_OP_AND:
+        ops->and_words(buf + begin, job->src->buf + begin, shared * sizeof(u64));
+        memset(buf + begin + shared, 0, (end - begin - shared) * sizeof(u64));
+        break;
+    default:
+        break;
+    }
+
+    if (job->op != WIDE_OP_COUNT && end == job->dst->buf_len)
+    {
+        wide_mask_tail(job->dst);
+    }
+
+    result->count = popcount_buf(buf + begin, (end - begin) * sizeof(u64));
+    result->first_word = 0;
+    result->last_word = 0;
+
+    if (job->op == WIDE_OP_COUNT || result->count == 0)
+    {
+        return;
+    }
+
+    for (i = begin; buf[i] == 0; i++)
+    {
+    }
+
+    result->first_word = (u32)i + 1;
+
+    for (i = end - 1; buf[i] == 0; i--)
+    {
+    }
+
+    result->last_word = (u32)i + 1;
+
+    return;
+}
+
+/* Run op over dst on the thread pool, false when dst is below the threshold and nothing was done */
+static bool wide_parallel(struct bitmap_wide *dst, struct bitmap_wide *src, u32 src_words, u8 op, u64 *count)
+{
+    struct wide_job job;
+    size_t chunks = 0;
+    size_t i = 0;
+    u32 first_word = 0;
+    u32 last_word = 0;
+
+    if (wide_pool == NULL || dst->buf_len < wide_parallel_min_words)
+    {
+        return false;
+    }
+
+    chunks = ((size_t)dst->buf_len + WIDE_CHUNK_WORDS - 1) / WIDE_CHUNK_WORDS;
+    job.dst = dst;
+    job.src = src;
+    job.src_words = src_words;
+    job.op = op;
+    job.results = (struct wide_chunk_result *)malloc(chunks * sizeof(struct wide_chunk_result));
+
+    if (job.results == NULL)
+    {
+        return false;
+    }
+
+    thread_pool_run(wide_pool, wide_chunk, &job, dst->buf_len, WIDE_CHUNK_WORDS);
+
+    *count = 0;
+
+    for (i = 0; i < chunks; i++)
+    {
+        *count += job.results[i].count;
+
+        if (first_word == 0)
+        {
+            first_word = job.results[i].first_word;
+        }
+
+        if (job.results[i].last_word != 0)
+        {
+            last_word = job.results[i].last_word;
+        }
+    }
+
+    free(job.results);
+
+    if (op != WIDE_OP_COUNT)
+    {
+        dst->numbers = (u32)*count;
+        dst->first_value = 0;
+        dst->last_value = 0;
+
+        if (first_word != 0)
+        {
+            dst->first_value = ((first_word - 1) << WORD64_SHIFT) + ctz64(dst->buf[first_word - 1]) + 1;
+            dst->last_value = ((last_word - 1) << WORD64_SHIFT) + (WORD64_MASK - clz64(dst->buf[last_word - 1])) + 1;
+        }
+    }
+
+    return true;
+}
+
+void bitmap_wide_set_thread_pool(struct thread_pool *pool)
+{
+    wide_pool = pool;
+
+    return;
+}
+
+void bitmap_wide_set_parallel_threshold(u32 min_words)
+{
+    wide_parallel_min_words = min_words == 0 ? WIDE_PARALLEL_MIN_WORDS : min_words;
+
+    return;
+}
+
+struct bitmap_wide *bitmap_wide_create(u32 capacity)
+{
+    u32 buf_len = 0;
+    size_t size = 0;
+    struct bitmap_wide *bm = NULL;
+
+    if (capacity == 0)
+    {
+        return NULL;
+    }
+
+    /* aligned_alloc wants a whole number of cache lines */
+    buf_len = (u32)(((u64)capacity + WORD64_BITS - 1) >> WORD64_SHIFT);
+    size = sizeof(struct bitmap_wide) + (size_t)buf_len * sizeof(u64);
+    size = (size + WIDE_ALIGN - 1) & ~(size_t)(WIDE_ALIGN - 1);
+    bm = (struct bitmap_wide *)aligned_alloc(WIDE_ALIGN, size);
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    memset(bm, 0, size);
+    bm->bm_self = bm;
+    bm->max_value = capacity;
+    bm->buf_len = buf_len;
+
+    return bm;
+}
+
+void bitmap_wide_destroy(struct bitmap_wide *bm)
+{
+    if (bitmap_wide_check(bm))
+    {
+        bm->bm_self = NULL;
+        free(bm);
+    }
+
+    return;
+}
+
+bool bitmap_wide_is_value_set(struct bitmap_wide *bm, u32 value)
+{
+    u32 index = 0;
+    u64 mask = 0;
+
+    if (!bitmap_wide_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    wide_index_and_mask(value, &index, &mask);
+
+    return (bm->buf[index] & mask) != 0;
+}
+
+bool bitmap_wide_add_value(struct bitmap_wide *bm, u32 value)
+{
+    u32 index = 0;
+    u64 mask = 0;
+
+    if (!bitmap_wide_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    wide_index_and_mask(value, &index, &mask);
+
+    if ((bm->buf[index] & mask) == 0)
+    {
+        bm->buf[index] |= mask;
+        bm->numbers++;
+
+        if (bm->first_value == 0 || value < bm->first_value)
+        {
+            bm->first_value = value;
+        }
+
+        if (value > bm->last_value)
+        {
+            bm->last_value = value;
+        }
+    }
+
+    return true;
+}
+
+bool bitmap_wide_del_value(struct bitmap_wide *bm, u32 value)
+{
+    u32 index = 0;
+    u64 mask = 0;
+
+    if (!bitmap_wide_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    wide_index_and_mask(value, &index, &mask);
+
+    if ((bm->buf[index] & mask) == 0)
+    {
+        return false;
+    }
+
+    bm->buf[index] &= ~mask;
+    bm->numbers--;
+
+    if (value == bm->first_value)
+    {
+        bm->first_value = bitmap_wide_next_value(bm, value);
+    }
+
+    if (value == bm->last_value)
+    {
+        bm->last_value = bitmap_wide_prev_value(bm, value);
+    }
+
+    return true;
+}
+
+u32 bitmap_wide_next_value(struct bitmap_wide *bm, u32 value)
+{
+    u32 index = 0;
+    u64 mask = 0;
+    u64 word = 0;
+
+    if (!bitmap_wide_check(bm) || value > bm->max_value)
+    {
+        return 0;
+    }
+
+    if (value == 0)
+    {
+        value = 1;
+    }
+
+    wide_index_and_mask(value, &index, &mask);
+    word = bm->buf[index] & ~(mask - 1);
+
+    while (word == 0)
+    {
+        if (++index >= bm->buf_len)
+        {
+            return 0;
+        }
+
+        word = bm->buf[index];
+    }
+
+    return (index << WORD64_SHIFT) + ctz64(word) + 1;
+}
+
+u32 bitmap_wide_prev_value(struct bitmap_wide *bm, u32 value)
+{
+    u32 index = 0;
+    u64 mask = 0;
+    u64 word = 0;
+
+    if (!bitmap_wide_check(bm) || value == 0)
+    {
+        return 0;
+    }
+
+    if (value > bm->max_value)
+    {
+        value = bm->max_value;
+    }
+
+    wide_index_and_mask(value, &index, &mask);
+    word = bm->buf[index] & (mask | (mask - 1));
+
+    while (word == 0)
+    {
+        if (index == 0)
+        {
+            return 0;
+        }
+
+        word = bm->buf[--index];
+    }
+
+    return (index << WORD64_SHIFT) + (WORD64_MASK - clz64(word)) + 1;
+}
+
+u32 bitmap_wide_count_set_bits(struct bitmap_wide *bm)
+{
+    u64 count = 0;
+
+    if (!bitmap_wide_check(bm))
+    {
+        return 0;
+    }
+
+    if (wide_parallel(bm, NULL, 0, WIDE_OP_COUNT, &count))
+    {
+        return (u32)count;
+    }
+
+    return (u32)popcount_buf(bm->buf, (size_t)bm->buf_len * sizeof(u64));
+}
+
+void bitmap_wide_print(struct bitmap_wide *bm)
+{
+    u32 start = 0;
+    u32 end = 0;
+    bool first_print = true;
+
+    if (!bitmap_wide_check(bm) || bm->numbers == 0)
+    {
+        puts("Empty bitmap");
+
+        return;
+    }
+
+    for (start = bm->first_value; start != 0; start = end >= bm->max_value ? 0 : bitmap_wide_next_value(bm, end + 1))
+    {
+        end = wide_run_end(bm, start);
+
+        if (!first_print)
+        {
+            printf(", ");
+        }
+
+        first_print = false;
+
+        if (start == end)
+        {
+            printf("%" PRIu32, start);
+        }
+        else
+        {
+            printf("%" PRIu32 "-%" PRIu32, start, end);
+        }
+    }
+
+    puts("\n");
+
+    return;
+}
+
+struct bitmap_wide *bitmap_wide_clone(struct bitmap_wide *bm)
+{
+    struct bitmap_wide *new_bm = NULL;
+
+    if (!bitmap_wide_check(bm))
+    {
+        return NULL;
+    }
+
+    new_bm = bitmap_wide_create(bm->max_value);
+
+    if (!bitmap_wide_check(new_bm))
+    {
+        return NULL;
+    }
+
+    memcpy(new_bm, bm, sizeof(struct bitmap_wide) + (size_t)bm->buf_len * sizeof(u64));
+    new_bm->bm_self = new_bm;
+
+    return new_bm;
+}
+
+bool bitmap_wide_not(struct bitmap_wide *bm)
+{
+    u64 count = 0;
+
+    if (!bitmap_wide_check(bm))
+    {
+        return false;
+    }
+
+    if (wide_parallel(bm, NULL, 0, WIDE_OP_NOT, &count))
+    {
+        return true;
+    }
+
+    word_ops_get()->not_words(bm->buf, (size_t)bm->buf_len * sizeof(u64));
+
+    wide_mask_tail(bm);
+    wide_update_bounds(bm, 1, bm->max_value);
+
+    return true;
+}
+
+bool bitmap_wide_or(struct bitmap_wide *bm_store, struct bitmap_wide *bm)
+{
+    size_t words = 0;
+    u32 first_hint = 0;
+    u32 last_hint = 0;
+    u64 count = 0;
+
+    if (!bitmap_wide_check(bm) || !bitmap_wide_check(bm_store))
+    {
+        return false;
+    }
+
+    words = bm_store->buf_len < bm->buf_len ? bm_store->buf_len : bm->buf_len;
+
+    if (wide_parallel(bm_store, bm, (u32)words, WIDE_OP_OR, &count))
+    {
+        return true;
+    }
+
+    first_hint = bm_store->first_value;
+    last_hint = bm_store->last_value;
+
+    if (bm->first_value != 0 && (first_hint == 0 || bm->first_value < first_hint))
+    {
+        first_hint = bm->first_value;
+    }
+
+    if (bm->last_value > last_hint)
+    {
+        last_hint = bm->last_value;
+    }
+
+    word_ops_get()->or_words(bm_store->buf, bm->buf, words * sizeof(u64));
+
+    if (bm_store->max_value < bm->max_value)
+    {
+        wide_mask_tail(bm_store);
+    }
+
+    wide_update_bounds(bm_store, first_hint, last_hint);
+
+    return true;
+}
+
+bool bitmap_wide_and(struct bitmap_wide *bm_store, struct bitmap_wide *bm)
+{
+    size_t words = 0;
+    u64 count = 0;
+
+    if (!bitmap_wide_check(bm) || !bitmap_wide_check(bm_store))
+    {
+        return false;
+    }
+
+    words = bm_store->buf_len < bm->buf_len ? bm_store->buf_len : bm->buf_len;
+
+    if (wide_parallel(bm_store, bm, (u32)words, WIDE_OP_AND, &count))
+    {
+        return true;
+    }
+
+    word_ops_get()->and_words(bm_store->buf, bm->buf, words * sizeof(u64));
+
+    /* bm holds nothing above its own max_value */
+    if (bm_store->buf_len > words)
+    {
+        memset(bm_store->buf + words, 0, (bm_store->buf_len - words) * sizeof(u64));
+    }
+
+    wide_update_bounds(bm_store, bm_store->first_value, bm_store->last_value);
+
+    return true;
+}
@@ -0,0 +1,172 @@
+#ifndef BITMAP_WIDE_H_INCLUDED
+#define BITMAP_WIDE_H_INCLUDED
+
+#include "bitmap.h"
+
+#define WORD64_BITS 64
+#define WORD64_SHIFT 6              /* log2(WORD64_BITS) */
+#define WORD64_MASK (WORD64_BITS - 1)
+#define U32_MAX 4294967295U
+#define WIDE_ALIGN 64                       /* Cache line, buf[] starts on one */
+#define WIDE_CHUNK_WORDS 8192               /* 64 KiB of words per parallel chunk, whole cache lines of buf[] */
+#define WIDE_PARALLEL_MIN_WORDS 131072      /* Default size (1 MiB of words) from which bulk ops go parallel */
+
+struct thread_pool;
+
+/* Same layout and semantics as struct bitmap with 32-bit values and 64-bit storage words */
+struct bitmap_wide
+{
+    struct bitmap_wide *bm_self; /* The value used when creating a bitmap */
+    u32 max_value;               /* The value used when creating a bitmap */
+    u32 first_value;             /* The first bit has been set */
+    u32 last_value;              /* The last bit has been set */
+    u32 numbers;                 /* Number of '1' bits in buf[] */
+    u32 buf_len;
+    _Alignas(WIDE_ALIGN) u64 buf[0]; /* Flexible array member for bitmap storage */
+};
+
+/*****************************************************************************************************
+ * Name: bitmap_wide_create
+ * Input:  capacity  The capacity of the bitmap that will be created, up to U32_MAX
+ * Return: Success   pointer to bitmap
+ *         Failed    NULL
+ * Description: Create a new wide bitmap holding the values 1 to capacity
+ *****************************************************************************************************/
+struct bitmap_wide *bitmap_wide_create(u32 capacity);
+
+/*****************************************************************************************************
+ * Name: bitmap_wide_destroy
+ * Input: bm        A wide bitmap that will be destroyed
+ * Return: None
+ * Description: Destroy a wide bitmap
+ *****************************************************************************************************/
+void bitmap_wide_destroy(struct bitmap_wide *bm);
+
+/*************************************************************
+ * Name: bitmap_wide_add_value
+ * Input: bm         The bitmap to which values are added
+ *        value      A value that will be added into the bitmap
+ * Return: Success   true
+ *         Failed    false
+ * Description: Add a value into the wide bitmap
+ **************************************************************/
+bool bitmap_wide_add_value(struct bitmap_wide *bm, u32 value);
+
+/************************************************************************
+ * Name: bitmap_wide_del_value
+ * Input: bm        The bitmap from which values are removed
+ *        value     A value that will be removed from the specified bitmap
+ * Return: Success  true
+ *         Failed   false
+ * Description: Remove a value from the wide bitmap
+ ************************************************************************/
+bool bitmap_wide_del_value(struct bitmap_wide *bm, u32 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_wide_is_value_set
+ * Input:  bm     Pointer to the wide bitmap
+ *         value  The value to check in the bitmap
+ * Return: Success   true
+ *         Failed    false
+ * Description: Check if a given value is set in the wide bitmap
+ *****************************************************************************************************/
+bool bitmap_wide_is_value_set(struct bitmap_wide *bm, u32 value);
+
+/*******************************************************
+ * Name: bitmap_wide_print
+ * Input: bm      A wide bitmap that will be printed
+ * Return: None
+ * Description: Print all the elements in the wide bitmap
+ *******************************************************/
+void bitmap_wide_print(struct bitmap_wide *bm);
+
+/*********************************************************************
+ * Name: bitmap_wide_clone
+ * Input: bm         A wide bitmap that will be copied
+ * Return: Success   Pointer to the copy
+ *         Fail      NULL
+ * Description: Create a new wide bitmap and copy bm data into it
+ **********************************************************************/
+struct bitmap_wide *bitmap_wide_clone(struct bitmap_wide *bm);
+
+/*********************************************************************
+ * Name: bitmap_wide_not
+ * Input: bm         A wide bitmap that will be reversed
+ * Return: Success   true
+ *         Failed    false
+ * Description: Reverse all the binary bits up to max_value
+ **********************************************************************/
+bool bitmap_wide_not(struct bitmap_wide *bm);
+
+/****************************************************************************************
+ * Name: bitmap_wide_or
+ * Input:
+ *    bm_store       A wide bitmap that participates in binary OR operations and stores the results
+ *    bm             Another wide bitmap that participates in binary OR operations
+ * Return: Success   true
+ *         Failed    false
+ * Description: Perform binary OR operation (bm_store | bm), bits of bm above
+ *              bm_store->max_value are dropped
+ *****************************************************************************************/
+bool bitmap_wide_or(struct bitmap_wide *bm_store, struct bitmap_wide *bm);
+
+/******************************************************************************************
+ * Name: bitmap_wide_and
+ * Input:
+ *    bm_store       A wide bitmap that participates in binary AND operations and stores the results
+ *    bm             Another wide bitmap that participates in binary AND operations
+ * Return: Success   true
+ *         Failed    false
+ * Description: Perform binary AND operation (bm_store & bm)
+ *******************************************************************************************/
+bool bitmap_wide_and(struct bitmap_wide *bm_store, struct bitmap_wide *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_wide_count_set_bits
+ * Input:  bm     Pointer to the wide bitmap
+ * Return: Success   count value
+ *         Failed    0
+ * Description: Count the number of set bits in the wide bitmap
+ *****************************************************************************************************/
+u32 bitmap_wide_count_set_bits(struct bitmap_wide *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_wide_next_value
+ * Input:  bm     Pointer to the wide bitmap
+ *         value  The value the scan starts from (0 is treated as 1)
+ * Return: Success   The smallest value >= value that is set
+ *         Failed    0 when there is none
+ * Description: Scan forward a word at a time, skipping zero words
+ *****************************************************************************************************/
+u32 bitmap_wide_next_value(struct bitmap_wide *bm, u32 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_wide_prev_value
+ * Input:  bm     Pointer to the wide bitmap
+ *         value  The value the scan starts from, clamped to max_value
+ * Return: Success   The largest value <= value that is set
+ *         Failed    0 when there is none
+ * Description: Scan backward a word at a time, skipping zero words
+ *****************************************************************************************************/
+u32 bitmap_wide_prev_value(struct bitmap_wide *bm, u32 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_wide_set_thread_pool
+ * Input:  pool   The pool the bulk operations split their work over, NULL for single threaded
+ * Return: None
+ * Description: not, or, and and count_set_bits on bitmaps of at least the parallel threshold run
+ *              WIDE_CHUNK_WORDS chunks on pool. Each chunk also counts its bits and finds its
+ *              first/last set word, so numbers/first/last come from reducing the chunk results.
+ *              Must not be called while a bulk operation is running
+ *****************************************************************************************************/
+void bitmap_wide_set_thread_pool(struct thread_pool *pool);
+
+/*****************************************************************************************************
+ * Name: bitmap_wide_set_parallel_threshold
+ * Input:  min_words  Smallest buf_len that is split over the thread pool, 0 restores the default
+ * Return: None
+ * Description: Smaller bitmaps stay on the single threaded path. Defaults to WIDE_PARALLEL_MIN_WORDS
+ *****************************************************************************************************/
+void bitmap_wide_set_parallel_threshold(u32 min_words);
+
+#endif // BITMAP_WIDE_H_INCLUDED
@@ -1,510 +1,1780 @@
-#include <string.h>
-#include "bitmap.h"
-
-/*Some Common Function used to helping the calculation*/
-void get_index_and_mask(u16 value, u16 *index, u32 *mask);
-bool is_value_set(struct bitmap *bm, u16 value);
-void set_value(struct bitmap *bm, u16 value);
-void clear_value(struct bitmap *bm, u16 value);
-void update_first_value(struct bitmap *bm);
-void update_last_value(struct bitmap *bm);
-u8 count_bits_in_byte(u32 byte);
-u16 count_set_bits(struct bitmap *bm);
-
-/*************************************************************
- * Name: bitmap_check
- * Input: bm         The bitmap to which values are added
- * Return: Success   true
- *         Failed    false
- * Description: Add a value into the bitmap
- **************************************************************/
-static bool bitmap_check(struct bitmap *bm);
-
-void get_index_and_mask(u16 value, u16 *index, u32 *mask)
-{
-    *index = (value - 1) / UINT_BITS;
-    *mask = 1U << ((value - 1) % UINT_BITS);
-
-    return;
-}
-
-bool is_value_set(struct bitmap *bm, u16 value)
-{
-    u16 index = 0;
-    u32 mask = 0;
-
-    if (!bitmap_check(bm) || value == 0 || value > bm->max_value)
-    {
-        return false;
-    }
-
-    get_index_and_mask(value, &index, &mask);
-
-    return (bm->buf[index] & mask) != 0;
-}
-
-void set_value(struct bitmap *bm, u16 value)
-{
-    u16 index = 0;
-    u32 mask = 0;
-
-    get_index_and_mask(value, &index, &mask);
-
-    bm->buf[index] |= mask;
-    
-    return;
-}
-
-void clear_value(struct bitmap *bm, u16 value)
-{
-    u16 index = 0;
-    u32 mask = 0;
-
-    get_index_and_mask(value, &index, &mask);
-
-    bm->buf[index] &= ~mask;
-
-    return;
-}
-
-void update_first_value(struct bitmap *bm)
-{
-    u32 iteration = 0;
-
-    for (iteration = 1; iteration <= bm->max_value; iteration++)
-    {
-        if (is_value_set(bm, iteration))
-        {
-            bm->first_value = iteration;
-
-            return;
-        }
-    }
-
-    bm->first_value = 0;
-
-    return;
-}
-
-void update_last_value(struct bitmap *bm)
-{
-    u32 iteration = 0;
-
-    for (iteration = bm->max_value; iteration >= 1; iteration--)
-    {
-        if (is_value_set(bm, iteration))
-        {
-            bm->last_value = iteration;
-
-            return;
-        }
-    }
-
-    bm->last_value = 0;
-
-    return;
-}
-
-u8 count_bits_in_byte(u32 byte)
-{
-    u8 count = 0;
-
-    while (byte)
-    {
-        count += byte & 1;
-        byte >>= 1;
-    }
-
-    return count;
-}
-
-u16 count_set_bits(struct bitmap *bm)
-{
-    u16 count = 0;
-    u16 i = 0;
-
-    for (i = 0; i < bm->buf_len; i++)
-    {
-        count += count_bits_in_byte(bm->buf[i]);
-    }
-
-    return count;
-}
-
-struct bitmap *bitMap_create(u16 capacity)
-{
-    u16 buf_len = 0;
-    u16 size = 0;
-    struct bitmap *bm = NULL;
-
-    if (capacity == 0)
-    {
-        return NULL;
-    }
-
-    buf_len = (capacity + UINT_BITS - 1) / UINT_BITS;
-    size = sizeof(struct bitmap) + buf_len * sizeof(u32);
-    bm = (struct bitmap *)calloc(1, size);
-
-    if (bm == NULL)
-    {
-        return NULL;
-    }
-
-    bm->bm_self = bm;
-    bm->max_value = capacity;
-    bm->first_value = 0;
-    bm->last_value = 0;
-    bm->numbers = 0;
-    bm->buf_len = buf_len;
-    memset(bm->buf, 0, buf_len * sizeof(u32));
-
-    return bm;
-}
-
-void bitmap_destroy(struct bitmap *bm)
-{
-    if (bitmap_check(bm))
-    {
-        bm->bm_self= NULL;
-        free(bm);
-        bm = NULL;
-    }
-
-    return;
-}
-
-static bool bitmap_check(struct bitmap *bm)
-{
-    if (bm != NULL && bm == bm->bm_self)
-    {
-        return true;
-    }
-
-    return false;
-}
-
-bool bitmap_add_value(struct bitmap *bm, u16 value)
-{
-    if (!bitmap_check(bm) || value == 0 || value > bm->max_value)
-    {
-        return false;
-    }
-
-    if (!is_value_set(bm, value))
-    {
-        set_value(bm, value);
-        bm->numbers++;
-
-        if (bm->first_value == 0 || value < bm->first_value)
-        {
-            bm->first_value = value;
-        }
-
-        if (value > bm->last_value)
-        {
-            bm->last_value = value;
-        }
-    }
-
-    return true;
-}
-
-bool bitmap_del_value(struct bitmap *bm, u16 value)
-{
-    if (!bitmap_check(bm) || value == 0 || value > bm->max_value)
-    {
-        return false;
-    }
-
-    if (is_value_set(bm, value))
-    {
-        clear_value(bm, value);
-        bm->numbers--;
-
-        if (value == bm->first_value)
-        {
-            update_first_value(bm);
-        }
-
-        if (value == bm->last_value)
-        {
-            update_last_value(bm);
-        }
-
-        return true;
-    }
-
-    return false;
-}
-
-void bitmap_print(struct bitmap *bm)
-{
-    u16 start = 0;
-    u32 iteration = 0;
-    bool in_range = false;
-    /* Flag to track whether it's the first number or range being printed*/
-    bool first_print = true;
-
-    if (!bitmap_check(bm) || bm->numbers == 0)
-    {
-        puts("Empty bitmap");
-
-        return;
-    }
-
-    start = bm->first_value;
-    in_range = false;
-
-    /* Start from first value and ends in maximum value */
-    for (iteration = bm->first_value; iteration <= bm->max_value; iteration++)
-    {
-        /* Check if the value is set */
-        if (is_value_set(bm, iteration))
-        {
-            /* Check if a new range starts */
-            if (!in_range)
-            {
-                start = iteration;
-                in_range = true;
-            }
-        }
-        else
-        {
-            if (in_range)
-            {
-                /* If only one value */
-                if (first_print)
-                {
-                    first_print = false;
-                }
-                /* Print a comma before the next element or range */
-                else
-                {
-                    printf(", ");
-                }
-
-                if (start == iteration - 1)
-                {
-                    printf("%hu", start);
-                }
-                else
-                {
-                    printf("%hu-%hu", start, iteration - 1);
-                }
-
-                in_range = false;
-            }
-        }
-    }
-
-    /* If the last range hasn't been printed */
-    if (in_range)
-    {
-        if (!first_print)
-        {
-            printf(", ");
-        }
-
-        if (start == bm->max_value)
-        {
-            printf("%hu", start);
-        }
-        else
-        {
-            printf("%hu-%hu", start, bm->max_value);
-        }
-    }
-
-    puts("\n");
-
-    return;
-}
-
-struct bitmap *bitmap_clone(struct bitmap *bm)
-{
-    struct bitmap *new_bm = NULL;
-
-    if (!bitmap_check(bm))
-    {
-        return NULL;
-    }
-
-    new_bm = bitMap_create(bm->max_value);
-
-    if (!bitmap_check(new_bm))
-    {
-        return NULL;
-    }
-
-    memcpy(new_bm, bm, sizeof(struct bitmap) + bm->buf_len * sizeof(u32));
-    new_bm->bm_self = new_bm;
-
-    return new_bm;
-}
-
-bool bitmap_not(struct bitmap *bm)
-{
-    u32 iteration = 0;
-    u32 extra_bits = 0;
-    u32 mask = 0;
-
-    if (!bitmap_check(bm))
-    {
-        return false;
-    }
-
-    for (iteration = 0; iteration < bm->buf_len; iteration++)
-    {
-        bm->buf[iteration] = ~bm->buf[iteration];
-    }
-
-    /* If the buffer length doesn't matches the word size then extra bits need to set*/
-    extra_bits = (bm->buf_len * UINT_BITS) - bm->max_value;
-    
-    if (extra_bits > 0)
-    {
-        mask = (1U << (UINT_BITS - extra_bits)) - 1;
-        bm->buf[bm->buf_len - 1] &= mask;
-    }
-
-    bm->numbers = count_set_bits(bm);
-    update_first_value(bm);
-    update_last_value(bm);
-
-    return true;
-}
-
-bool bitmap_or(struct bitmap *bm_store, struct bitmap *bm)
-{
-    u16 iteration = 0;
-
-    if (!bitmap_check(bm) || !bitmap_check(bm_store))
-    {
-        return false;
-    }
-
-    for (iteration = 0; iteration < bm_store->buf_len; iteration++)
-    {
-        bm_store->buf[iteration] |= bm->buf[iteration];
-    }
-
-    if (bm_store->max_value < bm->max_value)
-    {
-        u32 extra_bits = (bm_store->buf_len * UINT_BITS) - bm_store->max_value;
-        u32 mask = (1U << (UINT_BITS - extra_bits)) - 1;
-
-        /*Set the extra bits in bm_store to 0 in the last buffer element*/
-        bm_store->buf[bm_store->buf_len - 1] &= mask;
-    }
-
-    bm_store->numbers = count_set_bits(bm_store);
-    update_first_value(bm_store);
-    update_last_value(bm_store);
-
-    return true;
-}
-
-bool bitmap_and(struct bitmap *bm_store, struct bitmap *bm)
-{
-    u16 iteration = 0;
-
-    if (!bitmap_check(bm) || !bitmap_check(bm_store))
-    {
-        return false;
-    }
-
-    for (iteration = 0; iteration < bm->buf_len; iteration++)
-    {
-        bm_store->buf[iteration] &= bm->buf[iteration];
-    }
-
-    if (bm_store->max_value > bm->max_value)
-    {
-        memset(bm_store->buf + bm->buf_len, 0, (bm_store->buf_len - bm->buf_len) * sizeof(u32));
-    }
-
-    bm_store->numbers = count_set_bits(bm_store);
-    update_first_value(bm_store);
-    update_last_value(bm_store);
-
-    return true;
-}
-
-struct bitmap *bitmap_parse_str(u8 *str)
-{
-    struct bitmap *bm = NULL;
-    char *token = NULL;
-    char *dash = NULL;
-    u32 start = 0;
-    u32 end = 0;
-    u32 value = 0;
-    u32 iteration = 0;
-
-    if (str == NULL)
-    {
-        return NULL;
-    }
-
-    /*For parsing unsigned short maximum is used*/
-    bm = bitMap_create(U16_MAX);
-
-    if (!bitmap_check(bm))
-    {
-        return NULL;
-    }
-
-    /* Using to take range separated by comma*/
-    token = strtok((char *)str, ",");
-
-    while (token != NULL)
-    {
-        dash = strchr(token, '-');
-
-        if (dash)
-        {
-            start = atoi(token);
-            end = atoi(dash + 1);
-
-            /*Returns for invalid inputs*/
-            if (start == 0 || end == 0 || start > U16_MAX || end > U16_MAX)
-            {
-                free(bm);
-                bm = NULL;
-
-                return NULL;
-            }
-
-            /*Handle Reverse String Also*/
-            if (start > end)
-            {
-                start = start ^ end;
-                end = start ^ end;
-                start = start ^ end;
-            }
-
-            for (iteration = start; iteration <= end; iteration++)
-            {
-                bitmap_add_value(bm, iteration);
-            }
-        }
-        else
-        {
-            value = atoi(token);
-            
-			if(value == 0 || value >U16_MAX)
-			{
-                free(bm);
-                bm = NULL;
-
-                return NULL;				
-			}
-            
-            bitmap_add_value(bm, value);
-        }
-
-        token = strtok(NULL, ",");
-    }
-
-    return bm;
-}
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "popcount.h"
+#include "word-ops.h"
+#include "bitmap-rank.h"
+#include "bitmap-io.h"
+#include "range-parser.h"
+#include "bitmap-pool.h"
+#include "bitmap-stats.h"
+
+/* Output of bitmap_format is gathered in chunks of this size before it is handed to the sink */
+#define BITMAP_FORMAT_CHUNK 512
+
+/* Words processed per step by the blocked kernels, small enough to stay in L1 */
+#define BITMAP_BLOCK_WORDS 256
+
+/* Inputs of bitmap_and_many that are ordered without a heap allocation */
+#define BITMAP_MANY_STACK 256
+
+/* Destination of bitmap_format */
+struct format_buffer
+{
+    char *buf;
+    size_t cap;
+    size_t len;   /* Length of the whole output, may exceed cap */
+};
+
+enum bitmap_op
+{
+    BITMAP_OP_AND = 1,
+    BITMAP_OP_OR,
+    BITMAP_OP_XOR,
+    BITMAP_OP_ANDNOT
+};
+
+/*Some Common Function used to helping the calculation*/
+void get_index_and_mask(u16 value, u16 *index, u32 *mask);
+bool is_value_set(struct bitmap *bm, u16 value);
+void set_value(struct bitmap *bm, u16 value);
+void clear_value(struct bitmap *bm, u16 value);
+void update_first_value(struct bitmap *bm);
+void update_last_value(struct bitmap *bm);
+u16 bitmap_next_value(struct bitmap *bm, u16 value);
+u16 bitmap_prev_value(struct bitmap *bm, u16 value);
+u16 count_set_bits(struct bitmap *bm);
+
+/*************************************************************
+ * Name: bitmap_check
+ * Input: bm         The bitmap to which values are added
+ * Return: Success   true
+ *         Failed    false
+ * Description: Add a value into the bitmap
+ **************************************************************/
+static bool bitmap_check(struct bitmap *bm);
+
+/*************************************************************
+ * Name: bitmap_setup
+ * Input: bm         Storage for the bitmap, buf[] is not touched
+ *        capacity   The capacity of the bitmap
+ *        flags      BITMAP_FLAG_* bits of the new bitmap
+ * Return: None
+ * Description: Fill in the fields of a new, empty bitmap
+ **************************************************************/
+static void bitmap_setup(struct bitmap *bm, u16 capacity, u16 flags);
+
+/*************************************************************
+ * Name: bitmap_check_writable
+ * Input: bm         The bitmap that is about to be changed
+ * Return: Success   true
+ *         Failed    false, also for a read-only bitmap
+ * Description: bitmap_check for the operations that write to bm
+ **************************************************************/
+static bool bitmap_check_writable(struct bitmap *bm);
+
+/*************************************************************
+ * Name: mask_tail_bits
+ * Input: bm         The bitmap whose last word is trimmed
+ * Return: None
+ * Description: Clear the bits of the last word above max_value
+ **************************************************************/
+static void mask_tail_bits(struct bitmap *bm);
+
+/*************************************************************
+ * Name: block_is_zero
+ * Input: block      A run of buffer words
+ *        words      Number of words in block
+ * Return: true when every word is 0
+ * Description: Early exit test of the N-way AND
+ **************************************************************/
+static bool block_is_zero(const u32 *block, u32 words);
+
+/*************************************************************
+ * Name: refresh_after_bulk
+ * Input: bm         A bitmap whose words were rewritten
+ *        first_hint No value below it can be set, 0 when nothing is set
+ *        last_hint  No value above it can be set, 0 when nothing is set
+ * Return: None
+ * Description: Mark numbers, first_value and last_value stale inside
+ *              the hints, and recompute them at once unless bm is lazy
+ **************************************************************/
+static void refresh_after_bulk(struct bitmap *bm, u16 first_hint, u16 last_hint);
+
+/*************************************************************
+ * Name: bitmap_refresh
+ * Input: bm         Pointer to the bitmap structure
+ * Return: None
+ * Description: Recompute stale metadata, scanning only the words
+ *              between the bounds kept in first_value/last_value
+ **************************************************************/
+static void bitmap_refresh(struct bitmap *bm);
+
+/*************************************************************
+ * Name: bounds_union / bounds_intersect
+ * Input: bm_a       First operand
+ *        bm_b       Second operand
+ *        first      Receives the lowest value the result can hold
+ *        last       Receives the highest value, 0 for an empty result
+ * Return: None
+ * Description: Hints for refresh_after_bulk, work on stale bounds too
+ **************************************************************/
+static void bounds_union(struct bitmap *bm_a, struct bitmap *bm_b, u16 *first, u16 *last);
+static void bounds_intersect(struct bitmap *bm_a, struct bitmap *bm_b, u16 *first, u16 *last);
+
+/*************************************************************
+ * Name: run_end
+ * Input: bm         Pointer to the bitmap structure
+ *        start      A set value
+ * Return: The last value of the run of set values from start
+ * Description: Find run boundaries a word at a time
+ **************************************************************/
+static u16 run_end(struct bitmap *bm, u16 start);
+
+/*************************************************************
+ * Name: format_u16
+ * Input: out        Receives up to 5 digits, not terminated
+ *        value      The number to write
+ * Return: Number of digits written
+ * Description: Locale free itoa used by bitmap_format
+ **************************************************************/
+static u32 format_u16(char *out, u16 value);
+
+/*************************************************************
+ * Name: buffer_sink / stdout_sink
+ * Input: ctx        struct format_buffer / unused
+ *        data       Piece of formatted text
+ *        len        Number of bytes in data
+ * Return: false when the text could not be written
+ * Description: Sinks behind bitmap_format and bitmap_print
+ **************************************************************/
+static bool buffer_sink(void *ctx, const char *data, size_t len);
+static bool stdout_sink(void *ctx, const char *data, size_t len);
+
+/*************************************************************
+ * Name: batch_bounds
+ * Input: bm         The bitmap the batch is applied to
+ *        vals       The values of the batch
+ *        n          Number of values, at least 1
+ *        lo / hi    Receive the smallest and largest value
+ * Return: true when every value lies in 1..max_value
+ * Description: Single validation pass of bitmap_add_many/del_many
+ **************************************************************/
+static bool batch_bounds(struct bitmap *bm, const u16 *vals, u32 n, u16 *lo, u16 *hi);
+
+void get_index_and_mask(u16 value, u16 *index, u32 *mask)
+{
+    *index = (value - 1) >> UINT_SHIFT;
+    *mask = 1U << ((value - 1) & UINT_MASK);
+
+    return;
+}
+
+bool is_value_set(struct bitmap *bm, u16 value)
+{
+    u16 index = 0;
+    u32 mask = 0;
+
+    if (!bitmap_check(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    get_index_and_mask(value, &index, &mask);
+    BITMAP_STAT_COUNT(BITMAP_STAT_IS_VALUE_SET, 0, 1);
+
+    return (bm->buf[index] & mask) != 0;
+}
+
+void set_value(struct bitmap *bm, u16 value)
+{
+    u16 index = 0;
+    u32 mask = 0;
+
+    get_index_and_mask(value, &index, &mask);
+
+    bm->buf[index] |= mask;
+    
+    return;
+}
+
+void clear_value(struct bitmap *bm, u16 value)
+{
+    u16 index = 0;
+    u32 mask = 0;
+
+    get_index_and_mask(value, &index, &mask);
+
+    bm->buf[index] &= ~mask;
+
+    return;
+}
+
+u16 bitmap_next_value(struct bitmap *bm, u16 value)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 scan_from = 0;
+    u16 index = 0;
+    u32 mask = 0;
+    u32 word = 0;
+
+    if (!bitmap_check(bm) || value > bm->max_value)
+    {
+        return 0;
+    }
+
+    if (value == 0)
+    {
+        value = 1;
+    }
+
+    get_index_and_mask(value, &index, &mask);
+    scan_from = index;
+
+    /* Drop the bits below value and skip whole zero words after that */
+    word = bm->buf[index] & ~(mask - 1);
+
+    while (word == 0)
+    {
+        if (++index >= bm->buf_len)
+        {
+            break;
+        }
+
+        word = bm->buf[index];
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_NEXT_VALUE, 0, index - scan_from + (word != 0), stat_start);
+
+    if (word == 0)
+    {
+        return 0;
+    }
+
+    return (u16)(index * UINT_BITS + ctz32(word) + 1);
+}
+
+u16 bitmap_prev_value(struct bitmap *bm, u16 value)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 scan_from = 0;
+    u16 index = 0;
+    u32 mask = 0;
+    u32 word = 0;
+
+    if (!bitmap_check(bm) || value == 0)
+    {
+        return 0;
+    }
+
+    if (value > bm->max_value)
+    {
+        value = bm->max_value;
+    }
+
+    get_index_and_mask(value, &index, &mask);
+    scan_from = index;
+
+    /* Drop the bits above value and skip whole zero words below that */
+    word = bm->buf[index] & (mask | (mask - 1));
+
+    while (word == 0 && index != 0)
+    {
+        word = bm->buf[--index];
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_PREV_VALUE, 0, scan_from - index + 1, stat_start);
+
+    if (word == 0)
+    {
+        return 0;
+    }
+
+    return (u16)(index * UINT_BITS + (UINT_BITS - 1 - clz32(word)) + 1);
+}
+
+void update_first_value(struct bitmap *bm)
+{
+    u64 stat_start = BITMAP_STAT_START();
+
+    /* The words are counted by bitmap_next_value, the time of a full rescan is kept here */
+    bm->first_value = bitmap_next_value(bm, 1);
+    BITMAP_STAT_TIMED(BITMAP_STAT_UPDATE_FIRST, 0, 0, stat_start);
+
+    return;
+}
+
+void update_last_value(struct bitmap *bm)
+{
+    u64 stat_start = BITMAP_STAT_START();
+
+    bm->last_value = bitmap_prev_value(bm, bm->max_value);
+    BITMAP_STAT_TIMED(BITMAP_STAT_UPDATE_LAST, 0, 0, stat_start);
+
+    return;
+}
+
+u16 count_set_bits(struct bitmap *bm)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 count = (u16)popcount_buf(bm->buf, (size_t)bm->buf_len * sizeof(u32));
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_COUNT_SET_BITS, 0, bm->buf_len, stat_start);
+
+    return count;
+}
+
+u16 bitmap_cardinality_range(struct bitmap *bm, u16 lo, u16 hi)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 lo_index = 0;
+    u16 hi_index = 0;
+    u32 lo_mask = 0;
+    u32 hi_mask = 0;
+    u32 count = 0;
+
+    if (!bitmap_check(bm) || lo == 0 || lo > hi || lo > bm->max_value)
+    {
+        return 0;
+    }
+
+    if (hi > bm->max_value)
+    {
+        hi = bm->max_value;
+    }
+
+    get_index_and_mask(lo, &lo_index, &lo_mask);
+    get_index_and_mask(hi, &hi_index, &hi_mask);
+
+    /* Keep the bits from lo upwards in the first word and up to hi in the last one */
+    lo_mask = ~(lo_mask - 1);
+    hi_mask = hi_mask | (hi_mask - 1);
+
+    if (lo_index == hi_index)
+    {
+        count = popcount32(bm->buf[lo_index] & lo_mask & hi_mask);
+    }
+    else
+    {
+        count = popcount32(bm->buf[lo_index] & lo_mask) + popcount32(bm->buf[hi_index] & hi_mask);
+        count += (u32)popcount_buf(bm->buf + lo_index + 1, (size_t)(hi_index - lo_index - 1) * sizeof(u32));
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_CARDINALITY_RANGE, 0, hi_index - lo_index + 1, stat_start);
+
+    return (u16)count;
+}
+
+static void bitmap_setup(struct bitmap *bm, u16 capacity, u16 flags)
+{
+    bm->bm_self = bm;
+    bm->max_value = capacity;
+    bm->first_value = 0;
+    bm->last_value = 0;
+    bm->numbers = 0;
+    bm->buf_len = (capacity + UINT_BITS - 1) / UINT_BITS;
+    bm->flags = flags;
+    bm->rank = NULL;
+
+    return;
+}
+
+struct bitmap *bitMap_create(u16 capacity)
+{
+    struct bitmap *bm = NULL;
+
+    if (capacity == 0)
+    {
+        return NULL;
+    }
+
+    /* Blocks come back zeroed, from calloc or from the pool */
+    bm = bitmap_pool_alloc((capacity + UINT_BITS - 1) / UINT_BITS);
+
+    if (bm == NULL)
+    {
+        return NULL;
+    }
+
+    bitmap_setup(bm, capacity, 0);
+    BITMAP_STAT_COUNT(BITMAP_STAT_CREATE, 0, bm->buf_len);
+
+    return bm;
+}
+
+size_t bitmap_size_for(u16 capacity)
+{
+    return sizeof(struct bitmap) + (size_t)((capacity + UINT_BITS - 1) / UINT_BITS) * sizeof(u32);
+}
+
+struct bitmap *bitmap_init(void *mem, size_t len, u16 capacity)
+{
+    struct bitmap *bm = (struct bitmap *)mem;
+
+    if (mem == NULL || capacity == 0 || len < bitmap_size_for(capacity) ||
+        (uintptr_t)mem % _Alignof(struct bitmap) != 0)
+    {
+        return NULL;
+    }
+
+    bitmap_setup(bm, capacity, BITMAP_FLAG_EXTERNAL);
+    memset(bm->buf, 0, (size_t)bm->buf_len * sizeof(u32));
+    BITMAP_STAT_COUNT(BITMAP_STAT_INIT, 0, bm->buf_len);
+
+    return bm;
+}
+
+void bitmap_destroy(struct bitmap *bm)
+{
+    if (!bitmap_check(bm))
+    {
+        return;
+    }
+
+    BITMAP_STAT_COUNT(BITMAP_STAT_DESTROY, 0, 0);
+
+    if (bm->flags & BITMAP_FLAG_VIEW)
+    {
+        bitmap_close_view(bm);
+
+        return;
+    }
+
+    bitmap_rank_disable(bm);
+    bm->bm_self= NULL;
+
+    /* Caller-owned storage from bitmap_init is left to the caller */
+    if ((bm->flags & BITMAP_FLAG_EXTERNAL) == 0)
+    {
+        bitmap_pool_free(bm);
+    }
+
+    return;
+}
+
+static bool bitmap_check(struct bitmap *bm)
+{
+    if (bm != NULL && bm == bm->bm_self)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+static bool bitmap_check_writable(struct bitmap *bm)
+{
+    return bitmap_check(bm) && (bm->flags & BITMAP_FLAG_READONLY) == 0;
+}
+
+bool bitmap_is_valid(struct bitmap *bm)
+{
+    return bitmap_check(bm);
+}
+
+bool bitmap_set_lazy(struct bitmap *bm, bool lazy)
+{
+    if (!bitmap_check(bm))
+    {
+        return false;
+    }
+
+    if (lazy)
+    {
+        bm->flags |= BITMAP_FLAG_LAZY;
+    }
+    else
+    {
+        bitmap_refresh(bm);
+        bm->flags &= ~BITMAP_FLAG_LAZY;
+    }
+
+    BITMAP_STAT_COUNT(BITMAP_STAT_SET_LAZY, 0, 0);
+
+    return true;
+}
+
+u16 bitmap_cardinality(struct bitmap *bm)
+{
+    if (!bitmap_check(bm))
+    {
+        return 0;
+    }
+
+    bitmap_refresh(bm);
+    BITMAP_STAT_COUNT(BITMAP_STAT_CARDINALITY, 0, 0);
+
+    return bm->numbers;
+}
+
+u16 bitmap_first(struct bitmap *bm)
+{
+    if (!bitmap_check(bm))
+    {
+        return 0;
+    }
+
+    bitmap_refresh(bm);
+    BITMAP_STAT_COUNT(BITMAP_STAT_FIRST, 0, 0);
+
+    return bm->first_value;
+}
+
+u16 bitmap_last(struct bitmap *bm)
+{
+    if (!bitmap_check(bm))
+    {
+        return 0;
+    }
+
+    bitmap_refresh(bm);
+    BITMAP_STAT_COUNT(BITMAP_STAT_LAST, 0, 0);
+
+    return bm->last_value;
+}
+
+static void mask_tail_bits(struct bitmap *bm)
+{
+    u32 used_bits = bm->max_value & UINT_MASK;
+
+    if (used_bits != 0)
+    {
+        bm->buf[bm->buf_len - 1] &= (1U << used_bits) - 1;
+    }
+
+    return;
+}
+
+bool bitmap_add_value(struct bitmap *bm, u16 value)
+{
+    bool added = false;
+
+    if (!bitmap_check_writable(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    added = !is_value_set(bm, value);
+
+    if (added)
+    {
+        set_value(bm, value);
+        bm->numbers++;
+        bitmap_rank_update(bm, value, true);
+
+        if (bm->first_value == 0 || value < bm->first_value)
+        {
+            bm->first_value = value;
+        }
+
+        if (value > bm->last_value)
+        {
+            bm->last_value = value;
+        }
+    }
+
+    BITMAP_STAT_COUNT(BITMAP_STAT_ADD_VALUE, added, 1);
+
+    return true;
+}
+
+bool bitmap_del_value(struct bitmap *bm, u16 value)
+{
+    bool removed = false;
+
+    if (!bitmap_check_writable(bm) || value == 0 || value > bm->max_value)
+    {
+        return false;
+    }
+
+    removed = is_value_set(bm, value);
+
+    if (removed)
+    {
+        clear_value(bm, value);
+        bm->numbers--;
+        bitmap_rank_update(bm, value, false);
+
+        /* Nothing is set below the old first value or above the old last one, resume from there.
+           The bounds of a stale bitmap stay valid as they are */
+        if (value == bm->first_value && (bm->flags & BITMAP_FLAG_DIRTY) == 0)
+        {
+            bm->first_value = bitmap_next_value(bm, value);
+        }
+
+        if (value == bm->last_value && (bm->flags & BITMAP_FLAG_DIRTY) == 0)
+        {
+            bm->last_value = bitmap_prev_value(bm, value);
+        }
+    }
+
+    BITMAP_STAT_COUNT(BITMAP_STAT_DEL_VALUE, removed, 1);
+
+    return removed;
+}
+
+bool bitmap_add_range(struct bitmap *bm, u16 lo, u16 hi)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 lo_index = 0;
+    u16 hi_index = 0;
+    u32 lo_mask = 0;
+    u32 hi_mask = 0;
+    u16 added = 0;
+
+    if (!bitmap_check_writable(bm) || lo == 0 || lo > hi || hi > bm->max_value)
+    {
+        return false;
+    }
+
+    /* numbers of a stale bitmap is recomputed later anyway */
+    if ((bm->flags & BITMAP_FLAG_DIRTY) == 0)
+    {
+        added = (u16)(hi - lo + 1 - bitmap_cardinality_range(bm, lo, hi));
+    }
+
+    get_index_and_mask(lo, &lo_index, &lo_mask);
+    get_index_and_mask(hi, &hi_index, &hi_mask);
+    lo_mask = ~(lo_mask - 1);
+    hi_mask = hi_mask | (hi_mask - 1);
+
+    /* Only the two edge words need masking, everything between them is filled whole */
+    if (lo_index == hi_index)
+    {
+        bm->buf[lo_index] |= lo_mask & hi_mask;
+    }
+    else
+    {
+        bm->buf[lo_index] |= lo_mask;
+        memset(bm->buf + lo_index + 1, 0xFF, (size_t)(hi_index - lo_index - 1) * sizeof(u32));
+        bm->buf[hi_index] |= hi_mask;
+    }
+
+    bm->numbers += added;
+    bitmap_rank_invalidate(bm);
+
+    if (bm->first_value == 0 || lo < bm->first_value)
+    {
+        bm->first_value = lo;
+    }
+
+    if (hi > bm->last_value)
+    {
+        bm->last_value = hi;
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_ADD_RANGE, added, hi_index - lo_index + 1, stat_start);
+
+    return true;
+}
+
+bool bitmap_del_range(struct bitmap *bm, u16 lo, u16 hi)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 lo_index = 0;
+    u16 hi_index = 0;
+    u32 lo_mask = 0;
+    u32 hi_mask = 0;
+    u16 removed = 0;
+
+    if (!bitmap_check_writable(bm) || lo == 0 || lo > hi || hi > bm->max_value)
+    {
+        return false;
+    }
+
+    if ((bm->flags & BITMAP_FLAG_DIRTY) == 0)
+    {
+        removed = bitmap_cardinality_range(bm, lo, hi);
+    }
+
+    if (removed == 0 && (bm->flags & BITMAP_FLAG_DIRTY) == 0)
+    {
+        BITMAP_STAT_TIMED(BITMAP_STAT_DEL_RANGE, 0, 0, stat_start);
+
+        return true;
+    }
+
+    get_index_and_mask(lo, &lo_index, &lo_mask);
+    get_index_and_mask(hi, &hi_index, &hi_mask);
+    lo_mask = ~(lo_mask - 1);
+    hi_mask = hi_mask | (hi_mask - 1);
+
+    if (lo_index == hi_index)
+    {
+        bm->buf[lo_index] &= ~(lo_mask & hi_mask);
+    }
+    else
+    {
+        bm->buf[lo_index] &= ~lo_mask;
+        memset(bm->buf + lo_index + 1, 0, (size_t)(hi_index - lo_index - 1) * sizeof(u32));
+        bm->buf[hi_index] &= ~hi_mask;
+    }
+
+    bm->numbers -= removed;
+    bitmap_rank_invalidate(bm);
+
+    /* A bound that fell inside the range moves to the first survivor beyond it */
+    if ((bm->flags & BITMAP_FLAG_DIRTY) == 0 && bm->first_value >= lo && bm->first_value <= hi)
+    {
+        bm->first_value = hi == bm->max_value ? 0 : bitmap_next_value(bm, hi + 1);
+    }
+
+    if ((bm->flags & BITMAP_FLAG_DIRTY) == 0 && bm->last_value >= lo && bm->last_value <= hi)
+    {
+        bm->last_value = bitmap_prev_value(bm, lo - 1);
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_DEL_RANGE, removed, hi_index - lo_index + 1, stat_start);
+
+    return true;
+}
+
+/* Branch free min/max, the compiler vectorizes this loop */
+static bool batch_bounds(struct bitmap *bm, const u16 *vals, u32 n, u16 *lo, u16 *hi)
+{
+    u16 min = U16_MAX;
+    u16 max = 0;
+    u32 i = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        min = vals[i] < min ? vals[i] : min;
+        max = vals[i] > max ? vals[i] : max;
+    }
+
+    *lo = min;
+    *hi = max;
+
+    return min != 0 && max <= bm->max_value;
+}
+
+u32 bitmap_add_many(struct bitmap *bm, const u16 *vals, u32 n)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 lo = 0;
+    u16 hi = 0;
+    u32 index = 0;
+    u32 mask = 0;
+    u32 added = 0;
+    u32 words = 0;
+    u32 i = 0;
+
+    if (!bitmap_check_writable(bm) || vals == NULL || n == 0 || !batch_bounds(bm, vals, n, &lo, &hi))
+    {
+        return 0;
+    }
+
+    /* Gather the bits of each run of values in one word, so sorted input costs one store per word */
+    while (i < n)
+    {
+        index = (u32)(vals[i] - 1) >> UINT_SHIFT;
+        mask = 0;
+
+        do
+        {
+            mask |= 1U << ((vals[i] - 1) & UINT_MASK);
+            i++;
+        } while (i < n && ((u32)(vals[i] - 1) >> UINT_SHIFT) == index);
+
+        added += popcount32(mask & ~bm->buf[index]);
+        bm->buf[index] |= mask;
+        words++;
+    }
+
+    /* Every value of the batch is set now, so its bounds are set values */
+    if (added != 0)
+    {
+        bm->numbers += added;
+        bitmap_rank_invalidate(bm);
+
+        if (bm->first_value == 0 || lo < bm->first_value)
+        {
+            bm->first_value = lo;
+        }
+
+        if (hi > bm->last_value)
+        {
+            bm->last_value = hi;
+        }
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_ADD_MANY, added, words, stat_start);
+
+    return added;
+}
+
+u32 bitmap_del_many(struct bitmap *bm, const u16 *vals, u32 n)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 lo = 0;
+    u16 hi = 0;
+    u32 index = 0;
+    u32 mask = 0;
+    u32 removed = 0;
+    u32 words = 0;
+    u32 i = 0;
+
+    if (!bitmap_check_writable(bm) || vals == NULL || n == 0 || !batch_bounds(bm, vals, n, &lo, &hi))
+    {
+        return 0;
+    }
+
+    while (i < n)
+    {
+        index = (u32)(vals[i] - 1) >> UINT_SHIFT;
+        mask = 0;
+
+        do
+        {
+            mask |= 1U << ((vals[i] - 1) & UINT_MASK);
+            i++;
+        } while (i < n && ((u32)(vals[i] - 1) >> UINT_SHIFT) == index);
+
+        removed += popcount32(mask & bm->buf[index]);
+        bm->buf[index] &= ~mask;
+        words++;
+    }
+
+    if (removed != 0)
+    {
+        bm->numbers -= removed;
+        bitmap_rank_invalidate(bm);
+    }
+
+    /* Nothing is set outside the old bounds, so each scan resumes from the bound it replaces.
+       The bounds of a stale bitmap stay valid as they are */
+    if (removed != 0 && (bm->flags & BITMAP_FLAG_DIRTY) == 0)
+    {
+        if (bm->numbers == 0)
+        {
+            bm->first_value = 0;
+            bm->last_value = 0;
+        }
+        else
+        {
+            if (!is_value_set(bm, bm->first_value))
+            {
+                bm->first_value = bitmap_next_value(bm, bm->first_value);
+            }
+
+            if (!is_value_set(bm, bm->last_value))
+            {
+                bm->last_value = bitmap_prev_value(bm, bm->last_value);
+            }
+        }
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_DEL_MANY, removed, words, stat_start);
+
+    return removed;
+}
+
+bool bitmap_iter_init(struct bitmap_iter *it, struct bitmap *bm)
+{
+    if (it == NULL || !bitmap_check(bm))
+    {
+        return false;
+    }
+
+    it->bm = bm;
+    it->index = bm->buf_len;
+    it->word = 0;
+
+    /* Words below the one holding first_value are known to be zero, also for a stale lower bound */
+    if (bm->last_value != 0)
+    {
+        it->index = (u16)((bm->first_value - 1) >> UINT_SHIFT);
+        it->word = bm->buf[it->index];
+    }
+
+    BITMAP_STAT_COUNT(BITMAP_STAT_ITER_INIT, 0, bm->last_value != 0);
+
+    return true;
+}
+
+bool bitmap_iter_next(struct bitmap_iter *it, u16 *value)
+{
+    u32 words = 0;
+
+    while (it->word == 0)
+    {
+        if (it->index + 1 >= it->bm->buf_len)
+        {
+            it->index = it->bm->buf_len;
+            BITMAP_STAT_COUNT(BITMAP_STAT_ITER_NEXT, 0, words);
+
+            return false;
+        }
+
+        it->word = it->bm->buf[++it->index];
+        words++;
+    }
+
+    BITMAP_STAT_COUNT(BITMAP_STAT_ITER_NEXT, 0, words);
+
+    *value = (u16)((it->index << UINT_SHIFT) + ctz32(it->word) + 1);
+
+    /* Clear the lowest set bit, the one just returned */
+    it->word &= it->word - 1;
+
+    return true;
+}
+
+u32 bitmap_to_array(struct bitmap *bm, u16 *out, u32 n)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u32 count = 0;
+    u32 index = 0;
+    u32 word = 0;
+
+    if (!bitmap_check(bm) || out == NULL || bm->last_value == 0)
+    {
+        return 0;
+    }
+
+    for (index = (u32)(bm->first_value - 1) >> UINT_SHIFT; index < bm->buf_len && count < n; index++)
+    {
+        for (word = bm->buf[index]; word != 0 && count < n; word &= word - 1)
+        {
+            out[count++] = (u16)((index << UINT_SHIFT) + ctz32(word) + 1);
+        }
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_TO_ARRAY, 0, index - ((u32)(bm->first_value - 1) >> UINT_SHIFT), stat_start);
+
+    return count;
+}
+
+/* Last value of the run of set values beginning at start, all-ones words are skipped whole */
+static u16 run_end(struct bitmap *bm, u16 start)
+{
+    u16 index = 0;
+    u32 mask = 0;
+    u32 word = 0;
+    u32 end = 0;
+
+    get_index_and_mask(start, &index, &mask);
+    word = ~bm->buf[index] & ~(mask - 1);
+
+    while (word == 0)
+    {
+        if (++index >= bm->buf_len)
+        {
+            return bm->max_value;
+        }
+
+        word = ~bm->buf[index];
+    }
+
+    /* The first clear bit sits at 0-based position end, so the run ends at value end */
+    end = ((u32)index << UINT_SHIFT) + ctz32(word);
+
+    return end > bm->max_value ? bm->max_value : (u16)end;
+}
+
+/* Decimal digits of value without stdio or the locale, returns the number of chars written */
+static u32 format_u16(char *out, u16 value)
+{
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char tmp[5];
+    u32 pos = sizeof(tmp);
+    u32 len = 0;
+
+    while (value >= 100)
+    {
+        pos -= 2;
+        memcpy(tmp + pos, pairs + (value % 100) * 2, 2);
+        value /= 100;
+    }
+
+    if (value >= 10)
+    {
+        pos -= 2;
+        memcpy(tmp + pos, pairs + value * 2, 2);
+    }
+    else
+    {
+        tmp[--pos] = (char)('0' + value);
+    }
+
+    len = sizeof(tmp) - pos;
+    memcpy(out, tmp + pos, len);
+
+    return len;
+}
+
+bool bitmap_format_sink(struct bitmap *bm, bitmap_sink_fn sink, void *ctx)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    char chunk[BITMAP_FORMAT_CHUNK];
+    bool ok = true;
+    u32 len = 0;
+    u16 start = 0;
+    u16 end = 0;
+
+    if (!bitmap_check(bm) || sink == NULL)
+    {
+        return false;
+    }
+
+    /* Runs start at set values, a stale lower bound would not be one */
+    bitmap_refresh(bm);
+
+    for (start = bm->first_value; start != 0; start = end >= bm->max_value ? 0 : bitmap_next_value(bm, end + 1))
+    {
+        end = run_end(bm, start);
+
+        /* Room for ", 65535-65535" */
+        if (len + 14 > sizeof(chunk))
+        {
+            if (!sink(ctx, chunk, len))
+            {
+                ok = false;
+                break;
+            }
+
+            len = 0;
+        }
+
+        if (start != bm->first_value)
+        {
+            chunk[len++] = ',';
+            chunk[len++] = ' ';
+        }
+
+        len += format_u16(chunk + len, start);
+
+        if (start != end)
+        {
+            chunk[len++] = '-';
+            len += format_u16(chunk + len, end);
+        }
+    }
+
+    if (ok && len != 0)
+    {
+        ok = sink(ctx, chunk, len);
+    }
+
+    /* The scans between runs are counted by bitmap_next_value */
+    BITMAP_STAT_TIMED(BITMAP_STAT_FORMAT, 0, 0, stat_start);
+
+    return ok;
+}
+
+/* Copies what fits into buf and counts the rest */
+static bool buffer_sink(void *ctx, const char *data, size_t len)
+{
+    struct format_buffer *out = (struct format_buffer *)ctx;
+    size_t room = 0;
+
+    if (out->len + 1 < out->cap)
+    {
+        room = out->cap - 1 - out->len;
+        memcpy(out->buf + out->len, data, len < room ? len : room);
+    }
+
+    out->len += len;
+
+    return true;
+}
+
+size_t bitmap_format(struct bitmap *bm, char *buf, size_t cap)
+{
+    struct format_buffer out;
+
+    out.buf = buf;
+    out.cap = buf == NULL ? 0 : cap;
+    out.len = 0;
+
+    bitmap_format_sink(bm, buffer_sink, &out);
+
+    if (out.cap != 0)
+    {
+        buf[out.len < out.cap ? out.len : out.cap - 1] = '\0';
+    }
+
+    return out.len;
+}
+
+static bool stdout_sink(void *ctx, const char *data, size_t len)
+{
+    (void)ctx;
+
+    return fwrite(data, 1, len, stdout) == len;
+}
+
+void bitmap_print(struct bitmap *bm)
+{
+    u64 stat_start = BITMAP_STAT_START();
+
+    if (bitmap_cardinality(bm) == 0)
+    {
+        puts("Empty bitmap");
+
+        return;
+    }
+
+    bitmap_format_sink(bm, stdout_sink, NULL);
+    puts("\n");
+    BITMAP_STAT_TIMED(BITMAP_STAT_PRINT, 0, 0, stat_start);
+
+    return;
+}
+
+struct bitmap *bitmap_clone(struct bitmap *bm)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    struct bitmap *new_bm = NULL;
+
+    if (!bitmap_check(bm))
+    {
+        return NULL;
+    }
+
+    new_bm = bitMap_create(bm->max_value);
+
+    /* The copy keeps the metadata mode of the original */
+    if (new_bm != NULL)
+    {
+        new_bm->flags |= bm->flags & BITMAP_FLAG_LAZY;
+    }
+
+    if (!bitmap_clone_into(new_bm, bm))
+    {
+        bitmap_destroy(new_bm);
+
+        return NULL;
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_CLONE, bm->numbers, 0, stat_start);
+
+    return new_bm;
+}
+
+bool bitmap_clone_into(struct bitmap *dst, struct bitmap *src)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 old_numbers = 0;
+    u16 words = 0;
+
+    if (!bitmap_check_writable(dst) || !bitmap_check(src))
+    {
+        return false;
+    }
+
+    /* A stale upper bound must not reject a src whose values do fit */
+    if (src->last_value > dst->max_value)
+    {
+        bitmap_refresh(src);
+    }
+
+    if (src->last_value > dst->max_value)
+    {
+        return false;
+    }
+
+    if (dst == src)
+    {
+        return true;
+    }
+
+    old_numbers = dst->numbers;
+    words = dst->buf_len < src->buf_len ? dst->buf_len : src->buf_len;
+    memcpy(dst->buf, src->buf, (size_t)words * sizeof(u32));
+    memset(dst->buf + words, 0, (size_t)(dst->buf_len - words) * sizeof(u32));
+
+    /* src may be the larger one, its words above dst->max_value hold no set values anyway */
+    mask_tail_bits(dst);
+    dst->numbers = src->numbers;
+    dst->flags &= ~BITMAP_FLAG_DIRTY;
+
+    /* Stale bounds of src are bounds of the copy too */
+    if (src->flags & BITMAP_FLAG_DIRTY)
+    {
+        refresh_after_bulk(dst, src->first_value, src->last_value);
+    }
+    else
+    {
+        dst->first_value = src->first_value;
+        dst->last_value = src->last_value;
+        bitmap_rank_invalidate(dst);
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_CLONE_INTO, BITMAP_STAT_DELTA(old_numbers, dst), dst->buf_len, stat_start);
+
+    return true;
+}
+
+bool bitmap_not(struct bitmap *bm)
+{
+    u64 stat_start = BITMAP_STAT_START();
+
+    if (!bitmap_check_writable(bm))
+    {
+        return false;
+    }
+
+    word_ops_get()->not_words(bm->buf, (size_t)bm->buf_len * sizeof(u32));
+
+    /* If the buffer length doesn't matches the word size then extra bits need to set*/
+    mask_tail_bits(bm);
+
+    refresh_after_bulk(bm, 1, bm->max_value);
+    BITMAP_STAT_TIMED(BITMAP_STAT_NOT, bm->max_value, bm->buf_len, stat_start);
+
+    return true;
+}
+
+bool bitmap_or(struct bitmap *bm_store, struct bitmap *bm)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 old_numbers = 0;
+    u16 words = 0;
+    u16 first_hint = 0;
+    u16 last_hint = 0;
+
+    if (!bitmap_check(bm) || !bitmap_check_writable(bm_store))
+    {
+        return false;
+    }
+
+    old_numbers = bm_store->numbers;
+    bounds_union(bm_store, bm, &first_hint, &last_hint);
+
+    /* Only the words both bitmaps own take part, bm has no bits beyond its buffer */
+    words = bm_store->buf_len < bm->buf_len ? bm_store->buf_len : bm->buf_len;
+    word_ops_get()->or_words(bm_store->buf, bm->buf, (size_t)words * sizeof(u32));
+
+    if (bm_store->max_value < bm->max_value)
+    {
+        /*Set the extra bits in bm_store to 0 in the last buffer element*/
+        mask_tail_bits(bm_store);
+    }
+
+    refresh_after_bulk(bm_store, first_hint, last_hint);
+    BITMAP_STAT_TIMED(BITMAP_STAT_OR, BITMAP_STAT_DELTA(old_numbers, bm_store), words, stat_start);
+
+    return true;
+}
+
+bool bitmap_and(struct bitmap *bm_store, struct bitmap *bm)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 old_numbers = 0;
+    u16 words = 0;
+    u16 first_hint = 0;
+    u16 last_hint = 0;
+
+    if (!bitmap_check(bm) || !bitmap_check_writable(bm_store))
+    {
+        return false;
+    }
+
+    old_numbers = bm_store->numbers;
+    bounds_intersect(bm_store, bm, &first_hint, &last_hint);
+
+    words = bm_store->buf_len < bm->buf_len ? bm_store->buf_len : bm->buf_len;
+    word_ops_get()->and_words(bm_store->buf, bm->buf, (size_t)words * sizeof(u32));
+
+    if (bm_store->max_value > bm->max_value)
+    {
+        memset(bm_store->buf + words, 0, (bm_store->buf_len - words) * sizeof(u32));
+    }
+
+    refresh_after_bulk(bm_store, first_hint, last_hint);
+    BITMAP_STAT_TIMED(BITMAP_STAT_AND, BITMAP_STAT_DELTA(old_numbers, bm_store), bm_store->buf_len, stat_start);
+
+    return true;
+}
+
+/* The union can not start before the lower of both first values or end after the higher last value */
+static void bounds_union(struct bitmap *bm_a, struct bitmap *bm_b, u16 *first, u16 *last)
+{
+    *first = bm_a->first_value;
+    *last = bm_a->last_value > bm_b->last_value ? bm_a->last_value : bm_b->last_value;
+
+    if (bm_b->first_value != 0 && (*first == 0 || bm_b->first_value < *first))
+    {
+        *first = bm_b->first_value;
+    }
+
+    return;
+}
+
+/* The intersection lies inside the bounds of both bitmaps, last_value 0 means one of them is empty */
+static void bounds_intersect(struct bitmap *bm_a, struct bitmap *bm_b, u16 *first, u16 *last)
+{
+    *first = bm_a->first_value > bm_b->first_value ? bm_a->first_value : bm_b->first_value;
+    *last = bm_a->last_value < bm_b->last_value ? bm_a->last_value : bm_b->last_value;
+
+    return;
+}
+
+static struct bitmap *bitmap_op_new(struct bitmap *bm_a, struct bitmap *bm_b, struct bitmap *bm_result, u8 op)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    const struct word_ops *ops = word_ops_get();
+    struct bitmap *result = bm_result;
+    u16 old_numbers = 0;
+    u16 words = 0;
+    u16 first_hint = 0;
+    u16 last_hint = 0;
+
+    if (!bitmap_check(bm_a) || !bitmap_check(bm_b) || (bm_result == bm_b && bm_result != bm_a))
+    {
+        return NULL;
+    }
+
+    if (result == NULL)
+    {
+        result = bitMap_create(bm_a->max_value);
+    }
+
+    if (!bitmap_check_writable(result) || result->max_value != bm_a->max_value)
+    {
+        return NULL;
+    }
+
+    /* Taken before result, which may be bm_a, is rewritten. A \ B stays inside the bounds of A */
+    old_numbers = bm_a->numbers;
+    first_hint = bm_a->first_value;
+    last_hint = bm_a->last_value;
+
+    if (op == BITMAP_OP_AND)
+    {
+        bounds_intersect(bm_a, bm_b, &first_hint, &last_hint);
+    }
+    else if (op == BITMAP_OP_OR || op == BITMAP_OP_XOR)
+    {
+        bounds_union(bm_a, bm_b, &first_hint, &last_hint);
+    }
+
+    if (result != bm_a)
+    {
+        memcpy(result->buf, bm_a->buf, (size_t)bm_a->buf_len * sizeof(u32));
+    }
+
+    words = bm_a->buf_len < bm_b->buf_len ? bm_a->buf_len : bm_b->buf_len;
+
+    switch (op)
+    {
+        case BITMAP_OP_AND:
+            ops->and_words(result->buf, bm_b->buf, (size_t)words * sizeof(u32));
+            memset(result->buf + words, 0, (size_t)(result->buf_len - words) * sizeof(u32));
+            break;
+        case BITMAP_OP_OR:
+            ops->or_words(result->buf, bm_b->buf, (size_t)words * sizeof(u32));
+            break;
+        case BITMAP_OP_XOR:
+            ops->xor_words(result->buf, bm_b->buf, (size_t)words * sizeof(u32));
+            break;
+        default:
+            ops->andnot_words(result->buf, bm_b->buf, (size_t)words * sizeof(u32));
+            break;
+    }
+
+    /* Bits bm_b holds above the result's max_value must not leak into its last word */
+    if ((op == BITMAP_OP_OR || op == BITMAP_OP_XOR) && bm_a->max_value < bm_b->max_value)
+    {
+        mask_tail_bits(result);
+    }
+
+    refresh_after_bulk(result, first_hint, last_hint);
+
+    /* BITMAP_STAT_AND_NEW .. BITMAP_STAT_ANDNOT_NEW follow the order of enum bitmap_op */
+    BITMAP_STAT_TIMED(BITMAP_STAT_AND_NEW + op - BITMAP_OP_AND, BITMAP_STAT_DELTA(old_numbers, result), result->buf_len, stat_start);
+
+    return result;
+}
+
+struct bitmap *bitmap_and_new(struct bitmap *bm_a, struct bitmap *bm_b, struct bitmap *bm_result)
+{
+    return bitmap_op_new(bm_a, bm_b, bm_result, BITMAP_OP_AND);
+}
+
+struct bitmap *bitmap_or_new(struct bitmap *bm_a, struct bitmap *bm_b, struct bitmap *bm_result)
+{
+    return bitmap_op_new(bm_a, bm_b, bm_result, BITMAP_OP_OR);
+}
+
+struct bitmap *bitmap_xor_new(struct bitmap *bm_a, struct bitmap *bm_b, struct bitmap *bm_result)
+{
+    return bitmap_op_new(bm_a, bm_b, bm_result, BITMAP_OP_XOR);
+}
+
+struct bitmap *bitmap_andnot_new(struct bitmap *bm_a, struct bitmap *bm_b, struct bitmap *bm_result)
+{
+    return bitmap_op_new(bm_a, bm_b, bm_result, BITMAP_OP_ANDNOT);
+}
+
+u16 bitmap_and_cardinality(struct bitmap *bm_a, struct bitmap *bm_b)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    const struct word_ops *ops = word_ops_get();
+    u32 block[BITMAP_BLOCK_WORDS];
+    u32 lo_index = 0;
+    u32 hi_index = 0;
+    u32 span = 0;
+    u32 words = 0;
+    u64 count = 0;
+
+    if (!bitmap_check(bm_a) || !bitmap_check(bm_b))
+    {
+        return 0;
+    }
+
+    /* Stale bounds still enclose the set values, so only last_value is trusted to mean empty */
+    if (bm_a->last_value == 0 || bm_b->last_value == 0)
+    {
+        BITMAP_STAT_TIMED(BITMAP_STAT_AND_CARDINALITY, 0, 0, stat_start);
+
+        return 0;
+    }
+
+    /* Only the words between the larger first value and the smaller last value can overlap */
+    lo_index = (u32)((bm_a->first_value > bm_b->first_value ? bm_a->first_value : bm_b->first_value) - 1) >> UINT_SHIFT;
+    hi_index = (u32)((bm_a->last_value < bm_b->last_value ? bm_a->last_value : bm_b->last_value) - 1) >> UINT_SHIFT;
+    span = lo_index <= hi_index ? hi_index - lo_index + 1 : 0;
+
+    for (; lo_index <= hi_index; lo_index += words)
+    {
+        words = hi_index - lo_index + 1 < BITMAP_BLOCK_WORDS ? hi_index - lo_index + 1 : BITMAP_BLOCK_WORDS;
+        memcpy(block, bm_a->buf + lo_index, words * sizeof(u32));
+        ops->and_words(block, bm_b->buf + lo_index, words * sizeof(u32));
+        count += popcount_buf(block, words * sizeof(u32));
+    }
+
+    /* Both inputs are read over the overlap */
+    BITMAP_STAT_TIMED(BITMAP_STAT_AND_CARDINALITY, 0, 2 * span, stat_start);
+
+    return (u16)count;
+}
+
+u16 bitmap_or_cardinality(struct bitmap *bm_a, struct bitmap *bm_b)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 count = 0;
+
+    if (!bitmap_check(bm_a) || !bitmap_check(bm_b))
+    {
+        return 0;
+    }
+
+    /* |A| + |B| - |A & B|, with B cut down to the max_value of A like bitmap_or does */
+    count = (u16)(bitmap_cardinality(bm_a) + bitmap_cardinality_range(bm_b, 1, bm_a->max_value) - bitmap_and_cardinality(bm_a, bm_b));
+    BITMAP_STAT_TIMED(BITMAP_STAT_OR_CARDINALITY, 0, 0, stat_start);
+
+    return count;
+}
+
+bool bitmap_intersects(struct bitmap *bm_a, struct bitmap *bm_b)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u32 lo_index = 0;
+    u32 hi_index = 0;
+    u32 words = 0;
+    bool found = false;
+
+    if (!bitmap_check(bm_a) || !bitmap_check(bm_b))
+    {
+        return false;
+    }
+
+    if (bm_a->last_value == 0 || bm_b->last_value == 0)
+    {
+        BITMAP_STAT_TIMED(BITMAP_STAT_INTERSECTS, 0, 0, stat_start);
+
+        return false;
+    }
+
+    lo_index = (u32)((bm_a->first_value > bm_b->first_value ? bm_a->first_value : bm_b->first_value) - 1) >> UINT_SHIFT;
+    hi_index = (u32)((bm_a->last_value < bm_b->last_value ? bm_a->last_value : bm_b->last_value) - 1) >> UINT_SHIFT;
+
+    for (; lo_index <= hi_index && !found; lo_index++)
+    {
+        found = (bm_a->buf[lo_index] & bm_b->buf[lo_index]) != 0;
+        words += 2;
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_INTERSECTS, 0, words, stat_start);
+
+    return found;
+}
+
+static bool block_is_zero(const u32 *block, u32 words)
+{
+    u32 bits = 0;
+    u32 i = 0;
+
+    for (i = 0; i < words; i++)
+    {
+        bits |= block[i];
+    }
+
+    return bits == 0;
+}
+
+static void refresh_after_bulk(struct bitmap *bm, u16 first_hint, u16 last_hint)
+{
+    bitmap_rank_invalidate(bm);
+
+    /* A stale bitmap keeps its bounds in first_value/last_value, last_value 0 means empty */
+    if (last_hint > bm->max_value)
+    {
+        last_hint = bm->max_value;
+    }
+
+    bm->first_value = last_hint == 0 ? 0 : (first_hint == 0 ? 1 : first_hint);
+    bm->last_value = last_hint;
+    bm->flags |= BITMAP_FLAG_DIRTY;
+
+    if ((bm->flags & BITMAP_FLAG_LAZY) == 0)
+    {
+        bitmap_refresh(bm);
+    }
+
+    return;
+}
+
+static void bitmap_refresh(struct bitmap *bm)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    u16 lo = bm->first_value;
+    u16 hi = bm->last_value;
+
+    if ((bm->flags & BITMAP_FLAG_DIRTY) == 0)
+    {
+        return;
+    }
+
+    bm->flags &= ~BITMAP_FLAG_DIRTY;
+    bm->numbers = hi == 0 || lo > hi ? 0 : bitmap_cardinality_range(bm, lo, hi);
+
+    if (bm->numbers == 0)
+    {
+        bm->first_value = 0;
+        bm->last_value = 0;
+    }
+    else
+    {
+        bm->first_value = bitmap_next_value(bm, lo);
+        bm->last_value = bitmap_prev_value(bm, hi);
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_REFRESH, 0, 0, stat_start);
+
+    return;
+}
+
+bool bitmap_or_many(struct bitmap *bm_out, struct bitmap **bms, u32 k)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    const struct word_ops *ops = word_ops_get();
+    u32 block[BITMAP_BLOCK_WORDS];
+    u64 scanned = 0;
+    u16 old_numbers = 0;
+    u16 first_hint = 0;
+    u16 last_hint = 0;
+    u32 start = 0;
+    u32 words = 0;
+    u32 avail = 0;
+    u32 lo_index = 0;
+    u32 hi_index = 0;
+    u32 j = 0;
+
+    if (!bitmap_check_writable(bm_out) || bms == NULL)
+    {
+        return false;
+    }
+
+    for (j = 0; j < k; j++)
+    {
+        if (!bitmap_check(bms[j]))
+        {
+            return false;
+        }
+
+        if (bms[j]->last_value != 0)
+        {
+            first_hint = first_hint == 0 || bms[j]->first_value < first_hint ? bms[j]->first_value : first_hint;
+            last_hint = bms[j]->last_value > last_hint ? bms[j]->last_value : last_hint;
+        }
+    }
+
+    /* One pass over out, every input is folded into an L1-sized block before it is stored */
+    for (start = 0; start < bm_out->buf_len; start += words)
+    {
+        words = bm_out->buf_len - start < BITMAP_BLOCK_WORDS ? bm_out->buf_len - start : BITMAP_BLOCK_WORDS;
+        memset(block, 0, words * sizeof(u32));
+
+        for (j = 0; j < k; j++)
+        {
+            if (bms[j]->last_value == 0)
+            {
+                continue;
+            }
+
+            /* Skip inputs whose set words all lie outside this block */
+            lo_index = (u32)(bms[j]->first_value - 1) >> UINT_SHIFT;
+            hi_index = (u32)(bms[j]->last_value - 1) >> UINT_SHIFT;
+
+            if (hi_index < start || lo_index >= start + words)
+            {
+                continue;
+            }
+
+            avail = bms[j]->buf_len - start < words ? bms[j]->buf_len - start : words;
+            ops->or_words(block, bms[j]->buf + start, avail * sizeof(u32));
+            scanned += avail;
+        }
+
+        memcpy(bm_out->buf + start, block, words * sizeof(u32));
+        scanned += words;
+    }
+
+    old_numbers = bm_out->numbers;
+    mask_tail_bits(bm_out);
+    refresh_after_bulk(bm_out, first_hint, last_hint);
+    BITMAP_STAT_TIMED(BITMAP_STAT_OR_MANY, BITMAP_STAT_DELTA(old_numbers, bm_out), scanned, stat_start);
+
+    return true;
+}
+
+bool bitmap_and_many(struct bitmap *bm_out, struct bitmap **bms, u32 k)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    const struct word_ops *ops = word_ops_get();
+    u32 block[BITMAP_BLOCK_WORDS];
+    u64 scanned = 0;
+    u16 old_numbers = 0;
+    struct bitmap *order_stack[BITMAP_MANY_STACK];
+    struct bitmap **order = order_stack;
+    u32 lo_index = 0;
+    u32 hi_index = 0;
+    u32 start = 0;
+    u32 words = 0;
+    u32 i = 0;
+    u32 j = 0;
+
+    if (!bitmap_check_writable(bm_out) || bms == NULL || k == 0)
+    {
+        return false;
+    }
+
+    /* Typical fan-in fits on the stack, only very wide queries allocate */
+    if (k > BITMAP_MANY_STACK)
+    {
+        order = (struct bitmap **)malloc(k * sizeof(struct bitmap *));
+
+        if (order == NULL)
+        {
+            return false;
+        }
+    }
+
+    lo_index = 0;
+    hi_index = bm_out->buf_len - 1;
+
+    for (j = 0; j < k; j++)
+    {
+        if (!bitmap_check(bms[j]))
+        {
+            if (order != order_stack)
+            {
+                free(order);
+            }
+
+            return false;
+        }
+
+        /* Insertion sort by numbers so the sparsest inputs empty a block first, a stale count only costs speed */
+        for (i = j; i > 0 && order[i - 1]->numbers > bms[j]->numbers; i--)
+        {
+            order[i] = order[i - 1];
+        }
+
+        order[i] = bms[j];
+
+        /* Nothing can survive outside the overlap of every input's first/last words */
+        if (bms[j]->last_value == 0)
+        {
+            hi_index = 0;
+            lo_index = 1;
+        }
+        else
+        {
+            start = (u32)(bms[j]->first_value - 1) >> UINT_SHIFT;
+            words = (u32)(bms[j]->last_value - 1) >> UINT_SHIFT;
+            lo_index = start > lo_index ? start : lo_index;
+            hi_index = words < hi_index ? words : hi_index;
+        }
+    }
+
+    /* out may be one of the inputs, so its words are only written after they have been read */
+    for (start = lo_index; start <= hi_index; start += words)
+    {
+        words = hi_index - start + 1 < BITMAP_BLOCK_WORDS ? hi_index - start + 1 : BITMAP_BLOCK_WORDS;
+        memcpy(block, order[0]->buf + start, words * sizeof(u32));
+
+        for (j = 1; j < k && !block_is_zero(block, words); j++)
+        {
+            ops->and_words(block, order[j]->buf + start, words * sizeof(u32));
+        }
+
+        memcpy(bm_out->buf + start, block, words * sizeof(u32));
+        scanned += (u64)(j + 1) * words;
+    }
+
+    if (lo_index > hi_index)
+    {
+        memset(bm_out->buf, 0, (size_t)bm_out->buf_len * sizeof(u32));
+    }
+    else
+    {
+        memset(bm_out->buf, 0, lo_index * sizeof(u32));
+        memset(bm_out->buf + hi_index + 1, 0, (bm_out->buf_len - hi_index - 1) * sizeof(u32));
+    }
+
+    if (order != order_stack)
+    {
+        free(order);
+    }
+
+    old_numbers = bm_out->numbers;
+    mask_tail_bits(bm_out);
+
+    /* The surviving words bound the result */
+    if (lo_index > hi_index)
+    {
+        refresh_after_bulk(bm_out, 0, 0);
+    }
+    else
+    {
+        start = (hi_index + 1) << UINT_SHIFT;
+        refresh_after_bulk(bm_out, (u16)((lo_index << UINT_SHIFT) + 1), start > bm_out->max_value ? bm_out->max_value : (u16)start);
+    }
+
+    BITMAP_STAT_TIMED(BITMAP_STAT_AND_MANY, BITMAP_STAT_DELTA(old_numbers, bm_out), scanned, stat_start);
+
+    return true;
+}
+
+struct bitmap *bitmap_parse_str(u8 *str)
+{
+    u64 stat_start = BITMAP_STAT_START();
+    struct bitmap *bm = NULL;
+
+    if (str == NULL)
+    {
+        return NULL;
+    }
+
+    bm = range_parse_buf(str, strlen((const char *)str), NULL);
+    BITMAP_STAT_TIMED(BITMAP_STAT_PARSE_STR, bm == NULL ? 0 : bm->numbers, 0, stat_start);
+
+    return bm;
+}
@@ -1,198 +1,539 @@
-#ifndef BITMAP_H_INCLUDED
-#define BITMAP_H_INCLUDED
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <inttypes.h>
-#include <ctype.h>
-#include <limits.h>
-
-#define UINT_BITS (sizeof(uint32_t)*CHAR_BIT)
-#define U16_MAX 65535
-
-typedef uint32_t u32;
-typedef uint16_t u16;
-typedef uint8_t u8;
-typedef enum
-{
-    false = 0,
-    true
-} bool;
-
-struct bitmap
-{
-    struct bitmap *bm_self; /* The value used when creating a bitmap */
-    u16 max_value;          /* The value used when creating a bitmap */
-    u16 first_value;        /* The first bit has been set */
-    u16 last_value;         /* The last bit has been set */
-    u16 numbers;            /* Number of '1' bits in buf[] */
-    u16 buf_len;
-    u32 buf[0]; /* Flexible array member for bitmap storage */
-};
-
-/*****************************************************************************************************
- * Name: bitMap_create
- * Input:  capacity  The capacity of the bitmap that will be created
- * Return: Success   pointer to bitmap
- *         Failed    NULL
- * Description: Create a new bitmap
- *****************************************************************************************************/
-struct bitmap *bitMap_create(u16 capacity);
-
-/*****************************************************************************************************
- * Name: bitmap_destroy
- * Input: bm        A bitmap that will be destroyed
- * Return: Success  None
- *         Fail     Remind(None)
- * Description: Destroy a bitmap
- *****************************************************************************************************/
-void bitmap_destroy(struct bitmap *bm);
-
-/*************************************************************
- * Name: bitmap_add_value
- * Input: bm         The bitmap to which values are added
- *        value      A value that will be added into the bitmap
- * Return: Success   true
- *         Failed    false
- * Description: Add a value into the bitmap
- **************************************************************/
-bool bitmap_add_value(struct bitmap *bm, u16 value);
-
-/************************************************************************
- * Name: bitmap_del_value
- * Input: bm        The bitmap from which values are removed
- *        value     A value that will be removed from the specified bitmap
- * Return: Success  true
- *         Failed   false
- * Description: Remove a value from the specified bitmap
- ************************************************************************/
-bool bitmap_del_value(struct bitmap *bm, u16 value);
-
-/*******************************************************
- * Name: bitmap_print
- * Input: bm      A bitmap that will be printed
- * Return: None
- * Description: Print all the elements in the bitmap
- *******************************************************/
-void bitmap_print(struct bitmap *bm);
-
-/*********************************************************************
- * Name: bitmap_clone
- * Input: bm         A bitmap that will be copied
- * Return: Success  None
- *         Fail     None
- * Description: Create a new bitmap and copy specified bm data into it
- **********************************************************************/
-struct bitmap *bitmap_clone(struct bitmap *bm);
-
-/*********************************************************************
- * Name: bitmap_not
- * Input: bm         A bitmap that will be reversed with all the binary bits
- * Return: Success   true
- *         Failed    false
- * Description: Reverse all the binary bits
- **********************************************************************/
-bool bitmap_not(struct bitmap *bm);
-
-/****************************************************************************************
- * Name: bitmap_or
- * Input:
- *    bm_store       A bitmap that participates in binary OR operations and stores the results
- *    bm             Another bitmap that participates in binary OR operations
- * Return: Success   true
- *         Failed    false
- * Description: Perform binary OR operation (bm_store | bm)
- *****************************************************************************************/
-bool bitmap_or(struct bitmap *bm_store, struct bitmap *bm);
-
-/******************************************************************************************
- * Name: bitmap_and
- * Input:
- *    bm_store       A bitmap that participates in binary AND operations and stores the results
- *    bm             Another bitmap that participates in binary AND operations
- * Return: Success   true
- *         Failed    false
- * Description: Perform binary AND operation (bm_store & bm)
- *******************************************************************************************/
-bool bitmap_and(struct bitmap *bm_store, struct bitmap *bm);
-
-/******************************************************************************************
- * Name: bitmap_parse_str
- * Input: str       A string that will be parsed to a bitmap
- * Return: Success  Pointer to A new bitmap and stores the data is parsed from the specified string
- *         Failed   NULL
- * Description: Parse a string to create a bitmap
- *******************************************************************************************/
-struct bitmap *bitmap_parse_str(u8 *str);
-
-/*Used for simplicity and modularity following prototype are used*/
-/*****************************************************************************************************
- * Name: get_index_and_mask
- * Input:  value  The value for which index and mask will be calculated
- *         index  Pointer to store the calculated index
- *         mask   Pointer to store the calculated mask
- * Return: Success None
- *         Failed  None
- * Description: Calculate the index and mask for the given value in the bitmap
- *****************************************************************************************************/
-void get_index_and_mask(u16 value, u16 *index, u32 *mask);
-
-/*****************************************************************************************************
- * Name: is_value_set
- * Input:  bm     Pointer to the bitmap structure
- *         value  The value to check in the bitmap
- * Return: Success   true
- *         Failed    false
- * Description: Check if a given value is set in the bitmap
- *****************************************************************************************************/
-bool is_value_set(struct bitmap *bm, u16 value);
-
-/*****************************************************************************************************
- * Name: set_value
- * Input:  bm     Pointer to the bitmap structure
- *         value  The value to set in the bitmap
- * Return: Success None
- *         Failed  None
- * Description: Set the given value in the bitmap
- *****************************************************************************************************/
-void set_value(struct bitmap *bm, u16 value);
-
-/*****************************************************************************************************
- * Name: clear_value
- * Input:  bm     Pointer to the bitmap structure
- *         value  The value to clear in the bitmap
- * Return: Success None
- *         Failed  None
- * Description: Clear the given value from the bitmap
- *****************************************************************************************************/
-void clear_value(struct bitmap *bm, u16 value);
-
-/*****************************************************************************************************
- * Name: update_first_value
- * Input:  bm     Pointer to the bitmap structure
- * Return: Success None
- *         Failed  None
- * Description: Update the first value set in the bitmap, setting it to 0 if no values are set
- *****************************************************************************************************/
-void update_first_value(struct bitmap *bm);
-
-/*****************************************************************************************************
- * Name: update_last_value
- * Input:  bm     Pointer to the bitmap structure
- * Return: Success None
- *         Failed  None
- * Description: Update the last value set in the bitmap, setting it to 0 if no values are set
- *****************************************************************************************************/
-void update_last_value(struct bitmap *bm);
-
-/*****************************************************************************************************
- * Name: count_set_bits
- * Input:  bm     Pointer to the bitmap structure
- * Return: Success   count value
- *         Failed    0
- * Description: Count the number of set bits in the bitmap
- *****************************************************************************************************/
-u16 count_set_bits(struct bitmap *bm);
-
-#endif // BITMAP_H_INCLUDED
+#ifndef BITMAP_H_INCLUDED
+#define BITMAP_H_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <limits.h>
+
+#define UINT_BITS (sizeof(uint32_t)*CHAR_BIT)
+#define UINT_SHIFT 5                /* log2(UINT_BITS) */
+#define UINT_MASK (UINT_BITS - 1)
+#define U16_MAX 65535
+
+#define BITMAP_FLAG_READONLY 0x0001 /* Every operation that writes to the bitmap fails */
+#define BITMAP_FLAG_VIEW 0x0002     /* buf[] lives in a file mapping, see bitmap_open_view */
+#define BITMAP_FLAG_EXTERNAL 0x0004 /* Storage belongs to the caller, see bitmap_init */
+#define BITMAP_FLAG_LAZY 0x0008     /* Bulk operations leave numbers/first/last stale, see bitmap_set_lazy */
+#define BITMAP_FLAG_DIRTY 0x0010    /* numbers is stale, first_value/last_value only bound the set values */
+
+typedef uint64_t u64;
+typedef uint32_t u32;
+typedef uint16_t u16;
+typedef uint8_t u8;
+typedef enum
+{
+    false = 0,
+    true
+} bool;
+
+struct bitmap_rank;
+
+struct bitmap
+{
+    struct bitmap *bm_self; /* The value used when creating a bitmap */
+    u16 max_value;          /* The value used when creating a bitmap */
+    u16 first_value;        /* The first bit has been set */
+    u16 last_value;         /* The last bit has been set */
+    u16 numbers;            /* Number of '1' bits in buf[] */
+    u16 buf_len;
+    u16 flags;              /* BITMAP_FLAG_* bits */
+    struct bitmap_rank *rank; /* Optional rank/select index, see bitmap-rank.h */
+    u32 buf[0]; /* Flexible array member for bitmap storage */
+};
+
+/* Receiver of formatted text, see bitmap_format_sink */
+typedef bool (*bitmap_sink_fn)(void *ctx, const char *data, size_t len);
+
+/* Iteration state over the set values of a bitmap, see bitmap_iter_init */
+struct bitmap_iter
+{
+    struct bitmap *bm; /* The bitmap being iterated */
+    u32 word;          /* Bits of the current word not returned yet */
+    u16 index;         /* Index of the current word in buf[] */
+};
+
+/*****************************************************************************************************
+ * Name: bitMap_create
+ * Input:  capacity  The capacity of the bitmap that will be created
+ * Return: Success   pointer to bitmap
+ *         Failed    NULL
+ * Description: Create a new bitmap. Storage comes from a per-thread pool of freed bitmaps of the
+ *              same size class, so create/destroy cycles do not reach malloc, see bitmap-pool.h
+ *****************************************************************************************************/
+struct bitmap *bitMap_create(u16 capacity);
+
+/*****************************************************************************************************
+ * Name: bitmap_size_for
+ * Input:  capacity  The capacity of a bitmap
+ * Return: Number of bytes bitmap_init needs for that capacity
+ * Description: Size of struct bitmap plus its buffer words
+ *****************************************************************************************************/
+size_t bitmap_size_for(u16 capacity);
+
+/*****************************************************************************************************
+ * Name: bitmap_init
+ * Input:  mem       Caller-owned storage such as a stack buffer or arena memory, aligned for a pointer
+ *         len       Size of mem in bytes, at least bitmap_size_for(capacity)
+ *         capacity  The capacity of the bitmap
+ * Return: Success   pointer to the bitmap, at the start of mem
+ *         Failed    NULL
+ * Description: Create an empty bitmap in place. bitmap_destroy only invalidates it, mem stays
+ *              with the caller
+ *****************************************************************************************************/
+struct bitmap *bitmap_init(void *mem, size_t len, u16 capacity);
+
+/*****************************************************************************************************
+ * Name: bitmap_destroy
+ * Input: bm        A bitmap that will be destroyed
+ * Return: Success  None
+ *         Fail     Remind(None)
+ * Description: Destroy a bitmap
+ *****************************************************************************************************/
+void bitmap_destroy(struct bitmap *bm);
+
+/*************************************************************
+ * Name: bitmap_is_valid
+ * Input: bm         A bitmap pointer
+ * Return: Success   true
+ *         Failed    false
+ * Description: Check that bm points to a live bitmap created by bitMap_create
+ **************************************************************/
+bool bitmap_is_valid(struct bitmap *bm);
+
+/*************************************************************
+ * Name: bitmap_set_lazy
+ * Input: bm         The bitmap whose mode is changed
+ *        lazy       true to defer the metadata, false to keep it exact
+ * Return: Success   true
+ *         Failed    false
+ * Description: In lazy mode NOT/AND/OR, the _new and _many operations and
+ *              clone_into only mark numbers, first_value and last_value as
+ *              stale and keep word bounds of where the set values can be.
+ *              The fields are recomputed inside those bounds by the first
+ *              bitmap_cardinality/first/last call. Leaving lazy mode
+ *              recomputes them at once, so direct field reads work again
+ **************************************************************/
+bool bitmap_set_lazy(struct bitmap *bm, bool lazy);
+
+/*************************************************************
+ * Name: bitmap_cardinality
+ * Input: bm         Pointer to the bitmap structure
+ * Return: Number of values set, 0 for an invalid bitmap
+ * Description: Read numbers, recomputing it first when it is stale
+ **************************************************************/
+u16 bitmap_cardinality(struct bitmap *bm);
+
+/*************************************************************
+ * Name: bitmap_first / bitmap_last
+ * Input: bm         Pointer to the bitmap structure
+ * Return: The smallest / largest value set, 0 when the bitmap is empty or invalid
+ * Description: Read first_value / last_value, recomputing them when stale
+ **************************************************************/
+u16 bitmap_first(struct bitmap *bm);
+u16 bitmap_last(struct bitmap *bm);
+
+/*************************************************************
+ * Name: bitmap_add_value
+ * Input: bm         The bitmap to which values are added
+ *        value      A value that will be added into the bitmap
+ * Return: Success   true
+ *         Failed    false
+ * Description: Add a value into the bitmap
+ **************************************************************/
+bool bitmap_add_value(struct bitmap *bm, u16 value);
+
+/************************************************************************
+ * Name: bitmap_del_value
+ * Input: bm        The bitmap from which values are removed
+ *        value     A value that will be removed from the specified bitmap
+ * Return: Success  true
+ *         Failed   false
+ * Description: Remove a value from the specified bitmap
+ ************************************************************************/
+bool bitmap_del_value(struct bitmap *bm, u16 value);
+
+/*************************************************************
+ * Name: bitmap_add_range
+ * Input: bm         The bitmap to which values are added
+ *        lo         The first value of the range
+ *        hi         The last value of the range
+ * Return: Success   true
+ *         Failed    false
+ * Description: Add every value from lo to hi into the bitmap. Whole words are filled
+ *              at once, first/last/numbers are updated once per call
+ **************************************************************/
+bool bitmap_add_range(struct bitmap *bm, u16 lo, u16 hi);
+
+/*************************************************************
+ * Name: bitmap_del_range
+ * Input: bm         The bitmap from which values are removed
+ *        lo         The first value of the range
+ *        hi         The last value of the range
+ * Return: Success   true
+ *         Failed    false
+ * Description: Remove every value from lo to hi from the bitmap. Whole words are cleared
+ *              at once, first/last/numbers are updated once per call
+ **************************************************************/
+bool bitmap_del_range(struct bitmap *bm, u16 lo, u16 hi);
+
+/*************************************************************
+ * Name: bitmap_add_many
+ * Input: bm         The bitmap to which values are added
+ *        vals       The values to add, in any order, duplicates allowed
+ *        n          Number of values in vals
+ * Return: Number of values that were not set before, 0 and nothing added
+ *         when bm is invalid or any value is 0 or above max_value
+ * Description: Add a batch of values. Consecutive values falling into the same word,
+ *              as in sorted input, are merged into one store, first/last/numbers
+ *              are updated once per call
+ **************************************************************/
+u32 bitmap_add_many(struct bitmap *bm, const u16 *vals, u32 n);
+
+/*************************************************************
+ * Name: bitmap_del_many
+ * Input: bm         The bitmap from which values are removed
+ *        vals       The values to remove, in any order, duplicates allowed
+ *        n          Number of values in vals
+ * Return: Number of values that were set before, 0 and nothing removed
+ *         when bm is invalid or any value is 0 or above max_value
+ * Description: Remove a batch of values like bitmap_add_many. first/last are
+ *              rescanned at most once per call, from their old positions
+ **************************************************************/
+u32 bitmap_del_many(struct bitmap *bm, const u16 *vals, u32 n);
+
+/*******************************************************
+ * Name: bitmap_print
+ * Input: bm      A bitmap that will be printed
+ * Return: None
+ * Description: Print all the elements in the bitmap
+ *******************************************************/
+void bitmap_print(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_format
+ * Input:  bm     The bitmap that will be formatted
+ *         buf    Receives the text, always '\0' terminated when cap is not 0
+ *         cap    Size of buf, 0 only measures
+ * Return: Length of the whole text without the '\0', like snprintf; a larger value than
+ *         cap - 1 means the text was cut. 0 for an empty or invalid bitmap
+ * Description: Write the values as "a-b, c", the syntax bitmap_parse_str accepts. Runs are found
+ *              a word at a time and the numbers are written without stdio
+ *****************************************************************************************************/
+size_t bitmap_format(struct bitmap *bm, char *buf, size_t cap);
+
+/*****************************************************************************************************
+ * Name: bitmap_format_sink
+ * Input:  bm     The bitmap that will be formatted
+ *         sink   Called with each piece of the text in order, returns false to stop
+ *         ctx    Passed to every call of sink
+ * Return: Success   true
+ *         Failed    false for an invalid bitmap or when sink stopped
+ * Description: Same text as bitmap_format, streamed in pieces of up to 512 bytes
+ *****************************************************************************************************/
+bool bitmap_format_sink(struct bitmap *bm, bitmap_sink_fn sink, void *ctx);
+
+/*****************************************************************************************************
+ * Name: bitmap_iter_init
+ * Input:  it     The iterator to initialize, usually on the stack
+ *         bm     The bitmap to iterate
+ * Return: Success   true
+ *         Failed    false
+ * Description: Prepare it to return the set values of bm in increasing order. No memory is
+ *              allocated, the bitmap must not be modified while it is being iterated
+ *****************************************************************************************************/
+bool bitmap_iter_init(struct bitmap_iter *it, struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_iter_next
+ * Input:  it     An iterator prepared by bitmap_iter_init
+ *         value  Where the next set value is stored
+ * Return: Success   true
+ *         Failed    false when every value has been returned
+ * Description: Return the next set value. Zero words are skipped and the bits of a word are
+ *              extracted with ctz and clear-lowest-bit
+ *****************************************************************************************************/
+bool bitmap_iter_next(struct bitmap_iter *it, u16 *value);
+
+/*****************************************************************************************************
+ * Name: bitmap_to_array
+ * Input:  bm     The bitmap whose values are exported
+ *         out    Buffer that receives the values in increasing order
+ *         n      Capacity of out in values
+ * Return: Number of values written to out, at most n
+ * Description: Export the set values of bm into a caller-provided buffer
+ *****************************************************************************************************/
+u32 bitmap_to_array(struct bitmap *bm, u16 *out, u32 n);
+
+/*********************************************************************
+ * Name: bitmap_clone
+ * Input: bm         A bitmap that will be copied
+ * Return: Success  None
+ *         Fail     None
+ * Description: Create a new bitmap and copy specified bm data into it
+ **********************************************************************/
+struct bitmap *bitmap_clone(struct bitmap *bm);
+
+/*********************************************************************
+ * Name: bitmap_clone_into
+ * Input: dst        A bitmap whose values are replaced, its storage is reused
+ *        src        The bitmap that is copied
+ * Return: Success   true
+ *         Failed    false, also when src holds a value above dst->max_value
+ * Description: Copy the values of src into dst without allocating, dst keeps its
+ *              own max_value
+ **********************************************************************/
+bool bitmap_clone_into(struct bitmap *dst, struct bitmap *src);
+
+/*********************************************************************
+ * Name: bitmap_not
+ * Input: bm         A bitmap that will be reversed with all the binary bits
+ * Return: Success   true
+ *         Failed    false
+ * Description: Reverse all the binary bits
+ **********************************************************************/
+bool bitmap_not(struct bitmap *bm);
+
+/****************************************************************************************
+ * Name: bitmap_or
+ * Input:
+ *    bm_store       A bitmap that participates in binary OR operations and stores the results
+ *    bm             Another bitmap that participates in binary OR operations
+ * Return: Success   true
+ *         Failed    false
+ * Description: Perform binary OR operation (bm_store | bm)
+ *****************************************************************************************/
+bool bitmap_or(struct bitmap *bm_store, struct bitmap *bm);
+
+/******************************************************************************************
+ * Name: bitmap_and
+ * Input:
+ *    bm_store       A bitmap that participates in binary AND operations and stores the results
+ *    bm             Another bitmap that participates in binary AND operations
+ * Return: Success   true
+ *         Failed    false
+ * Description: Perform binary AND operation (bm_store & bm)
+ *******************************************************************************************/
+bool bitmap_and(struct bitmap *bm_store, struct bitmap *bm);
+
+/******************************************************************************************
+ * Name: bitmap_and_new
+ * Input:
+ *    bm_a           A bitmap that participates in binary AND operations
+ *    bm_b           Another bitmap that participates in binary AND operations
+ *    bm_result      Bitmap with the max_value of bm_a that receives the result, may be bm_a.
+ *                   NULL allocates a new one
+ * Return: Success   Pointer to the result
+ *         Failed    NULL
+ * Description: Perform binary AND operation (bm_a & bm_b) leaving bm_b, and bm_a unless it is
+ *              the result, unchanged
+ *******************************************************************************************/
+struct bitmap *bitmap_and_new(struct bitmap *bm_a, struct bitmap *bm_b, struct bitmap *bm_result);
+
+/******************************************************************************************
+ * Name: bitmap_or_new
+ * Input:
+ *    bm_a           A bitmap that participates in binary OR operations
+ *    bm_b           Another bitmap that participates in binary OR operations
+ *    bm_result      Bitmap with the max_value of bm_a that receives the result, may be bm_a.
+ *                   NULL allocates a new one
+ * Return: Success   Pointer to the result
+ *         Failed    NULL
+ * Description: Perform binary OR operation (bm_a | bm_b) out of place
+ *******************************************************************************************/
+struct bitmap *bitmap_or_new(struct bitmap *bm_a, struct bitmap *bm_b, struct bitmap *bm_result);
+
+/******************************************************************************************
+ * Name: bitmap_xor_new
+ * Input:
+ *    bm_a           A bitmap that participates in binary XOR operations
+ *    bm_b           Another bitmap that participates in binary XOR operations
+ *    bm_result      Bitmap with the max_value of bm_a that receives the result, may be bm_a.
+ *                   NULL allocates a new one
+ * Return: Success   Pointer to the result
+ *         Failed    NULL
+ * Description: Perform binary XOR operation (bm_a ^ bm_b) out of place
+ *******************************************************************************************/
+struct bitmap *bitmap_xor_new(struct bitmap *bm_a, struct bitmap *bm_b, struct bitmap *bm_result);
+
+/******************************************************************************************
+ * Name: bitmap_andnot_new
+ * Input:
+ *    bm_a           The bitmap values are taken from
+ *    bm_b           The bitmap whose values are removed
+ *    bm_result      Bitmap with the max_value of bm_a that receives the result, may be bm_a.
+ *                   NULL allocates a new one
+ * Return: Success   Pointer to the result
+ *         Failed    NULL
+ * Description: Perform binary AND NOT operation (bm_a & ~bm_b) out of place
+ *******************************************************************************************/
+struct bitmap *bitmap_andnot_new(struct bitmap *bm_a, struct bitmap *bm_b, struct bitmap *bm_result);
+
+/******************************************************************************************
+ * Name: bitmap_and_cardinality
+ * Input:  bm_a      A bitmap
+ *         bm_b      Another bitmap
+ * Return: Number of values set in both bitmaps, 0 for invalid bitmaps
+ * Description: Count bm_a & bm_b without building the result or allocating memory
+ *******************************************************************************************/
+u16 bitmap_and_cardinality(struct bitmap *bm_a, struct bitmap *bm_b);
+
+/******************************************************************************************
+ * Name: bitmap_or_cardinality
+ * Input:  bm_a      A bitmap
+ *         bm_b      Another bitmap
+ * Return: Number of values bitmap_or(bm_a, bm_b) would leave in bm_a, 0 for invalid bitmaps
+ * Description: Count bm_a | bm_b without building the result or allocating memory
+ *******************************************************************************************/
+u16 bitmap_or_cardinality(struct bitmap *bm_a, struct bitmap *bm_b);
+
+/******************************************************************************************
+ * Name: bitmap_intersects
+ * Input:  bm_a      A bitmap
+ *         bm_b      Another bitmap
+ * Return: Success   true when at least one value is set in both bitmaps
+ *         Failed    false
+ * Description: Test for overlap, stopping at the first common word
+ *******************************************************************************************/
+bool bitmap_intersects(struct bitmap *bm_a, struct bitmap *bm_b);
+
+/******************************************************************************************
+ * Name: bitmap_or_many
+ * Input:
+ *    bm_out         The bitmap that stores the union, it may also be one of the inputs
+ *    bms            Array of k bitmaps that participate in the union
+ *    k              Number of bitmaps in bms, 0 clears bm_out
+ * Return: Success   true
+ *         Failed    false
+ * Description: Union of all bms in one pass over cache-sized word blocks, bits above
+ *              bm_out->max_value are dropped. numbers/first/last are computed once at the end
+ *******************************************************************************************/
+bool bitmap_or_many(struct bitmap *bm_out, struct bitmap **bms, u32 k);
+
+/******************************************************************************************
+ * Name: bitmap_and_many
+ * Input:
+ *    bm_out         The bitmap that stores the intersection, it may also be one of the inputs
+ *    bms            Array of k bitmaps that participate in the intersection
+ *    k              Number of bitmaps in bms, at least 1
+ * Return: Success   true
+ *         Failed    false
+ * Description: Intersection of all bms in one pass over cache-sized word blocks. Inputs are
+ *              applied sparsest first and a block stops as soon as it becomes zero, only the
+ *              words inside every input's first/last range are visited
+ *******************************************************************************************/
+bool bitmap_and_many(struct bitmap *bm_out, struct bitmap **bms, u32 k);
+
+/******************************************************************************************
+ * Name: bitmap_parse_str
+ * Input: str       A string that will be parsed to a bitmap
+ * Return: Success  Pointer to A new bitmap and stores the data is parsed from the specified string
+ *         Failed   NULL
+ * Description: Parse a string to create a bitmap, str is not modified. See range-parser.h
+ *              for chunked input from a FILE* or fd and for the offset of an error
+ *******************************************************************************************/
+struct bitmap *bitmap_parse_str(u8 *str);
+
+/*Used for simplicity and modularity following prototype are used*/
+/*****************************************************************************************************
+ * Name: get_index_and_mask
+ * Input:  value  The value for which index and mask will be calculated
+ *         index  Pointer to store the calculated index
+ *         mask   Pointer to store the calculated mask
+ * Return: Success None
+ *         Failed  None
+ * Description: Calculate the index and mask for the given value in the bitmap
+ *****************************************************************************************************/
+void get_index_and_mask(u16 value, u16 *index, u32 *mask);
+
+/*****************************************************************************************************
+ * Name: is_value_set
+ * Input:  bm     Pointer to the bitmap structure
+ *         value  The value to check in the bitmap
+ * Return: Success   true
+ *         Failed    false
+ * Description: Check if a given value is set in the bitmap
+ *****************************************************************************************************/
+bool is_value_set(struct bitmap *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: set_value
+ * Input:  bm     Pointer to the bitmap structure
+ *         value  The value to set in the bitmap
+ * Return: Success None
+ *         Failed  None
+ * Description: Set the given value in the bitmap
+ *****************************************************************************************************/
+void set_value(struct bitmap *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: clear_value
+ * Input:  bm     Pointer to the bitmap structure
+ *         value  The value to clear in the bitmap
+ * Return: Success None
+ *         Failed  None
+ * Description: Clear the given value from the bitmap
+ *****************************************************************************************************/
+void clear_value(struct bitmap *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: update_first_value
+ * Input:  bm     Pointer to the bitmap structure
+ * Return: Success None
+ *         Failed  None
+ * Description: Update the first value set in the bitmap, setting it to 0 if no values are set
+ *****************************************************************************************************/
+void update_first_value(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: update_last_value
+ * Input:  bm     Pointer to the bitmap structure
+ * Return: Success None
+ *         Failed  None
+ * Description: Update the last value set in the bitmap, setting it to 0 if no values are set
+ *****************************************************************************************************/
+void update_last_value(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_next_value
+ * Input:  bm     Pointer to the bitmap structure
+ *         value  The value the scan starts from (0 is treated as 1)
+ * Return: Success   The smallest value >= value that is set
+ *         Failed    0 when there is none
+ * Description: Scan forward a word at a time, skipping zero words and locating the bit with ctz
+ *****************************************************************************************************/
+u16 bitmap_next_value(struct bitmap *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: bitmap_prev_value
+ * Input:  bm     Pointer to the bitmap structure
+ *         value  The value the scan starts from, clamped to max_value
+ * Return: Success   The largest value <= value that is set
+ *         Failed    0 when there is none
+ * Description: Scan backward a word at a time, skipping zero words and locating the bit with clz
+ *****************************************************************************************************/
+u16 bitmap_prev_value(struct bitmap *bm, u16 value);
+
+/*****************************************************************************************************
+ * Name: count_set_bits
+ * Input:  bm     Pointer to the bitmap structure
+ * Return: Success   count value
+ *         Failed    0
+ * Description: Count the number of set bits in the bitmap
+ *****************************************************************************************************/
+u16 count_set_bits(struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: bitmap_cardinality_range
+ * Input:  bm     Pointer to the bitmap structure
+ *         lo     The first value of the range
+ *         hi     The last value of the range, clamped to max_value
+ * Return: Success   Number of values in [lo, hi] that are set
+ *         Failed    0
+ * Description: Count the set values inside an inclusive range without touching the rest of buf[]
+ *****************************************************************************************************/
+u16 bitmap_cardinality_range(struct bitmap *bm, u16 lo, u16 hi);
+
+#endif // BITMAP_H_INCLUDED
@@ -0,0 +1,163 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "popcount.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define POPCOUNT_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+typedef u64 (*popcount_fn)(const u8 *data, size_t nbytes);
+
+static u64 popcount_swar(const u8 *data, size_t nbytes);
+static u64 popcount_resolve(const u8 *data, size_t nbytes);
+
+/* Every call goes through this pointer, the first one lands in the resolver which replaces it.
+ * Threads may resolve at the same time, they all store the same values */
+static _Atomic(popcount_fn) popcount_impl = popcount_resolve;
+static _Atomic(const char *) popcount_name = "swar";
+
+static u64 popcount_swar(const u8 *data, size_t nbytes)
+{
+    u64 count = 0;
+    u64 word = 0;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(u64) <= nbytes; i += sizeof(u64))
+    {
+        memcpy(&word, data + i, sizeof(u64));
+        count += popcount64(word);
+    }
+
+    /* Less than a word left, pad it with zeros */
+    if (i < nbytes)
+    {
+        word = 0;
+        memcpy(&word, data + i, nbytes - i);
+        count += popcount64(word);
+    }
+
+    return count;
+}
+
+#ifdef POPCOUNT_X86_DISPATCH
+__attribute__((target("popcnt")))
+static u64 popcount_hw(const u8 *data, size_t nbytes)
+{
+    u64 count[4] = {0};
+    u64 word[4] = {0};
+    u64 tail = 0;
+    size_t i = 0;
+
+    /* Four independent accumulators keep the POPCNT units busy */
+    for (i = 0; i + 4 * sizeof(u64) <= nbytes; i += 4 * sizeof(u64))
+    {
+        memcpy(word, data + i, sizeof(word));
+        count[0] += (u64)__builtin_popcountll(word[0]);
+        count[1] += (u64)__builtin_popcountll(word[1]);
+        count[2] += (u64)__builtin_popcountll(word[2]);
+        count[3] += (u64)__builtin_popcountll(word[3]);
+    }
+
+    for (; i + sizeof(u64) <= nbytes; i += sizeof(u64))
+    {
+        memcpy(&tail, data + i, sizeof(u64));
+        count[0] += (u64)__builtin_popcountll(tail);
+    }
+
+    if (i < nbytes)
+    {
+        tail = 0;
+        memcpy(&tail, data + i, nbytes - i);
+        count[0] += (u64)__builtin_popcountll(tail);
+    }
+
+    return count[0] + count[1] + count[2] + count[3];
+}
+
+__attribute__((target("avx2,popcnt")))
+static u64 popcount_avx2(const u8 *data, size_t nbytes)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    __m256i local = _mm256_setzero_si256();
+    __m256i vec = _mm256_setzero_si256();
+    u64 lanes[4] = {0};
+    size_t i = 0;
+    u32 inner = 0;
+
+    if (nbytes < POPCOUNT_AVX2_MIN_BYTES)
+    {
+        return popcount_hw(data, nbytes);
+    }
+
+    while (i + sizeof(__m256i) <= nbytes)
+    {
+        local = _mm256_setzero_si256();
+
+        /* Each byte lane gains at most 8 per round, flush before the u8 lanes can overflow */
+        for (inner = 0; inner < 31 && i + sizeof(__m256i) <= nbytes; inner++, i += sizeof(__m256i))
+        {
+            vec = _mm256_loadu_si256((const __m256i *)(data + i));
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, _mm256_and_si256(vec, low_mask)));
+            local = _mm256_add_epi8(local, _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(vec, 4), low_mask)));
+        }
+
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(local, _mm256_setzero_si256()));
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes, total);
+
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + popcount_hw(data + i, nbytes - i);
+}
+#endif
+
+static u64 popcount_resolve(const u8 *data, size_t nbytes)
+{
+    popcount_fn impl = popcount_swar;
+    const char *name = "swar";
+
+#ifdef POPCOUNT_X86_DISPATCH
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+    {
+        impl = popcount_avx2;
+        name = "avx2";
+    }
+    else if (__builtin_cpu_supports("popcnt"))
+    {
+        impl = popcount_hw;
+        name = "popcnt";
+    }
+#endif
+
+    atomic_store_explicit(&popcount_name, name, memory_order_relaxed);
+    atomic_store_explicit(&popcount_impl, impl, memory_order_release);
+
+    return impl(data, nbytes);
+}
+
+u64 popcount_buf(const void *data, size_t nbytes)
+{
+    if (data == NULL || nbytes == 0)
+    {
+        return 0;
+    }
+
+    return atomic_load_explicit(&popcount_impl, memory_order_acquire)((const u8 *)data, nbytes);
+}
+
+const char *popcount_impl_name(void)
+{
+    if (atomic_load_explicit(&popcount_impl, memory_order_acquire) == popcount_resolve)
+    {
+        popcount_resolve(NULL, 0);
+    }
+
+    return atomic_load_explicit(&popcount_name, memory_order_relaxed);
+}
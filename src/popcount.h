@@ -0,0 +1,29 @@
+#ifndef POPCOUNT_H_INCLUDED
+#define POPCOUNT_H_INCLUDED
+
+#include <stddef.h>
+#include "bitmap.h"
+
+/* Buffers shorter than this never go through the AVX2 kernel, the setup cost is not worth it */
+#define POPCOUNT_AVX2_MIN_BYTES 256
+
+/*****************************************************************************************************
+ * Name: popcount_buf
+ * Input:  data    Start of the memory to be counted
+ *         nbytes  Number of bytes to count
+ * Return: Number of '1' bits in the nbytes bytes starting at data
+ * Description: Count the set bits of a buffer with the fastest kernel the running CPU supports.
+ *              The kernel is chosen once, on the first call: AVX2 nibble lookup for long buffers,
+ *              the POPCNT instruction, or a portable SWAR reduction
+ *****************************************************************************************************/
+u64 popcount_buf(const void *data, size_t nbytes);
+
+/*****************************************************************************************************
+ * Name: popcount_impl_name
+ * Input:  None
+ * Return: Name of the kernel popcount_buf dispatches to ("avx2", "popcnt" or "swar")
+ * Description: Report which popcount kernel was selected for the running CPU
+ *****************************************************************************************************/
+const char *popcount_impl_name(void);
+
+#endif // POPCOUNT_H_INCLUDED
@@ -0,0 +1,304 @@
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include "bitmap.h"
+#include "range-parser.h"
+
+static bool parser_fail(struct range_parser *parser, u8 status, u64 offset);
+static bool parser_digit(struct range_parser *parser, u8 ch);
+static bool parser_end_value(struct range_parser *parser);
+static bool parser_commit(struct range_parser *parser);
+static struct bitmap *parse_and_finish(struct range_parser *parser, u64 *error_offset);
+
+static bool parser_fail(struct range_parser *parser, u8 status, u64 offset)
+{
+    parser->state = RANGE_STATE_ERROR;
+    parser->status = status;
+    parser->error_offset = offset;
+
+    return false;
+}
+
+/* Append a digit to value, a value that grows past max_value is reported at its first digit */
+static bool parser_digit(struct range_parser *parser, u8 ch)
+{
+    if (parser->state == RANGE_STATE_ITEM || parser->state == RANGE_STATE_SECOND_START)
+    {
+        parser->value = 0;
+        parser->value_offset = parser->offset;
+        parser->state = parser->state == RANGE_STATE_ITEM ? RANGE_STATE_FIRST : RANGE_STATE_SECOND;
+    }
+
+    parser->value = parser->value * 10 + (ch - '0');
+
+    if (parser->value > parser->bm->max_value)
+    {
+        return parser_fail(parser, RANGE_PARSER_RANGE, parser->value_offset);
+    }
+
+    return true;
+}
+
+/* Called when a number ends, only 0 can still be wrong here */
+static bool parser_end_value(struct range_parser *parser)
+{
+    if (parser->value == 0)
+    {
+        return parser_fail(parser, RANGE_PARSER_RANGE, parser->value_offset);
+    }
+
+    if (parser->state == RANGE_STATE_FIRST)
+    {
+        parser->first = parser->value;
+        parser->state = RANGE_STATE_AFTER_FIRST;
+    }
+    else if (parser->state == RANGE_STATE_SECOND)
+    {
+        parser->state = RANGE_STATE_AFTER_SECOND;
+    }
+
+    return true;
+}
+
+/* Add the finished item to the bitmap, reverse ranges are accepted */
+static bool parser_commit(struct range_parser *parser)
+{
+    bool ok = false;
+
+    if (parser->state == RANGE_STATE_AFTER_FIRST)
+    {
+        ok = bitmap_add_value(parser->bm, (u16)parser->first);
+    }
+    else if (parser->first <= parser->value)
+    {
+        ok = bitmap_add_range(parser->bm, (u16)parser->first, (u16)parser->value);
+    }
+    else
+    {
+        ok = bitmap_add_range(parser->bm, (u16)parser->value, (u16)parser->first);
+    }
+
+    if (!ok)
+    {
+        return parser_fail(parser, RANGE_PARSER_RANGE, parser->offset);
+    }
+
+    parser->state = RANGE_STATE_ITEM;
+
+    return true;
+}
+
+bool range_parser_init(struct range_parser *parser, struct bitmap *bm)
+{
+    if (parser == NULL)
+    {
+        return false;
+    }
+
+    memset(parser, 0, sizeof(struct range_parser));
+    parser->state = RANGE_STATE_ITEM;
+    parser->status = RANGE_PARSER_OK;
+
+    if (bm != NULL)
+    {
+        if (!bitmap_is_valid(bm))
+        {
+            return parser_fail(parser, RANGE_PARSER_RANGE, 0);
+        }
+
+        parser->bm = bm;
+
+        return true;
+    }
+
+    /*For parsing unsigned short maximum is used*/
+    parser->bm = bitMap_create(U16_MAX);
+    parser->owns_bm = true;
+
+    if (parser->bm == NULL)
+    {
+        return parser_fail(parser, RANGE_PARSER_NOMEM, 0);
+    }
+
+    return true;
+}
+
+bool range_parser_feed(struct range_parser *parser, const u8 *data, size_t len)
+{
+    size_t i = 0;
+    u8 ch = 0;
+
+    if (parser == NULL || parser->state == RANGE_STATE_ERROR)
+    {
+        return false;
+    }
+
+    for (i = 0; i < len; i++, parser->offset++)
+    {
+        ch = data[i];
+
+        if (isdigit(ch))
+        {
+            /* A blank between two digits does not join them into one number */
+            if (parser->state == RANGE_STATE_AFTER_FIRST || parser->state == RANGE_STATE_AFTER_SECOND)
+            {
+                return parser_fail(parser, RANGE_PARSER_SYNTAX, parser->offset);
+            }
+
+            if (!parser_digit(parser, ch))
+            {
+                return false;
+            }
+        }
+        else if (isspace(ch))
+        {
+            if ((parser->state == RANGE_STATE_FIRST || parser->state == RANGE_STATE_SECOND) && !parser_end_value(parser))
+            {
+                return false;
+            }
+        }
+        else if (ch == '-' && (parser->state == RANGE_STATE_FIRST || parser->state == RANGE_STATE_AFTER_FIRST))
+        {
+            if (!parser_end_value(parser))
+            {
+                return false;
+            }
+
+            parser->state = RANGE_STATE_SECOND_START;
+        }
+        else if (ch == ',' && parser->state != RANGE_STATE_ITEM && parser->state != RANGE_STATE_SECOND_START)
+        {
+            if (!parser_end_value(parser) || !parser_commit(parser))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return parser_fail(parser, RANGE_PARSER_SYNTAX, parser->offset);
+        }
+    }
+
+    return true;
+}
+
+struct bitmap *range_parser_finish(struct range_parser *parser)
+{
+    struct bitmap *bm = NULL;
+
+    if (parser == NULL)
+    {
+        return NULL;
+    }
+
+    if (parser->state == RANGE_STATE_ITEM || parser->state == RANGE_STATE_SECOND_START)
+    {
+        parser_fail(parser, RANGE_PARSER_SYNTAX, parser->offset);
+    }
+    else if (parser->state != RANGE_STATE_ERROR && parser_end_value(parser))
+    {
+        parser_commit(parser);
+    }
+
+    bm = parser->bm;
+    parser->bm = NULL;
+
+    if (parser->state == RANGE_STATE_ERROR)
+    {
+        if (parser->owns_bm)
+        {
+            bitmap_destroy(bm);
+        }
+
+        return NULL;
+    }
+
+    return bm;
+}
+
+static struct bitmap *parse_and_finish(struct range_parser *parser, u64 *error_offset)
+{
+    struct bitmap *bm = range_parser_finish(parser);
+
+    if (bm == NULL && error_offset != NULL)
+    {
+        *error_offset = parser->error_offset;
+    }
+
+    return bm;
+}
+
+struct bitmap *range_parse_buf(const u8 *buf, size_t len, u64 *error_offset)
+{
+    struct range_parser parser;
+
+    if (buf == NULL || !range_parser_init(&parser, NULL))
+    {
+        return NULL;
+    }
+
+    range_parser_feed(&parser, buf, len);
+
+    return parse_and_finish(&parser, error_offset);
+}
+
+struct bitmap *range_parse_file(FILE *fp, u64 *error_offset)
+{
+    struct range_parser parser;
+    u8 chunk[RANGE_PARSER_CHUNK];
+    size_t len = 0;
+
+    if (fp == NULL || !range_parser_init(&parser, NULL))
+    {
+        return NULL;
+    }
+
+    while ((len = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    {
+        if (!range_parser_feed(&parser, chunk, len))
+        {
+            break;
+        }
+    }
+
+    if (ferror(fp) && parser.state != RANGE_STATE_ERROR)
+    {
+        parser_fail(&parser, RANGE_PARSER_IO, parser.offset);
+    }
+
+    return parse_and_finish(&parser, error_offset);
+}
+
+struct bitmap *range_parse_fd(int fd, u64 *error_offset)
+{
+    struct range_parser parser;
+    u8 chunk[RANGE_PARSER_CHUNK];
+    ssize_t len = 0;
+
+    if (fd < 0 || !range_parser_init(&parser, NULL))
+    {
+        return NULL;
+    }
+
+    while (true)
+    {
+        len = read(fd, chunk, sizeof(chunk));
+
+        if (len < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (len < 0)
+        {
+            parser_fail(&parser, RANGE_PARSER_IO, parser.offset);
+        }
+
+        if (len <= 0 || !range_parser_feed(&parser, chunk, (size_t)len))
+        {
+            break;
+        }
+    }
+
+    return parse_and_finish(&parser, error_offset);
+}
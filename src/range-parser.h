@@ -0,0 +1,109 @@
+#ifndef RANGE_PARSER_H_INCLUDED
+#define RANGE_PARSER_H_INCLUDED
+
+#include <stdio.h>
+#include "bitmap.h"
+
+#define RANGE_PARSER_CHUNK 4096    /* Bytes read at a time from a FILE* or fd */
+
+enum range_parser_state
+{
+    RANGE_STATE_ITEM = 0,          /* Expecting the first number of an item */
+    RANGE_STATE_FIRST,             /* Inside the first number */
+    RANGE_STATE_AFTER_FIRST,       /* Blanks after the first number, '-' or ',' may follow */
+    RANGE_STATE_SECOND_START,      /* After '-', expecting the second number */
+    RANGE_STATE_SECOND,            /* Inside the second number */
+    RANGE_STATE_AFTER_SECOND,      /* Blanks after the second number, ',' may follow */
+    RANGE_STATE_ERROR
+};
+
+enum range_parser_status
+{
+    RANGE_PARSER_OK = 0,
+    RANGE_PARSER_SYNTAX,           /* Unexpected character, or the input ended inside an item */
+    RANGE_PARSER_RANGE,            /* A value is 0 or above the bitmap's max_value */
+    RANGE_PARSER_IO,               /* Reading the FILE* or fd failed */
+    RANGE_PARSER_NOMEM
+};
+
+/*
+ * Incremental parser for lists like "1-14, 15,16-77,70-14". Items are a value or a range of two
+ * values, in either order, separated by ','. Blanks may surround values and separators.
+ * All state lives in the struct, so any number of parsers can run at once.
+ */
+struct range_parser
+{
+    struct bitmap *bm;             /* The bitmap values are added to as they are parsed */
+    bool owns_bm;                  /* bm was created by range_parser_init and is destroyed on error */
+    u8 state;                      /* RANGE_STATE_* */
+    u8 status;                     /* RANGE_PARSER_* */
+    u32 first;                     /* First number of the current item */
+    u32 value;                     /* Number being read */
+    u64 value_offset;              /* Offset of the first digit of value */
+    u64 offset;                    /* Bytes consumed so far */
+    u64 error_offset;              /* Offset of the byte the error was found at */
+};
+
+/*****************************************************************************************************
+ * Name: range_parser_init
+ * Input:  parser  The parser to set up
+ *         bm      The bitmap to add to, NULL creates one holding values up to U16_MAX
+ * Return: Success   true
+ *         Failed    false
+ * Description: Start parsing a new list. A caller-supplied bm keeps the values added before an
+ *              error, a bitmap created here is destroyed by range_parser_finish on error
+ *****************************************************************************************************/
+bool range_parser_init(struct range_parser *parser, struct bitmap *bm);
+
+/*****************************************************************************************************
+ * Name: range_parser_feed
+ * Input:  parser  The parser
+ *         data    The next chunk of input, chunks may split numbers anywhere
+ *         len     Number of bytes in data
+ * Return: Success   true
+ *         Failed    false once an error was found, later chunks are ignored
+ * Description: Validate the chunk and add each item to the bitmap as soon as it is complete
+ *****************************************************************************************************/
+bool range_parser_feed(struct range_parser *parser, const u8 *data, size_t len);
+
+/*****************************************************************************************************
+ * Name: range_parser_finish
+ * Input:  parser  The parser
+ * Return: Success   The bitmap holding every parsed value
+ *         Failed    NULL, see parser->status and parser->error_offset
+ * Description: Complete the last item. An empty list or one ending in ',' or '-' is an error
+ *****************************************************************************************************/
+struct bitmap *range_parser_finish(struct range_parser *parser);
+
+/*****************************************************************************************************
+ * Name: range_parse_buf
+ * Input:  buf           The list to parse
+ *         len           Number of bytes in buf
+ *         error_offset  Receives the offset of the first bad byte on error, may be NULL
+ * Return: Success   A new bitmap holding values up to U16_MAX
+ *         Failed    NULL
+ * Description: Parse a list held in memory
+ *****************************************************************************************************/
+struct bitmap *range_parse_buf(const u8 *buf, size_t len, u64 *error_offset);
+
+/*****************************************************************************************************
+ * Name: range_parse_file
+ * Input:  fp            Stream the list is read from until EOF
+ *         error_offset  Receives the offset of the first bad byte on error, may be NULL
+ * Return: Success   A new bitmap holding values up to U16_MAX
+ *         Failed    NULL
+ * Description: Parse a list of any length with RANGE_PARSER_CHUNK bytes of buffer
+ *****************************************************************************************************/
+struct bitmap *range_parse_file(FILE *fp, u64 *error_offset);
+
+/*****************************************************************************************************
+ * Name: range_parse_fd
+ * Input:  fd            File descriptor the list is read from until EOF
+ *         error_offset  Receives the offset of the first bad byte on error, may be NULL
+ * Return: Success   A new bitmap holding values up to U16_MAX
+ *         Failed    NULL
+ * Description: Same as range_parse_file for a raw descriptor, reads interrupted by signals resume
+ *****************************************************************************************************/
+struct bitmap *range_parse_fd(int fd, u64 *error_offset);
+
+#endif // RANGE_PARSER_H_INCLUDED
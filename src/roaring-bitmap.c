@@ -0,0 +1,1724 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+#include "bit-ops.h"
+#include "popcount.h"
+#include "roaring-bitmap.h"
+
+#define ROARING_BITSET_BYTES (ROARING_BITSET_WORDS * sizeof(u32))
+
+/*************************************************************
+ * Name: roaring_check
+ * Input: rb         The compressed bitmap to validate
+ * Return: Success   true
+ *         Failed    false
+ * Description: Check that rb was created by roaring_bitmap_create
+ **************************************************************/
+static bool roaring_check(struct roaring_bitmap *rb);
+
+/*Container helpers, every container holds the low 16 bits of the values of one chunk*/
+static void container_free(struct roaring_container *c);
+static bool container_init(struct roaring_container *c, u16 type, u32 entries);
+static bool container_reserve(struct roaring_container *c, u32 entries);
+static bool container_clone(const struct roaring_container *c, struct roaring_container *out);
+static bool container_contains(const struct roaring_container *c, u16 value);
+static bool container_add(struct roaring_container *c, u16 value, bool *changed);
+static bool container_del(struct roaring_container *c, u16 value, bool *changed);
+static bool container_to_array(struct roaring_container *c);
+static bool container_to_bitset(struct roaring_container *c);
+static bool container_to_run(struct roaring_container *c);
+static bool container_repack(struct roaring_container *c);
+static bool container_and(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out);
+static bool container_or(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out);
+static bool container_not(const struct roaring_container *c, u32 hi, struct roaring_container *out);
+
+static bool roaring_check(struct roaring_bitmap *rb)
+{
+    if (rb != NULL && rb == rb->rb_self)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+static size_t container_entry_size(u16 type)
+{
+    if (type == ROARING_ARRAY)
+    {
+        return sizeof(u16);
+    }
+
+    if (type == ROARING_RUN)
+    {
+        return sizeof(struct roaring_run);
+    }
+
+    return sizeof(u32);
+}
+
+static void container_free(struct roaring_container *c)
+{
+    free(c->data);
+    memset(c, 0, sizeof(*c));
+
+    return;
+}
+
+static bool container_reserve(struct roaring_container *c, u32 entries)
+{
+    u32 capacity = c->capacity == 0 ? 4 : c->capacity;
+    void *data = NULL;
+
+    if (entries <= c->capacity)
+    {
+        return true;
+    }
+
+    while (capacity < entries)
+    {
+        capacity *= 2;
+    }
+
+    data = realloc(c->data, capacity * container_entry_size(c->type));
+
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    c->data = data;
+    c->capacity = capacity;
+
+    return true;
+}
+
+static bool container_init(struct roaring_container *c, u16 type, u32 entries)
+{
+    memset(c, 0, sizeof(*c));
+    c->type = type;
+
+    if (type == ROARING_BITSET)
+    {
+        c->data = calloc(ROARING_BITSET_WORDS, sizeof(u32));
+        c->capacity = ROARING_BITSET_WORDS;
+
+        return c->data != NULL;
+    }
+
+    if (entries == 0)
+    {
+        return true;
+    }
+
+    return container_reserve(c, entries);
+}
+
+static bool container_clone(const struct roaring_container *c, struct roaring_container *out)
+{
+    u32 entries = c->type == ROARING_BITSET ? ROARING_BITSET_WORDS : c->size;
+
+    if (!container_init(out, c->type, entries))
+    {
+        return false;
+    }
+
+    memcpy(out->data, c->data, entries * container_entry_size(c->type));
+    out->size = c->size;
+    out->cardinality = c->cardinality;
+
+    return true;
+}
+
+/* Index of the first entry >= value */
+static u32 array_lower_bound(const u16 *values, u32 size, u16 value)
+{
+    u32 lo = 0;
+    u32 hi = size;
+    u32 mid = 0;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if (values[mid] < value)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* Index of the run that starts at or before value, size when value precedes every run */
+static u32 run_find(const struct roaring_run *runs, u32 size, u16 value)
+{
+    u32 lo = 0;
+    u32 hi = size;
+    u32 mid = 0;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if (runs[mid].start <= value)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo == 0 ? size : lo - 1;
+}
+
+static u32 run_end(const struct roaring_run *run)
+{
+    return (u32)run->start + run->length;
+}
+
+/* Append start..end to a run container, merging with the last run when they touch */
+static bool run_append(struct roaring_container *c, u32 start, u32 end)
+{
+    struct roaring_run *runs = (struct roaring_run *)c->data;
+
+    if (c->size > 0 && start <= run_end(&runs[c->size - 1]) + 1)
+    {
+        if (end > run_end(&runs[c->size - 1]))
+        {
+            runs[c->size - 1].length = (u16)(end - runs[c->size - 1].start);
+        }
+
+        return true;
+    }
+
+    if (!container_reserve(c, c->size + 1))
+    {
+        return false;
+    }
+
+    runs = (struct roaring_run *)c->data;
+    runs[c->size].start = (u16)start;
+    runs[c->size].length = (u16)(end - start);
+    c->size++;
+
+    return true;
+}
+
+static u32 run_cardinality(const struct roaring_container *c)
+{
+    const struct roaring_run *runs = (const struct roaring_run *)c->data;
+    u32 count = 0;
+    u32 i = 0;
+
+    for (i = 0; i < c->size; i++)
+    {
+        count += (u32)runs[i].length + 1;
+    }
+
+    return count;
+}
+
+static void bitset_set_range(u32 *words, u32 lo, u32 hi)
+{
+    u32 lo_word = lo / UINT_BITS;
+    u32 hi_word = hi / UINT_BITS;
+    u32 lo_mask = ~0U << (lo % UINT_BITS);
+    u32 hi_mask = ~0U >> (UINT_BITS - 1 - hi % UINT_BITS);
+    u32 i = 0;
+
+    if (lo_word == hi_word)
+    {
+        words[lo_word] |= lo_mask & hi_mask;
+
+        return;
+    }
+
+    words[lo_word] |= lo_mask;
+
+    for (i = lo_word + 1; i < hi_word; i++)
+    {
+        words[i] = ~0U;
+    }
+
+    words[hi_word] |= hi_mask;
+
+    return;
+}
+
+static void bitset_flip_range(u32 *words, u32 lo, u32 hi)
+{
+    u32 lo_word = lo / UINT_BITS;
+    u32 hi_word = hi / UINT_BITS;
+    u32 lo_mask = ~0U << (lo % UINT_BITS);
+    u32 hi_mask = ~0U >> (UINT_BITS - 1 - hi % UINT_BITS);
+    u32 i = 0;
+
+    if (lo_word == hi_word)
+    {
+        words[lo_word] ^= lo_mask & hi_mask;
+
+        return;
+    }
+
+    words[lo_word] ^= lo_mask;
+
+    for (i = lo_word + 1; i < hi_word; i++)
+    {
+        words[i] = ~words[i];
+    }
+
+    words[hi_word] ^= hi_mask;
+
+    return;
+}
+
+/* dst |= src restricted to lo..hi */
+static void bitset_copy_range(u32 *dst, const u32 *src, u32 lo, u32 hi)
+{
+    u32 lo_word = lo / UINT_BITS;
+    u32 hi_word = hi / UINT_BITS;
+    u32 lo_mask = ~0U << (lo % UINT_BITS);
+    u32 hi_mask = ~0U >> (UINT_BITS - 1 - hi % UINT_BITS);
+    u32 i = 0;
+
+    if (lo_word == hi_word)
+    {
+        dst[lo_word] |= src[lo_word] & lo_mask & hi_mask;
+
+        return;
+    }
+
+    dst[lo_word] |= src[lo_word] & lo_mask;
+
+    for (i = lo_word + 1; i < hi_word; i++)
+    {
+        dst[i] = src[i];
+    }
+
+    dst[hi_word] |= src[hi_word] & hi_mask;
+
+    return;
+}
+
+/* First position >= pos whose bit equals set, ROARING_CHUNK_BITS when there is none */
+static u32 bitset_scan(const u32 *words, u32 pos, bool set)
+{
+    u32 index = pos / UINT_BITS;
+    u32 word = 0;
+
+    if (pos >= ROARING_CHUNK_BITS)
+    {
+        return ROARING_CHUNK_BITS;
+    }
+
+    word = (set ? words[index] : ~words[index]) & (~0U << (pos % UINT_BITS));
+
+    while (word == 0)
+    {
+        if (++index >= ROARING_BITSET_WORDS)
+        {
+            return ROARING_CHUNK_BITS;
+        }
+
+        word = set ? words[index] : ~words[index];
+    }
+
+    return index * UINT_BITS + ctz32(word);
+}
+
+static u32 container_count_runs(const struct roaring_container *c)
+{
+    const u32 *words = (const u32 *)c->data;
+    const u16 *values = (const u16 *)c->data;
+    u32 runs = 0;
+    u32 carry = 0;
+    u32 i = 0;
+
+    if (c->type == ROARING_RUN)
+    {
+        return c->size;
+    }
+
+    if (c->type == ROARING_ARRAY)
+    {
+        for (i = 0; i < c->size; i++)
+        {
+            if (i == 0 || values[i] != values[i - 1] + 1)
+            {
+                runs++;
+            }
+        }
+
+        return runs;
+    }
+
+    /* A run starts on every '1' bit whose lower neighbour is '0' */
+    for (i = 0; i < ROARING_BITSET_WORDS; i++)
+    {
+        runs += popcount32(words[i] & ~((words[i] << 1) | carry));
+        carry = words[i] >> (UINT_BITS - 1);
+    }
+
+    return runs;
+}
+
+static bool container_to_bitset(struct roaring_container *c)
+{
+    struct roaring_container out;
+    const u16 *values = (const u16 *)c->data;
+    const struct roaring_run *runs = (const struct roaring_run *)c->data;
+    u32 *words = NULL;
+    u32 i = 0;
+
+    if (c->type == ROARING_BITSET)
+    {
+        return true;
+    }
+
+    if (!container_init(&out, ROARING_BITSET, 0))
+    {
+        return false;
+    }
+
+    words = (u32 *)out.data;
+
+    for (i = 0; i < c->size; i++)
+    {
+        if (c->type == ROARING_ARRAY)
+        {
+            words[values[i] / UINT_BITS] |= 1U << (values[i] % UINT_BITS);
+        }
+        else
+        {
+            bitset_set_range(words, runs[i].start, run_end(&runs[i]));
+        }
+    }
+
+    out.cardinality = c->cardinality;
+    container_free(c);
+    *c = out;
+
+    return true;
+}
+
+static bool container_to_array(struct roaring_container *c)
+{
+    struct roaring_container out;
+    const u32 *words = (const u32 *)c->data;
+    const struct roaring_run *runs = (const struct roaring_run *)c->data;
+    u16 *values = NULL;
+    u32 word = 0;
+    u32 value = 0;
+    u32 i = 0;
+
+    if (c->type == ROARING_ARRAY)
+    {
+        return true;
+    }
+
+    if (!container_init(&out, ROARING_ARRAY, c->cardinality))
+    {
+        return false;
+    }
+
+    values = (u16 *)out.data;
+
+    if (c->type == ROARING_BITSET)
+    {
+        for (i = 0; i < ROARING_BITSET_WORDS; i++)
+        {
+            for (word = words[i]; word != 0; word &= word - 1)
+            {
+                values[out.size++] = (u16)(i * UINT_BITS + ctz32(word));
+            }
+        }
+    }
+    else
+    {
+        for (i = 0; i < c->size; i++)
+        {
+            for (value = runs[i].start; value <= run_end(&runs[i]); value++)
+            {
+                values[out.size++] = (u16)value;
+            }
+        }
+    }
+
+    out.cardinality = out.size;
+    container_free(c);
+    *c = out;
+
+    return true;
+}
+
+static bool container_to_run(struct roaring_container *c)
+{
+    struct roaring_container out;
+    const u32 *words = (const u32 *)c->data;
+    const u16 *values = (const u16 *)c->data;
+    u32 start = 0;
+    u32 end = 0;
+    u32 i = 0;
+    bool ok = true;
+
+    if (c->type == ROARING_RUN)
+    {
+        return true;
+    }
+
+    if (!container_init(&out, ROARING_RUN, container_count_runs(c)))
+    {
+        return false;
+    }
+
+    if (c->type == ROARING_ARRAY)
+    {
+        for (i = 0; ok && i < c->size; i++)
+        {
+            ok = run_append(&out, values[i], values[i]);
+        }
+    }
+    else
+    {
+        start = bitset_scan(words, 0, true);
+
+        while (ok && start < ROARING_CHUNK_BITS)
+        {
+            end = bitset_scan(words, start, false);
+            ok = run_append(&out, start, end - 1);
+            start = bitset_scan(words, end, true);
+        }
+    }
+
+    if (!ok)
+    {
+        container_free(&out);
+
+        return false;
+    }
+
+    out.cardinality = c->cardinality;
+    container_free(c);
+    *c = out;
+
+    return true;
+}
+
+static bool container_repack(struct roaring_container *c)
+{
+    size_t run_bytes = container_count_runs(c) * sizeof(struct roaring_run);
+    size_t array_bytes = c->cardinality * sizeof(u16);
+
+    if (c->cardinality > ROARING_ARRAY_MAX)
+    {
+        array_bytes = ROARING_BITSET_BYTES + 1;
+    }
+
+    if (run_bytes < array_bytes && run_bytes < ROARING_BITSET_BYTES)
+    {
+        return container_to_run(c);
+    }
+
+    if (array_bytes <= ROARING_BITSET_BYTES)
+    {
+        return container_to_array(c);
+    }
+
+    return container_to_bitset(c);
+}
+
+/* Leave the run layout once it has grown bigger than the alternative */
+static bool container_run_fixup(struct roaring_container *c)
+{
+    size_t run_bytes = c->size * sizeof(struct roaring_run);
+
+    if (c->cardinality <= ROARING_ARRAY_MAX)
+    {
+        return run_bytes <= c->cardinality * sizeof(u16) || container_to_array(c);
+    }
+
+    return run_bytes <= ROARING_BITSET_BYTES || container_to_bitset(c);
+}
+
+static bool container_contains(const struct roaring_container *c, u16 value)
+{
+    const u16 *values = (const u16 *)c->data;
+    const u32 *words = (const u32 *)c->data;
+    const struct roaring_run *runs = (const struct roaring_run *)c->data;
+    u32 pos = 0;
+
+    if (c->type == ROARING_ARRAY)
+    {
+        pos = array_lower_bound(values, c->size, value);
+
+        return pos < c->size && values[pos] == value;
+    }
+
+    if (c->type == ROARING_BITSET)
+    {
+        return (words[value / UINT_BITS] >> (value % UINT_BITS)) & 1U;
+    }
+
+    pos = run_find(runs, c->size, value);
+
+    return pos < c->size && value <= run_end(&runs[pos]);
+}
+
+static bool container_add(struct roaring_container *c, u16 value, bool *changed)
+{
+    struct roaring_run *runs = NULL;
+    u16 *values = NULL;
+    u32 pos = 0;
+    u32 next = 0;
+    bool join_prev = false;
+    bool join_next = false;
+
+    *changed = false;
+
+    if (container_contains(c, value))
+    {
+        return true;
+    }
+
+    if (c->type == ROARING_BITSET)
+    {
+        ((u32 *)c->data)[value / UINT_BITS] |= 1U << (value % UINT_BITS);
+        c->cardinality++;
+        *changed = true;
+
+        return true;
+    }
+
+    if (c->type == ROARING_ARRAY)
+    {
+        if (c->cardinality == ROARING_ARRAY_MAX)
+        {
+            if (!container_to_bitset(c))
+            {
+                return false;
+            }
+
+            return container_add(c, value, changed);
+        }
+
+        if (!container_reserve(c, c->size + 1))
+        {
+            return false;
+        }
+
+        values = (u16 *)c->data;
+        pos = array_lower_bound(values, c->size, value);
+        memmove(values + pos + 1, values + pos, (c->size - pos) * sizeof(u16));
+        values[pos] = value;
+        c->size++;
+        c->cardinality++;
+        *changed = true;
+
+        return true;
+    }
+
+    runs = (struct roaring_run *)c->data;
+    pos = run_find(runs, c->size, value);
+    next = pos == c->size ? 0 : pos + 1;
+    join_prev = pos < c->size && run_end(&runs[pos]) + 1 == value;
+    join_next = next < c->size && (u32)value + 1 == runs[next].start;
+
+    if (join_prev && join_next)
+    {
+        runs[pos].length = (u16)(run_end(&runs[next]) - runs[pos].start);
+        memmove(runs + next, runs + next + 1, (c->size - next - 1) * sizeof(struct roaring_run));
+        c->size--;
+    }
+    else if (join_prev)
+    {
+        runs[pos].length++;
+    }
+    else if (join_next)
+    {
+        runs[next].start--;
+        runs[next].length++;
+    }
+    else
+    {
+        if (!container_reserve(c, c->size + 1))
+        {
+            return false;
+        }
+
+        runs = (struct roaring_run *)c->data;
+        memmove(runs + next + 1, runs + next, (c->size - next) * sizeof(struct roaring_run));
+        runs[next].start = value;
+        runs[next].length = 0;
+        c->size++;
+    }
+
+    c->cardinality++;
+    *changed = true;
+
+    return container_run_fixup(c);
+}
+
+static bool container_del(struct roaring_container *c, u16 value, bool *changed)
+{
+    struct roaring_run *runs = NULL;
+    u16 *values = NULL;
+    u32 pos = 0;
+    u32 end = 0;
+
+    *changed = false;
+
+    if (!container_contains(c, value))
+    {
+        return true;
+    }
+
+    if (c->type == ROARING_BITSET)
+    {
+        ((u32 *)c->data)[value / UINT_BITS] &= ~(1U << (value % UINT_BITS));
+        c->cardinality--;
+        *changed = true;
+
+        return c->cardinality > ROARING_ARRAY_MAX || container_to_array(c);
+    }
+
+    if (c->type == ROARING_ARRAY)
+    {
+        values = (u16 *)c->data;
+        pos = array_lower_bound(values, c->size, value);
+        memmove(values + pos, values + pos + 1, (c->size - pos - 1) * sizeof(u16));
+        c->size--;
+        c->cardinality--;
+        *changed = true;
+
+        return true;
+    }
+
+    runs = (struct roaring_run *)c->data;
+    pos = run_find(runs, c->size, value);
+    end = run_end(&runs[pos]);
+
+    if (runs[pos].length == 0)
+    {
+        memmove(runs + pos, runs + pos + 1, (c->size - pos - 1) * sizeof(struct roaring_run));
+        c->size--;
+    }
+    else if (value == runs[pos].start)
+    {
+        runs[pos].start++;
+        runs[pos].length--;
+    }
+    else if (value == end)
+    {
+        runs[pos].length--;
+    }
+    else
+    {
+        /* Split the run around value */
+        if (!container_reserve(c, c->size + 1))
+        {
+            return false;
+        }
+
+        runs = (struct roaring_run *)c->data;
+        memmove(runs + pos + 2, runs + pos + 1, (c->size - pos - 1) * sizeof(struct roaring_run));
+        runs[pos + 1].start = (u16)(value + 1);
+        runs[pos + 1].length = (u16)(end - value - 1);
+        runs[pos].length = (u16)(value - 1 - runs[pos].start);
+        c->size++;
+    }
+
+    c->cardinality--;
+    *changed = true;
+
+    return container_run_fixup(c);
+}
+
+/*AND kernels, one per container pair*/
+static bool and_array_array(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const u16 *va = (const u16 *)a->data;
+    const u16 *vb = (const u16 *)b->data;
+    u16 *values = NULL;
+    u32 i = 0;
+    u32 j = 0;
+
+    if (!container_init(out, ROARING_ARRAY, a->size < b->size ? a->size : b->size))
+    {
+        return false;
+    }
+
+    values = (u16 *)out->data;
+
+    while (i < a->size && j < b->size)
+    {
+        if (va[i] < vb[j])
+        {
+            i++;
+        }
+        else if (va[i] > vb[j])
+        {
+            j++;
+        }
+        else
+        {
+            values[out->size++] = va[i];
+            i++;
+            j++;
+        }
+    }
+
+    out->cardinality = out->size;
+
+    return true;
+}
+
+static bool and_array_bitset(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const u16 *va = (const u16 *)a->data;
+    const u32 *words = (const u32 *)b->data;
+    u16 *values = NULL;
+    u32 i = 0;
+
+    if (!container_init(out, ROARING_ARRAY, a->size))
+    {
+        return false;
+    }
+
+    values = (u16 *)out->data;
+
+    for (i = 0; i < a->size; i++)
+    {
+        if ((words[va[i] / UINT_BITS] >> (va[i] % UINT_BITS)) & 1U)
+        {
+            values[out->size++] = va[i];
+        }
+    }
+
+    out->cardinality = out->size;
+
+    return true;
+}
+
+static bool and_array_run(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const u16 *va = (const u16 *)a->data;
+    const struct roaring_run *runs = (const struct roaring_run *)b->data;
+    u16 *values = NULL;
+    u32 i = 0;
+    u32 j = 0;
+
+    if (!container_init(out, ROARING_ARRAY, a->size))
+    {
+        return false;
+    }
+
+    values = (u16 *)out->data;
+
+    while (i < a->size && j < b->size)
+    {
+        if (va[i] < runs[j].start)
+        {
+            i++;
+        }
+        else if (va[i] > run_end(&runs[j]))
+        {
+            j++;
+        }
+        else
+        {
+            values[out->size++] = va[i++];
+        }
+    }
+
+    out->cardinality = out->size;
+
+    return true;
+}
+
+static bool and_bitset_bitset(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const u32 *wa = (const u32 *)a->data;
+    const u32 *wb = (const u32 *)b->data;
+    u32 *words = NULL;
+    u32 i = 0;
+
+    if (!container_init(out, ROARING_BITSET, 0))
+    {
+        return false;
+    }
+
+    words = (u32 *)out->data;
+
+    for (i = 0; i < ROARING_BITSET_WORDS; i++)
+    {
+        words[i] = wa[i] & wb[i];
+    }
+
+    out->cardinality = (u32)popcount_buf(words, ROARING_BITSET_BYTES);
+
+    return true;
+}
+
+static bool and_bitset_run(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const struct roaring_run *runs = (const struct roaring_run *)b->data;
+    u32 i = 0;
+
+    if (!container_init(out, ROARING_BITSET, 0))
+    {
+        return false;
+    }
+
+    for (i = 0; i < b->size; i++)
+    {
+        bitset_copy_range((u32 *)out->data, (const u32 *)a->data, runs[i].start, run_end(&runs[i]));
+    }
+
+    out->cardinality = (u32)popcount_buf(out->data, ROARING_BITSET_BYTES);
+
+    return true;
+}
+
+static bool and_run_run(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const struct roaring_run *ra = (const struct roaring_run *)a->data;
+    const struct roaring_run *rb = (const struct roaring_run *)b->data;
+    u32 lo = 0;
+    u32 hi = 0;
+    u32 i = 0;
+    u32 j = 0;
+
+    if (!container_init(out, ROARING_RUN, 0))
+    {
+        return false;
+    }
+
+    while (i < a->size && j < b->size)
+    {
+        lo = ra[i].start > rb[j].start ? ra[i].start : rb[j].start;
+        hi = run_end(&ra[i]) < run_end(&rb[j]) ? run_end(&ra[i]) : run_end(&rb[j]);
+
+        if (lo <= hi && !run_append(out, lo, hi))
+        {
+            return false;
+        }
+
+        if (run_end(&ra[i]) < run_end(&rb[j]))
+        {
+            i++;
+        }
+        else
+        {
+            j++;
+        }
+    }
+
+    out->cardinality = run_cardinality(out);
+
+    return true;
+}
+
+/*OR kernels, one per container pair*/
+static bool or_array_array(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const u16 *va = (const u16 *)a->data;
+    const u16 *vb = (const u16 *)b->data;
+    u16 *values = NULL;
+    u32 i = 0;
+    u32 j = 0;
+
+    if (!container_init(out, ROARING_ARRAY, a->size + b->size))
+    {
+        return false;
+    }
+
+    values = (u16 *)out->data;
+
+    while (i < a->size || j < b->size)
+    {
+        if (j == b->size || (i < a->size && va[i] < vb[j]))
+        {
+            values[out->size++] = va[i++];
+        }
+        else if (i == a->size || vb[j] < va[i])
+        {
+            values[out->size++] = vb[j++];
+        }
+        else
+        {
+            values[out->size++] = va[i];
+            i++;
+            j++;
+        }
+    }
+
+    out->cardinality = out->size;
+
+    return true;
+}
+
+static bool or_array_bitset(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const u16 *va = (const u16 *)a->data;
+    u32 *words = NULL;
+    u32 mask = 0;
+    u32 i = 0;
+
+    if (!container_clone(b, out))
+    {
+        return false;
+    }
+
+    words = (u32 *)out->data;
+
+    for (i = 0; i < a->size; i++)
+    {
+        mask = 1U << (va[i] % UINT_BITS);
+        out->cardinality += (words[va[i] / UINT_BITS] & mask) == 0;
+        words[va[i] / UINT_BITS] |= mask;
+    }
+
+    return true;
+}
+
+static bool or_bitset_bitset(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const u32 *wa = (const u32 *)a->data;
+    const u32 *wb = (const u32 *)b->data;
+    u32 *words = NULL;
+    u32 i = 0;
+
+    if (!container_init(out, ROARING_BITSET, 0))
+    {
+        return false;
+    }
+
+    words = (u32 *)out->data;
+
+    for (i = 0; i < ROARING_BITSET_WORDS; i++)
+    {
+        words[i] = wa[i] | wb[i];
+    }
+
+    out->cardinality = (u32)popcount_buf(words, ROARING_BITSET_BYTES);
+
+    return true;
+}
+
+static bool or_bitset_run(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const struct roaring_run *runs = (const struct roaring_run *)b->data;
+    u32 i = 0;
+
+    if (!container_clone(a, out))
+    {
+        return false;
+    }
+
+    for (i = 0; i < b->size; i++)
+    {
+        bitset_set_range((u32 *)out->data, runs[i].start, run_end(&runs[i]));
+    }
+
+    out->cardinality = (u32)popcount_buf(out->data, ROARING_BITSET_BYTES);
+
+    return true;
+}
+
+/* Merge two sorted run lists, taking whichever run starts first */
+static bool or_runs(const struct roaring_run *ra, u32 na, const struct roaring_run *rb, u32 nb, struct roaring_container *out)
+{
+    u32 i = 0;
+    u32 j = 0;
+    bool ok = true;
+
+    if (!container_init(out, ROARING_RUN, na + nb))
+    {
+        return false;
+    }
+
+    while (ok && (i < na || j < nb))
+    {
+        if (j == nb || (i < na && ra[i].start <= rb[j].start))
+        {
+            ok = run_append(out, ra[i].start, run_end(&ra[i]));
+            i++;
+        }
+        else
+        {
+            ok = run_append(out, rb[j].start, run_end(&rb[j]));
+            j++;
+        }
+    }
+
+    out->cardinality = run_cardinality(out);
+
+    return ok;
+}
+
+static bool or_array_run(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const u16 *va = (const u16 *)a->data;
+    struct roaring_run *single = NULL;
+    u32 i = 0;
+    bool ok = false;
+
+    /* Every array value is a run of length 0 */
+    single = (struct roaring_run *)malloc(a->size * sizeof(struct roaring_run));
+
+    if (single == NULL)
+    {
+        return false;
+    }
+
+    for (i = 0; i < a->size; i++)
+    {
+        single[i].start = va[i];
+        single[i].length = 0;
+    }
+
+    ok = or_runs(single, a->size, (const struct roaring_run *)b->data, b->size, out);
+    free(single);
+
+    return ok;
+}
+
+static bool container_and(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const struct roaring_container *swap = NULL;
+    bool ok = false;
+
+    /* Order the pair as ARRAY < BITSET < RUN so every combination has one kernel */
+    if (a->type > b->type)
+    {
+        swap = a;
+        a = b;
+        b = swap;
+    }
+
+    if (a->type == ROARING_ARRAY)
+    {
+        if (b->type == ROARING_ARRAY)
+        {
+            ok = and_array_array(a, b, out);
+        }
+        else if (b->type == ROARING_BITSET)
+        {
+            ok = and_array_bitset(a, b, out);
+        }
+        else
+        {
+            ok = and_array_run(a, b, out);
+        }
+    }
+    else if (a->type == ROARING_BITSET)
+    {
+        ok = b->type == ROARING_BITSET ? and_bitset_bitset(a, b, out) : and_bitset_run(a, b, out);
+    }
+    else
+    {
+        ok = and_run_run(a, b, out);
+    }
+
+    if (ok && out->cardinality > 0)
+    {
+        ok = container_repack(out);
+    }
+
+    if (!ok)
+    {
+        container_free(out);
+    }
+
+    return ok;
+}
+
+static bool container_or(const struct roaring_container *a, const struct roaring_container *b, struct roaring_container *out)
+{
+    const struct roaring_container *swap = NULL;
+    bool ok = false;
+
+    if (a->type > b->type)
+    {
+        swap = a;
+        a = b;
+        b = swap;
+    }
+
+    if (a->type == ROARING_ARRAY)
+    {
+        if (b->type == ROARING_ARRAY)
+        {
+            ok = or_array_array(a, b, out);
+        }
+        else if (b->type == ROARING_BITSET)
+        {
+            ok = or_array_bitset(a, b, out);
+        }
+        else
+        {
+            ok = or_array_run(a, b, out);
+        }
+    }
+    else if (a->type == ROARING_BITSET)
+    {
+        ok = b->type == ROARING_BITSET ? or_bitset_bitset(a, b, out) : or_bitset_run(a, b, out);
+    }
+    else
+    {
+        ok = or_runs((const struct roaring_run *)a->data, a->size, (const struct roaring_run *)b->data, b->size, out);
+    }
+
+    if (ok)
+    {
+        ok = container_repack(out);
+    }
+
+    if (!ok)
+    {
+        container_free(out);
+    }
+
+    return ok;
+}
+
+static bool container_not(const struct roaring_container *c, u32 hi, struct roaring_container *out)
+{
+    bool ok = container_clone(c, out) && container_to_bitset(out);
+
+    if (ok)
+    {
+        /* Flip 0..hi, the bits above hi belong to values beyond max_value and are kept */
+        bitset_flip_range((u32 *)out->data, 0, hi);
+        out->cardinality = (u32)popcount_buf(out->data, ROARING_BITSET_BYTES);
+        ok = out->cardinality == 0 || container_repack(out);
+    }
+
+    if (!ok)
+    {
+        container_free(out);
+    }
+
+    return ok;
+}
+
+/* Position of key in rb->keys, or the position it would be inserted at */
+static bool roaring_find_key(struct roaring_bitmap *rb, u16 key, u32 *pos)
+{
+    u32 lo = 0;
+    u32 hi = rb->size;
+    u32 mid = 0;
+
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+
+        if (rb->keys[mid] < key)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    *pos = lo;
+
+    return lo < rb->size && rb->keys[lo] == key;
+}
+
+static bool roaring_reserve(struct roaring_bitmap *rb, u32 chunks)
+{
+    u16 *keys = NULL;
+    struct roaring_container *containers = NULL;
+    u32 capacity = rb->capacity == 0 ? 4 : rb->capacity;
+
+    if (chunks <= rb->capacity)
+    {
+        return true;
+    }
+
+    while (capacity < chunks)
+    {
+        capacity *= 2;
+    }
+
+    keys = (u16 *)realloc(rb->keys, capacity * sizeof(u16));
+
+    if (keys == NULL)
+    {
+        return false;
+    }
+
+    rb->keys = keys;
+    containers = (struct roaring_container *)realloc(rb->containers, capacity * sizeof(struct roaring_container));
+
+    if (containers == NULL)
+    {
+        return false;
+    }
+
+    rb->containers = containers;
+    rb->capacity = capacity;
+
+    return true;
+}
+
+static void roaring_remove_at(struct roaring_bitmap *rb, u32 pos)
+{
+    container_free(&rb->containers[pos]);
+    memmove(rb->keys + pos, rb->keys + pos + 1, (rb->size - pos - 1) * sizeof(u16));
+    memmove(rb->containers + pos, rb->containers + pos + 1, (rb->size - pos - 1) * sizeof(struct roaring_container));
+    rb->size--;
+
+    return;
+}
+
+/* Install a freshly built chunk list, the containers of the old one must already be released */
+static void roaring_replace(struct roaring_bitmap *rb, u16 *keys, struct roaring_container *containers, u32 size, u32 capacity)
+{
+    free(rb->keys);
+    free(rb->containers);
+    rb->keys = keys;
+    rb->containers = containers;
+    rb->size = size;
+    rb->capacity = capacity;
+
+    return;
+}
+
+struct roaring_bitmap *roaring_bitmap_create(void)
+{
+    struct roaring_bitmap *rb = (struct roaring_bitmap *)calloc(1, sizeof(struct roaring_bitmap));
+
+    if (rb == NULL)
+    {
+        return NULL;
+    }
+
+    rb->rb_self = rb;
+
+    return rb;
+}
+
+void roaring_bitmap_destroy(struct roaring_bitmap *rb)
+{
+    u32 i = 0;
+
+    if (!roaring_check(rb))
+    {
+        return;
+    }
+
+    for (i = 0; i < rb->size; i++)
+    {
+        container_free(&rb->containers[i]);
+    }
+
+    free(rb->keys);
+    free(rb->containers);
+    rb->rb_self = NULL;
+    free(rb);
+
+    return;
+}
+
+bool roaring_bitmap_add_value(struct roaring_bitmap *rb, u32 value)
+{
+    u16 key = (u16)(value >> 16);
+    u32 pos = 0;
+    bool changed = false;
+
+    if (!roaring_check(rb))
+    {
+        return false;
+    }
+
+    if (!roaring_find_key(rb, key, &pos))
+    {
+        if (!roaring_reserve(rb, rb->size + 1))
+        {
+            return false;
+        }
+
+        memmove(rb->keys + pos + 1, rb->keys + pos, (rb->size - pos) * sizeof(u16));
+        memmove(rb->containers + pos + 1, rb->containers + pos, (rb->size - pos) * sizeof(struct roaring_container));
+        rb->keys[pos] = key;
+        container_init(&rb->containers[pos], ROARING_ARRAY, 0);
+        rb->size++;
+    }
+
+    if (!container_add(&rb->containers[pos], (u16)value, &changed))
+    {
+        if (rb->containers[pos].cardinality == 0)
+        {
+            roaring_remove_at(rb, pos);
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+bool roaring_bitmap_del_value(struct roaring_bitmap *rb, u32 value)
+{
+    u32 pos = 0;
+    bool changed = false;
+
+    if (!roaring_check(rb) || !roaring_find_key(rb, (u16)(value >> 16), &pos))
+    {
+        return false;
+    }
+
+    if (!container_del(&rb->containers[pos], (u16)value, &changed))
+    {
+        return false;
+    }
+
+    if (rb->containers[pos].cardinality == 0)
+    {
+        roaring_remove_at(rb, pos);
+    }
+
+    return changed;
+}
+
+bool roaring_bitmap_contains(struct roaring_bitmap *rb, u32 value)
+{
+    u32 pos = 0;
+
+    if (!roaring_check(rb) || !roaring_find_key(rb, (u16)(value >> 16), &pos))
+    {
+        return false;
+    }
+
+    return container_contains(&rb->containers[pos], (u16)value);
+}
+
+u64 roaring_bitmap_cardinality(struct roaring_bitmap *rb)
+{
+    u64 count = 0;
+    u32 i = 0;
+
+    if (!roaring_check(rb))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < rb->size; i++)
+    {
+        count += rb->containers[i].cardinality;
+    }
+
+    return count;
+}
+
+size_t roaring_bitmap_size_in_bytes(struct roaring_bitmap *rb)
+{
+    const struct roaring_container *c = NULL;
+    size_t bytes = 0;
+    u32 i = 0;
+
+    if (!roaring_check(rb))
+    {
+        return 0;
+    }
+
+    bytes = sizeof(struct roaring_bitmap) + rb->size * (sizeof(u16) + sizeof(struct roaring_container));
+
+    for (i = 0; i < rb->size; i++)
+    {
+        c = &rb->containers[i];
+        bytes += c->type == ROARING_BITSET ? ROARING_BITSET_BYTES : c->size * container_entry_size(c->type);
+    }
+
+    return bytes;
+}
+
+bool roaring_bitmap_optimize(struct roaring_bitmap *rb)
+{
+    u32 i = 0;
+
+    if (!roaring_check(rb))
+    {
+        return false;
+    }
+
+    for (i = 0; i < rb->size; i++)
+    {
+        if (!container_repack(&rb->containers[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool roaring_bitmap_and(struct roaring_bitmap *rb_store, struct roaring_bitmap *rb)
+{
+    struct roaring_container out;
+    u32 i = 0;
+    u32 j = 0;
+    u32 n = 0;
+    bool ok = true;
+
+    if (!roaring_check(rb_store) || !roaring_check(rb))
+    {
+        return false;
+    }
+
+    if (rb_store == rb)
+    {
+        return true;
+    }
+
+    /* Compact the surviving chunks in place, only keys present on both sides can survive */
+    while (i < rb_store->size && j < rb->size)
+    {
+        if (rb_store->keys[i] < rb->keys[j])
+        {
+            container_free(&rb_store->containers[i++]);
+        }
+        else if (rb_store->keys[i] > rb->keys[j])
+        {
+            j++;
+        }
+        else
+        {
+            if (!container_and(&rb_store->containers[i], &rb->containers[j], &out))
+            {
+                ok = false;
+
+                break;
+            }
+
+            container_free(&rb_store->containers[i]);
+
+            if (out.cardinality > 0)
+            {
+                rb_store->keys[n] = rb_store->keys[i];
+                rb_store->containers[n++] = out;
+            }
+            else
+            {
+                container_free(&out);
+            }
+
+            i++;
+            j++;
+        }
+    }
+
+    if (!ok)
+    {
+        /* Keep the chunks not processed yet so the bitmap stays consistent */
+        for (; i < rb_store->size; i++)
+        {
+            rb_store->keys[n] = rb_store->keys[i];
+            rb_store->containers[n++] = rb_store->containers[i];
+        }
+    }
+
+    for (; i < rb_store->size; i++)
+    {
+        container_free(&rb_store->containers[i]);
+    }
+
+    rb_store->size = n;
+
+    return ok;
+}
+
+bool roaring_bitmap_or(struct roaring_bitmap *rb_store, struct roaring_bitmap *rb)
+{
+    u16 *keys = NULL;
+    struct roaring_container *containers = NULL;
+    bool *fresh = NULL;
+    u32 capacity = 0;
+    u32 i = 0;
+    u32 j = 0;
+    u32 n = 0;
+    bool ok = true;
+
+    if (!roaring_check(rb_store) || !roaring_check(rb))
+    {
+        return false;
+    }
+
+    if (rb_store == rb || rb->size == 0)
+    {
+        return true;
+    }
+
+    capacity = rb_store->size + rb->size;
+    keys = (u16 *)malloc(capacity * sizeof(u16));
+    containers = (struct roaring_container *)malloc(capacity * sizeof(struct roaring_container));
+    fresh = (bool *)calloc(capacity, sizeof(bool));
+
+    if (keys == NULL || containers == NULL || fresh == NULL)
+    {
+        free(keys);
+        free(containers);
+        free(fresh);
+
+        return false;
+    }
+
+    /* Chunks only in rb_store move over, the others are built new and rb_store is left alone until the end */
+    while (ok && (i < rb_store->size || j < rb->size))
+    {
+        if (j == rb->size || (i < rb_store->size && rb_store->keys[i] < rb->keys[j]))
+        {
+            keys[n] = rb_store->keys[i];
+            containers[n++] = rb_store->containers[i++];
+        }
+        else if (i == rb_store->size || rb_store->keys[i] > rb->keys[j])
+        {
+            keys[n] = rb->keys[j];
+            fresh[n] = true;
+            ok = container_clone(&rb->containers[j++], &containers[n++]);
+        }
+        else
+        {
+            keys[n] = rb->keys[j];
+            fresh[n] = true;
+            ok = container_or(&rb_store->containers[i++], &rb->containers[j++], &containers[n++]);
+        }
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (fresh[i] && !ok)
+        {
+            container_free(&containers[i]);
+        }
+    }
+
+    if (!ok)
+    {
+        free(keys);
+        free(containers);
+        free(fresh);
+
+        return false;
+    }
+
+    /* The old containers of the keys rb also holds have been replaced */
+    for (i = 0; i < rb_store->size; i++)
+    {
+        if (roaring_find_key(rb, rb_store->keys[i], &j))
+        {
+            container_free(&rb_store->containers[i]);
+        }
+    }
+
+    roaring_replace(rb_store, keys, containers, n, capacity);
+    free(fresh);
+
+    return true;
+}
+
+bool roaring_bitmap_not(struct roaring_bitmap *rb, u32 max_value)
+{
+    u16 *keys = NULL;
+    struct roaring_container *containers = NULL;
+    bool *fresh = NULL;
+    u32 last_key = max_value >> 16;
+    u32 capacity = 0;
+    u32 key = 0;
+    u32 hi = 0;
+    u32 i = 0;
+    u32 n = 0;
+    bool ok = true;
+
+    if (!roaring_check(rb))
+    {
+        return false;
+    }
+
+    capacity = rb->size + last_key + 1;
+    keys = (u16 *)malloc(capacity * sizeof(u16));
+    containers = (struct roaring_container *)malloc(capacity * sizeof(struct roaring_container));
+    fresh = (bool *)calloc(capacity, sizeof(bool));
+
+    if (keys == NULL || containers == NULL || fresh == NULL)
+    {
+        free(keys);
+        free(containers);
+        free(fresh);
+
+        return false;
+    }
+
+    for (key = 0; ok && key <= last_key; key++)
+    {
+        hi = key == last_key ? (max_value & 0xFFFF) : 0xFFFF;
+
+        /* Chunks missing from rb become a single full run */
+        if (i == rb->size || rb->keys[i] != key)
+        {
+            keys[n] = (u16)key;
+            fresh[n] = true;
+            ok = container_init(&containers[n], ROARING_RUN, 1) && run_append(&containers[n], 0, hi);
+            containers[n++].cardinality = hi + 1;
+
+            continue;
+        }
+
+        ok = container_not(&rb->containers[i++], hi, &containers[n]);
+
+        if (ok && containers[n].cardinality == 0)
+        {
+            container_free(&containers[n]);
+        }
+        else if (ok)
+        {
+            keys[n] = (u16)key;
+            fresh[n++] = true;
+        }
+    }
+
+    /* Chunks above max_value are kept as they are */
+    for (; ok && i < rb->size; i++)
+    {
+        keys[n] = rb->keys[i];
+        containers[n++] = rb->containers[i];
+    }
+
+    if (!ok)
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (fresh[i])
+            {
+                container_free(&containers[i]);
+            }
+        }
+
+        free(keys);
+        free(containers);
+        free(fresh);
+
+        return false;
+    }
+
+    for (i = 0; i < rb->size && rb->keys[i] <= last_key; i++)
+    {
+        container_free(&rb->containers[i]);
+    }
+
+    roaring_replace(rb, keys, containers, n, capacity);
+    free(fresh);
+
+    return true;
+}
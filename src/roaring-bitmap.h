@@ -0,0 +1,150 @@
+#ifndef ROARING_BITMAP_H_INCLUDED
+#define ROARING_BITMAP_H_INCLUDED
+
+#include <stddef.h>
+#include "bitmap.h"
+
+#define ROARING_CHUNK_BITS 65536
+#define ROARING_BITSET_WORDS (ROARING_CHUNK_BITS / UINT_BITS)
+#define ROARING_ARRAY_MAX 4096 /* An array container holding more values than this is bigger than a bitset */
+
+enum roaring_container_type
+{
+    ROARING_ARRAY = 1, /* Sorted u16 values */
+    ROARING_BITSET,    /* ROARING_BITSET_WORDS u32 words, low 16 bits v at bit v. struct bitmap keeps v at
+                          bit v - 1, so the words of the two can not be copied into each other */
+    ROARING_RUN        /* Sorted struct roaring_run entries */
+};
+
+struct roaring_run
+{
+    u16 start;  /* First value of the run */
+    u16 length; /* Number of values following start, the run covers start..start+length */
+};
+
+struct roaring_container
+{
+    u16 type;        /* One of enum roaring_container_type */
+    u32 cardinality; /* Number of values held, up to ROARING_CHUNK_BITS */
+    u32 size;        /* Values of an array container or runs of a run container */
+    u32 capacity;    /* Entries allocated in data */
+    void *data;
+};
+
+struct roaring_bitmap
+{
+    struct roaring_bitmap *rb_self;        /* The value used when creating a bitmap */
+    u32 size;                              /* Number of non-empty chunks */
+    u32 capacity;                          /* Chunks allocated in keys[] and containers[] */
+    u16 *keys;                             /* High 16 bits of the values of each chunk, sorted */
+    struct roaring_container *containers;  /* Low 16 bits of the values of each chunk */
+};
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_create
+ * Input:  None
+ * Return: Success   pointer to an empty compressed bitmap
+ *         Failed    NULL
+ * Description: Create a compressed bitmap for values 0 to 2^32 - 1. Values are split into 64K chunks
+ *              keyed by their high 16 bits, each chunk is stored as a sorted array, a dense bitset
+ *              or a run list, whichever is smallest
+ *****************************************************************************************************/
+struct roaring_bitmap *roaring_bitmap_create(void);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_destroy
+ * Input:  rb     A compressed bitmap that will be destroyed
+ * Return: None
+ * Description: Destroy a compressed bitmap and all of its containers
+ *****************************************************************************************************/
+void roaring_bitmap_destroy(struct roaring_bitmap *rb);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_add_value
+ * Input:  rb        The compressed bitmap to which the value is added
+ *         value     A value that will be added into the bitmap
+ * Return: Success   true
+ *         Failed    false
+ * Description: Add a value into the compressed bitmap
+ *****************************************************************************************************/
+bool roaring_bitmap_add_value(struct roaring_bitmap *rb, u32 value);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_del_value
+ * Input:  rb        The compressed bitmap from which the value is removed
+ *         value     A value that will be removed from the bitmap
+ * Return: Success   true
+ *         Failed    false (also when the value was not set)
+ * Description: Remove a value from the compressed bitmap
+ *****************************************************************************************************/
+bool roaring_bitmap_del_value(struct roaring_bitmap *rb, u32 value);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_contains
+ * Input:  rb        Pointer to the compressed bitmap
+ *         value     The value to check
+ * Return: Success   true
+ *         Failed    false
+ * Description: Check if a given value is set in the compressed bitmap
+ *****************************************************************************************************/
+bool roaring_bitmap_contains(struct roaring_bitmap *rb, u32 value);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_cardinality
+ * Input:  rb        Pointer to the compressed bitmap
+ * Return: Number of values set, 0 for an invalid bitmap
+ * Description: Sum the cardinality kept by every container
+ *****************************************************************************************************/
+u64 roaring_bitmap_cardinality(struct roaring_bitmap *rb);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_size_in_bytes
+ * Input:  rb        Pointer to the compressed bitmap
+ * Return: Number of bytes the containers of rb use
+ * Description: Report the memory footprint of the bitmap payload
+ *****************************************************************************************************/
+size_t roaring_bitmap_size_in_bytes(struct roaring_bitmap *rb);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_optimize
+ * Input:  rb        Pointer to the compressed bitmap
+ * Return: Success   true
+ *         Failed    false
+ * Description: Convert every container to the smallest of the array, bitset and run layouts.
+ *              add/del only switch layouts at the array/bitset threshold, call this after bulk loads
+ *****************************************************************************************************/
+bool roaring_bitmap_optimize(struct roaring_bitmap *rb);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_or
+ * Input:
+ *    rb_store       A compressed bitmap that participates in binary OR operations and stores the results
+ *    rb             Another compressed bitmap that participates in binary OR operations
+ * Return: Success   true
+ *         Failed    false
+ * Description: Perform binary OR operation (rb_store | rb) chunk by chunk
+ *****************************************************************************************************/
+bool roaring_bitmap_or(struct roaring_bitmap *rb_store, struct roaring_bitmap *rb);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_and
+ * Input:
+ *    rb_store       A compressed bitmap that participates in binary AND operations and stores the results
+ *    rb             Another compressed bitmap that participates in binary AND operations
+ * Return: Success   true
+ *         Failed    false
+ * Description: Perform binary AND operation (rb_store & rb) chunk by chunk
+ *****************************************************************************************************/
+bool roaring_bitmap_and(struct roaring_bitmap *rb_store, struct roaring_bitmap *rb);
+
+/*****************************************************************************************************
+ * Name: roaring_bitmap_not
+ * Input:  rb         A compressed bitmap that will be reversed
+ *         max_value  The last value of the universe that is reversed
+ * Return: Success   true
+ *         Failed    false
+ * Description: Reverse all the values from 0 to max_value, values above max_value are kept
+ *****************************************************************************************************/
+bool roaring_bitmap_not(struct roaring_bitmap *rb, u32 max_value);
+
+#endif // ROARING_BITMAP_H_INCLUDED
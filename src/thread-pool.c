@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include "bitmap.h"
+#include "thread-pool.h"
+
+static bool thread_pool_check(struct thread_pool *pool);
+static void run_chunks(struct thread_pool *pool);
+static void *worker_main(void *arg);
+
+static bool thread_pool_check(struct thread_pool *pool)
+{
+    if (pool != NULL && pool == pool->pool_self)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+/* Called with pool->lock held, the lock is dropped while a chunk runs */
+static void run_chunks(struct thread_pool *pool)
+{
+    size_t chunk = 0;
+    size_t begin = 0;
+    size_t end = 0;
+
+    while (pool->next_chunk < pool->chunks)
+    {
+        chunk = pool->next_chunk++;
+        begin = chunk * pool->grain;
+        end = begin + pool->grain < pool->count ? begin + pool->grain : pool->count;
+
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(pool->arg, chunk, begin, end);
+        pthread_mutex_lock(&pool->lock);
+
+        if (++pool->chunks_done == pool->chunks)
+        {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+
+    return;
+}
+
+static void *worker_main(void *arg)
+{
+    struct thread_pool *pool = (struct thread_pool *)arg;
+    u64 seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (true)
+    {
+        while (!pool->shutdown && pool->generation == seen)
+        {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+
+        if (pool->shutdown)
+        {
+            break;
+        }
+
+        seen = pool->generation;
+        run_chunks(pool);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+struct thread_pool *thread_pool_create(u32 threads)
+{
+    struct thread_pool *pool = NULL;
+    u32 i = 0;
+
+    if (threads == 0 || threads > THREAD_POOL_MAX_THREADS)
+    {
+        return NULL;
+    }
+
+    pool = (struct thread_pool *)calloc(1, sizeof(struct thread_pool));
+
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    pool->pool_self = pool;
+
+    for (i = 0; i < threads; i++)
+    {
+        if (pthread_create(&pool->workers[i], NULL, worker_main, pool) != 0)
+        {
+            break;
+        }
+
+        pool->threads++;
+    }
+
+    if (pool->threads != threads)
+    {
+        thread_pool_destroy(pool);
+
+        return NULL;
+    }
+
+    return pool;
+}
+
+void thread_pool_destroy(struct thread_pool *pool)
+{
+    u32 i = 0;
+
+    if (!thread_pool_check(pool))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->threads; i++)
+    {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run_lock);
+    pool->pool_self = NULL;
+    free(pool);
+
+    return;
+}
+
+void thread_pool_run(struct thread_pool *pool, thread_pool_fn fn, void *arg, size_t count, size_t grain)
+{
+    size_t chunk = 0;
+    size_t begin = 0;
+
+    if (fn == NULL || count == 0 || grain == 0)
+    {
+        return;
+    }
+
+    if (!thread_pool_check(pool))
+    {
+        for (chunk = 0, begin = 0; begin < count; chunk++, begin += grain)
+        {
+            fn(arg, chunk, begin, begin + grain < count ? begin + grain : count);
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&pool->run_lock);
+    pthread_mutex_lock(&pool->lock);
+
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->count = count;
+    pool->grain = grain;
+    pool->chunks = (count + grain - 1) / grain;
+    pool->next_chunk = 0;
+    pool->chunks_done = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    run_chunks(pool);
+
+    while (pool->chunks_done < pool->chunks)
+    {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->run_lock);
+
+    return;
+}
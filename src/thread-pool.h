@@ -0,0 +1,64 @@
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include <stddef.h>
+#include <pthread.h>
+#include "bitmap.h"
+
+#define THREAD_POOL_MAX_THREADS 64
+
+/* Body of a parallel loop, called once per chunk [begin, end) with chunk = begin / grain */
+typedef void (*thread_pool_fn)(void *arg, size_t chunk, size_t begin, size_t end);
+
+/* Fixed set of worker threads that run one parallel loop at a time */
+struct thread_pool
+{
+    struct thread_pool *pool_self;
+    u32 threads;                              /* Worker threads, the caller of thread_pool_run helps as well */
+    pthread_t workers[THREAD_POOL_MAX_THREADS];
+    pthread_mutex_t run_lock;                 /* Serializes thread_pool_run callers */
+    pthread_mutex_t lock;                     /* Protects every field below */
+    pthread_cond_t work_ready;                /* Signalled when a new loop is published */
+    pthread_cond_t work_done;                 /* Signalled when the last chunk of a loop finishes */
+    u64 generation;                           /* Bumped for every loop, workers wait for it to change */
+    bool shutdown;
+    thread_pool_fn fn;
+    void *arg;
+    size_t count;
+    size_t grain;
+    size_t chunks;
+    size_t next_chunk;                        /* Next chunk to hand out */
+    size_t chunks_done;
+};
+
+/*****************************************************************************************************
+ * Name: thread_pool_create
+ * Input:  threads   Number of worker threads, up to THREAD_POOL_MAX_THREADS
+ * Return: Success   pointer to the pool
+ *         Failed    NULL
+ * Description: Start the worker threads, they sleep until thread_pool_run publishes work
+ *****************************************************************************************************/
+struct thread_pool *thread_pool_create(u32 threads);
+
+/*****************************************************************************************************
+ * Name: thread_pool_destroy
+ * Input:  pool      The pool that will be destroyed
+ * Return: None
+ * Description: Stop and join the worker threads, then free the pool
+ *****************************************************************************************************/
+void thread_pool_destroy(struct thread_pool *pool);
+
+/*****************************************************************************************************
+ * Name: thread_pool_run
+ * Input:  pool      The pool that runs the loop, NULL runs it on the calling thread
+ *         fn        The loop body
+ *         arg       Passed to every call of fn
+ *         count     Number of items, [0, count) is split into chunks of grain items
+ *         grain     Items per chunk, the last chunk may be shorter
+ * Return: None
+ * Description: Run fn over every chunk and return once all of them have finished. Chunks are
+ *              handed out dynamically and the calling thread takes part
+ *****************************************************************************************************/
+void thread_pool_run(struct thread_pool *pool, thread_pool_fn fn, void *arg, size_t count, size_t grain);
+
+#endif // THREAD_POOL_H_INCLUDED
@@ -0,0 +1,461 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "bitmap.h"
+#include "word-ops.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define WORD_OPS_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+/* Resolved once by whichever thread gets here first, pool workers may race to do it */
+static _Atomic(const struct word_ops *) word_ops_table = NULL;
+
+/*Portable kernels, also used for the tails the vector kernels leave behind*/
+static void and_scalar(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    u64 a = 0;
+    u64 b = 0;
+    u32 a32 = 0;
+    u32 b32 = 0;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(u64) <= nbytes; i += sizeof(u64))
+    {
+        memcpy(&a, d + i, sizeof(u64));
+        memcpy(&b, s + i, sizeof(u64));
+        a &= b;
+        memcpy(d + i, &a, sizeof(u64));
+    }
+
+    if (i < nbytes)
+    {
+        memcpy(&a32, d + i, sizeof(u32));
+        memcpy(&b32, s + i, sizeof(u32));
+        a32 &= b32;
+        memcpy(d + i, &a32, sizeof(u32));
+    }
+
+    return;
+}
+
+static void or_scalar(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    u64 a = 0;
+    u64 b = 0;
+    u32 a32 = 0;
+    u32 b32 = 0;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(u64) <= nbytes; i += sizeof(u64))
+    {
+        memcpy(&a, d + i, sizeof(u64));
+        memcpy(&b, s + i, sizeof(u64));
+        a |= b;
+        memcpy(d + i, &a, sizeof(u64));
+    }
+
+    if (i < nbytes)
+    {
+        memcpy(&a32, d + i, sizeof(u32));
+        memcpy(&b32, s + i, sizeof(u32));
+        a32 |= b32;
+        memcpy(d + i, &a32, sizeof(u32));
+    }
+
+    return;
+}
+
+static void xor_scalar(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    u64 a = 0;
+    u64 b = 0;
+    u32 a32 = 0;
+    u32 b32 = 0;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(u64) <= nbytes; i += sizeof(u64))
+    {
+        memcpy(&a, d + i, sizeof(u64));
+        memcpy(&b, s + i, sizeof(u64));
+        a ^= b;
+        memcpy(d + i, &a, sizeof(u64));
+    }
+
+    if (i < nbytes)
+    {
+        memcpy(&a32, d + i, sizeof(u32));
+        memcpy(&b32, s + i, sizeof(u32));
+        a32 ^= b32;
+        memcpy(d + i, &a32, sizeof(u32));
+    }
+
+    return;
+}
+
+static void andnot_scalar(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    u64 a = 0;
+    u64 b = 0;
+    u32 a32 = 0;
+    u32 b32 = 0;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(u64) <= nbytes; i += sizeof(u64))
+    {
+        memcpy(&a, d + i, sizeof(u64));
+        memcpy(&b, s + i, sizeof(u64));
+        a &= ~b;
+        memcpy(d + i, &a, sizeof(u64));
+    }
+
+    if (i < nbytes)
+    {
+        memcpy(&a32, d + i, sizeof(u32));
+        memcpy(&b32, s + i, sizeof(u32));
+        a32 &= ~b32;
+        memcpy(d + i, &a32, sizeof(u32));
+    }
+
+    return;
+}
+
+static void not_scalar(void *dst, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    u64 a = 0;
+    u32 a32 = 0;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(u64) <= nbytes; i += sizeof(u64))
+    {
+        memcpy(&a, d + i, sizeof(u64));
+        a = ~a;
+        memcpy(d + i, &a, sizeof(u64));
+    }
+
+    if (i < nbytes)
+    {
+        memcpy(&a32, d + i, sizeof(u32));
+        a32 = ~a32;
+        memcpy(d + i, &a32, sizeof(u32));
+    }
+
+    return;
+}
+
+static const struct word_ops word_ops_scalar = {"scalar", and_scalar, or_scalar, xor_scalar, andnot_scalar, not_scalar};
+
+#ifdef WORD_OPS_X86_DISPATCH
+__attribute__((target("sse2")))
+static void and_sse2(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m128i) <= nbytes; i += sizeof(__m128i))
+    {
+        _mm_storeu_si128((__m128i *)(d + i), _mm_and_si128(_mm_loadu_si128((const __m128i *)(d + i)),
+                                                           _mm_loadu_si128((const __m128i *)(s + i))));
+    }
+
+    and_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("sse2")))
+static void or_sse2(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m128i) <= nbytes; i += sizeof(__m128i))
+    {
+        _mm_storeu_si128((__m128i *)(d + i), _mm_or_si128(_mm_loadu_si128((const __m128i *)(d + i)),
+                                                          _mm_loadu_si128((const __m128i *)(s + i))));
+    }
+
+    or_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("sse2")))
+static void xor_sse2(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m128i) <= nbytes; i += sizeof(__m128i))
+    {
+        _mm_storeu_si128((__m128i *)(d + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(d + i)),
+                                                           _mm_loadu_si128((const __m128i *)(s + i))));
+    }
+
+    xor_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("sse2")))
+static void andnot_sse2(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m128i) <= nbytes; i += sizeof(__m128i))
+    {
+        _mm_storeu_si128((__m128i *)(d + i), _mm_andnot_si128(_mm_loadu_si128((const __m128i *)(s + i)),
+                                                              _mm_loadu_si128((const __m128i *)(d + i))));
+    }
+
+    andnot_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("sse2")))
+static void not_sse2(void *dst, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const __m128i ones = _mm_set1_epi32(-1);
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m128i) <= nbytes; i += sizeof(__m128i))
+    {
+        _mm_storeu_si128((__m128i *)(d + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(d + i)), ones));
+    }
+
+    not_scalar(d + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx2")))
+static void and_avx2(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m256i) <= nbytes; i += sizeof(__m256i))
+    {
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(d + i)),
+                                                                 _mm256_loadu_si256((const __m256i *)(s + i))));
+    }
+
+    and_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx2")))
+static void or_avx2(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m256i) <= nbytes; i += sizeof(__m256i))
+    {
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(d + i)),
+                                                                _mm256_loadu_si256((const __m256i *)(s + i))));
+    }
+
+    or_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx2")))
+static void xor_avx2(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m256i) <= nbytes; i += sizeof(__m256i))
+    {
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(d + i)),
+                                                                 _mm256_loadu_si256((const __m256i *)(s + i))));
+    }
+
+    xor_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx2")))
+static void andnot_avx2(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m256i) <= nbytes; i += sizeof(__m256i))
+    {
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_andnot_si256(_mm256_loadu_si256((const __m256i *)(s + i)),
+                                                                    _mm256_loadu_si256((const __m256i *)(d + i))));
+    }
+
+    andnot_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx2")))
+static void not_avx2(void *dst, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const __m256i ones = _mm256_set1_epi32(-1);
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m256i) <= nbytes; i += sizeof(__m256i))
+    {
+        _mm256_storeu_si256((__m256i *)(d + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(d + i)), ones));
+    }
+
+    not_scalar(d + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx512f")))
+static void and_avx512(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m512i) <= nbytes; i += sizeof(__m512i))
+    {
+        _mm512_storeu_si512((void *)(d + i), _mm512_and_si512(_mm512_loadu_si512((const void *)(d + i)),
+                                                              _mm512_loadu_si512((const void *)(s + i))));
+    }
+
+    and_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx512f")))
+static void or_avx512(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m512i) <= nbytes; i += sizeof(__m512i))
+    {
+        _mm512_storeu_si512((void *)(d + i), _mm512_or_si512(_mm512_loadu_si512((const void *)(d + i)),
+                                                             _mm512_loadu_si512((const void *)(s + i))));
+    }
+
+    or_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx512f")))
+static void xor_avx512(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m512i) <= nbytes; i += sizeof(__m512i))
+    {
+        _mm512_storeu_si512((void *)(d + i), _mm512_xor_si512(_mm512_loadu_si512((const void *)(d + i)),
+                                                              _mm512_loadu_si512((const void *)(s + i))));
+    }
+
+    xor_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx512f")))
+static void andnot_avx512(void *dst, const void *src, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m512i) <= nbytes; i += sizeof(__m512i))
+    {
+        _mm512_storeu_si512((void *)(d + i), _mm512_andnot_si512(_mm512_loadu_si512((const void *)(s + i)),
+                                                                 _mm512_loadu_si512((const void *)(d + i))));
+    }
+
+    andnot_scalar(d + i, s + i, nbytes - i);
+
+    return;
+}
+
+__attribute__((target("avx512f")))
+static void not_avx512(void *dst, size_t nbytes)
+{
+    u8 *d = (u8 *)dst;
+    const __m512i ones = _mm512_set1_epi32(-1);
+    size_t i = 0;
+
+    for (i = 0; i + sizeof(__m512i) <= nbytes; i += sizeof(__m512i))
+    {
+        _mm512_storeu_si512((void *)(d + i), _mm512_xor_si512(_mm512_loadu_si512((const void *)(d + i)), ones));
+    }
+
+    not_scalar(d + i, nbytes - i);
+
+    return;
+}
+
+static const struct word_ops word_ops_sse2 = {"sse2", and_sse2, or_sse2, xor_sse2, andnot_sse2, not_sse2};
+static const struct word_ops word_ops_avx2 = {"avx2", and_avx2, or_avx2, xor_avx2, andnot_avx2, not_avx2};
+static const struct word_ops word_ops_avx512 = {"avx512", and_avx512, or_avx512, xor_avx512, andnot_avx512, not_avx512};
+#endif
+
+const struct word_ops *word_ops_get(void)
+{
+    const struct word_ops *table = atomic_load_explicit(&word_ops_table, memory_order_acquire);
+
+    if (table != NULL)
+    {
+        return table;
+    }
+
+    table = &word_ops_scalar;
+
+#ifdef WORD_OPS_X86_DISPATCH
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        table = &word_ops_avx512;
+    }
+    else if (__builtin_cpu_supports("avx2"))
+    {
+        table = &word_ops_avx2;
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        table = &word_ops_sse2;
+    }
+#endif
+
+    atomic_store_explicit(&word_ops_table, table, memory_order_release);
+
+    return table;
+}
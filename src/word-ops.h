@@ -0,0 +1,27 @@
+#ifndef WORD_OPS_H_INCLUDED
+#define WORD_OPS_H_INCLUDED
+
+#include <stddef.h>
+#include "bitmap.h"
+
+/* Bulk word kernels shared by the bitmap set operations, nbytes is always a multiple of 4 */
+struct word_ops
+{
+    const char *name;                                                /* "avx512", "avx2", "sse2" or "scalar" */
+    void (*and_words)(void *dst, const void *src, size_t nbytes);    /* dst &= src */
+    void (*or_words)(void *dst, const void *src, size_t nbytes);     /* dst |= src */
+    void (*xor_words)(void *dst, const void *src, size_t nbytes);    /* dst ^= src */
+    void (*andnot_words)(void *dst, const void *src, size_t nbytes); /* dst &= ~src */
+    void (*not_words)(void *dst, size_t nbytes);                     /* dst = ~dst */
+};
+
+/*****************************************************************************************************
+ * Name: word_ops_get
+ * Input:  None
+ * Return: The kernel table for the running CPU
+ * Description: Pick the widest of the AVX-512, AVX2, SSE2 and scalar kernels the CPU supports.
+ *              The table is chosen once with CPUID and reused for every later call
+ *****************************************************************************************************/
+const struct word_ops *word_ops_get(void);
+
+#endif // WORD_OPS_H_INCLUDED